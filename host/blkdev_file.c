@@ -0,0 +1,51 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "blkdev.h"
+
+// Disk image backend for the native build: pread/pwrite on a raw image such as
+// one made by mkfs.fat or tools/mksdimg.py. ctx carries the file descriptor
+
+#define FD(ctx) ((int)(intptr_t)(ctx))
+
+static int file_read(void *ctx, uint32_t lba, uint32_t count, void *buf) {
+    size_t len = (size_t)count * BLKDEV_SECTOR;
+    ssize_t n = pread(FD(ctx), buf, len, (off_t)lba * BLKDEV_SECTOR);
+    return n == (ssize_t)len ? 0 : -1;
+}
+
+static int file_write(void *ctx, uint32_t lba, uint32_t count, const void *buf) {
+    size_t len = (size_t)count * BLKDEV_SECTOR;
+    ssize_t n = pwrite(FD(ctx), buf, len, (off_t)lba * BLKDEV_SECTOR);
+    return n == (ssize_t)len ? 0 : -1;
+}
+
+static int file_flush(void *ctx) {
+    return fdatasync(FD(ctx)) == 0 ? 0 : -1;
+}
+
+static const struct blkdev_ops_t file_ops = { file_read, file_write, file_flush, NULL, NULL };
+
+int file_blkdev_open(struct blkdev_t *dev, const char *path) {
+    struct stat st;
+    int fd = open(path, O_RDWR);
+    if (fd < 0) return -1;
+    if (fstat(fd, &st) != 0 || st.st_size < BLKDEV_SECTOR) {
+        close(fd);
+        return -2;
+    }
+    dev->ops = &file_ops;
+    dev->ctx = (void *)(intptr_t)fd;
+    dev->sectors = (uint32_t)(st.st_size / BLKDEV_SECTOR);
+#ifdef IO_STATS
+    blkdev_stats_reset(dev);
+#endif
+    return 0;
+}
+
+void file_blkdev_close(struct blkdev_t *dev) {
+    close(FD(dev->ctx));
+    dev->ops = 0;
+}
@@ -0,0 +1,55 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "blkdev.h"
+#include "bench.h"
+
+// Native benchmark driver: the storage benchmark from src/bench.c against a disk
+// image, either through the file backend or copied into a RAM disk first so the
+// numbers (and perf profiles) are the filesystem's alone. The file backend writes
+// to the image; the RAM disk leaves it untouched.
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [--ram] image.img\n", prog);
+    exit(2);
+}
+
+static int load_ramdisk(struct blkdev_t *dev, const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return -1;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    rewind(f);
+
+    uint32_t sectors = (uint32_t)(size / BLKDEV_SECTOR);
+    void *mem = malloc((size_t)sectors * BLKDEV_SECTOR);
+    if (!mem || fread(mem, BLKDEV_SECTOR, sectors, f) != sectors) {
+        free(mem);
+        fclose(f);
+        return -2;
+    }
+    fclose(f);
+    ramdisk_init(dev, mem, sectors);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    struct blkdev_t dev;
+    int ram = 0, res;
+
+    if (argc == 3 && strcmp(argv[1], "--ram") == 0) ram = 1;
+    else if (argc != 2) usage(argv[0]);
+    const char *path = argv[argc - 1];
+
+    res = ram ? load_ramdisk(&dev, path) : file_blkdev_open(&dev, path);
+    if (res != 0) {
+        fprintf(stderr, "%s: cannot open %s (%d)\n", argv[0], path, res);
+        return 1;
+    }
+
+    res = storage_bench(&dev);
+
+    if (ram) free(dev.ctx);
+    else file_blkdev_close(&dev);
+    return res == 0 ? 0 : 1;
+}
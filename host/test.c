@@ -0,0 +1,61 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "test.h"
+
+int test_failures;
+
+void test_fail(const char *file, int line, const char *expr, long long got, long long want) {
+    test_failures++;
+    if (got == want) fprintf(stderr, "%s:%d: CHECK(%s) failed\n", file, line, expr);
+    else fprintf(stderr, "%s:%d: CHECK(%s) failed: got %lld, want %lld\n", file, line, expr, got, want);
+}
+
+int test_ramdisk(struct blkdev_t *dev, const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return -1;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    rewind(f);
+
+    uint32_t sectors = (uint32_t)(size / BLKDEV_SECTOR);
+    void *mem = malloc((size_t)sectors * BLKDEV_SECTOR);
+    if (!mem || fread(mem, BLKDEV_SECTOR, sectors, f) != sectors) {
+        free(mem);
+        fclose(f);
+        return -2;
+    }
+    fclose(f);
+    ramdisk_init(dev, mem, sectors);
+    return 0;
+}
+
+void test_ramdisk_free(struct blkdev_t *dev) {
+    free(dev->ctx);
+    dev->ctx = NULL;
+}
+
+// Same formula as pattern() in tools/mksdimg.py
+uint8_t test_pattern(uint32_t i, uint32_t seed) {
+    return (uint8_t)(i * 31 + (i >> 9) + seed);
+}
+
+void test_fill(uint8_t *buf, uint32_t offset, uint32_t size, uint32_t seed) {
+    for (uint32_t i = 0; i < size; i++) buf[i] = test_pattern(offset + i, seed);
+}
+
+// 1 if buf holds bytes [offset, offset + size) of the pattern
+int test_verify(const uint8_t *buf, uint32_t offset, uint32_t size, uint32_t seed) {
+    for (uint32_t i = 0; i < size; i++) {
+        if (buf[i] != test_pattern(offset + i, seed)) return 0;
+    }
+    return 1;
+}
+
+int test_exit(const char *name) {
+    if (test_failures) {
+        fprintf(stderr, "%s: %d check(s) failed\n", name, test_failures);
+        return 1;
+    }
+    printf("%s: ok\n", name);
+    return 0;
+}
@@ -0,0 +1,35 @@
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <stdint.h>
+#include "blkdev.h"
+
+// Shared bits of the host tests (test_*.c). A failed CHECK is reported and counted
+// and the test carries on; test_exit turns the count into the exit status.
+// Tests work on a RAM disk copy of their image, so the image is never modified.
+
+extern int test_failures;
+
+void test_fail(const char *file, int line, const char *expr, long long got, long long want);
+
+#define CHECK(cond) do { \
+    if (!(cond)) test_fail(__FILE__, __LINE__, #cond, 0, 0); \
+} while (0)
+
+#define CHECK_EQ(got, want) do { \
+    long long g_ = (long long)(got), w_ = (long long)(want); \
+    if (g_ != w_) test_fail(__FILE__, __LINE__, #got " == " #want, g_, w_); \
+} while (0)
+
+// Whole image into a RAM disk; test_ramdisk_free releases it
+int test_ramdisk(struct blkdev_t *dev, const char *path);
+void test_ramdisk_free(struct blkdev_t *dev);
+
+// Deterministic file contents: byte i of a stream with the given seed
+uint8_t test_pattern(uint32_t i, uint32_t seed);
+void test_fill(uint8_t *buf, uint32_t offset, uint32_t size, uint32_t seed);
+int test_verify(const uint8_t *buf, uint32_t offset, uint32_t size, uint32_t seed);
+
+int test_exit(const char *name);
+
+#endif
@@ -0,0 +1,305 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fat32.h"
+#include "crc32.h"
+#include "test.h"
+
+// Asynchronous reads and writes on a device that completes nothing by itself: submit
+// only queues, and each poll finishes the oldest request. The test sees the handle
+// move on at submission, the callbacks run in order and only from a poll, the dirent
+// catch up at close, and the data come back through a fresh mount. An injected FAT
+// read failure in the middle of a request must leave the handle and the chain as
+// they were. Calls that move or read a file's chain wait for its requests first.
+
+#define QUEUE   64
+#define CHUNK   (8 * 1024 + 512)    // Not a cluster multiple: requests start mid-cluster
+#define CHUNKS  6
+
+// The deferred device, over a RAM disk. Synchronous calls first carry out the queued
+// transfers (without completing them), so they are ordered after everything submitted
+struct deferred_t {
+    struct blkdev_t *ram;
+    struct blk_req_t *queue[QUEUE];
+    uint8_t ran[QUEUE];             // Transfer done, res stored, done not run yet
+    uint32_t head, tail;
+    uint32_t fail_lba;              // One synchronous read of this sector fails
+    uint32_t failed;
+};
+
+static void run_queued(struct deferred_t *d) {
+    for (uint32_t i = d->head; i != d->tail; i++) {
+        struct blk_req_t *req = d->queue[i % QUEUE];
+        if (d->ran[i % QUEUE]) continue;
+        if (req->op == BLK_OP_READ) req->res = blk_read(d->ram, req->lba, req->count, req->buf);
+        else if (req->op == BLK_OP_WRITE) req->res = blk_write(d->ram, req->lba, req->count, req->buf);
+        else req->res = blk_flush(d->ram);
+        d->ran[i % QUEUE] = 1;
+    }
+}
+
+static int deferred_read(void *ctx, uint32_t lba, uint32_t count, void *buf) {
+    struct deferred_t *d = ctx;
+    run_queued(d);
+    if (lba == d->fail_lba) {
+        d->fail_lba = 0xFFFFFFFF;
+        d->failed++;
+        return -5;
+    }
+    return blk_read(d->ram, lba, count, buf);
+}
+
+static int deferred_write(void *ctx, uint32_t lba, uint32_t count, const void *buf) {
+    struct deferred_t *d = ctx;
+    run_queued(d);
+    return blk_write(d->ram, lba, count, buf);
+}
+
+static int deferred_flush(void *ctx) {
+    run_queued(ctx);
+    return 0;
+}
+
+static int deferred_submit(void *ctx, struct blk_req_t *req) {
+    struct deferred_t *d = ctx;
+    if (d->tail - d->head == QUEUE) return -3;
+    d->ran[d->tail % QUEUE] = 0;
+    d->queue[d->tail++ % QUEUE] = req;
+    return 0;
+}
+
+// One request per call, oldest first
+static int deferred_poll(void *ctx) {
+    struct deferred_t *d = ctx;
+    if (d->head == d->tail) return 0;
+    run_queued(d);
+    struct blk_req_t *req = d->queue[d->head++ % QUEUE];
+    blk_complete(req, req->res);
+    return 1;
+}
+
+static const struct blkdev_ops_t deferred_ops = {
+    deferred_read, deferred_write, deferred_flush, deferred_submit, deferred_poll,
+};
+
+static struct deferred_t deferred;
+static struct fat32_aio_t aio[CHUNKS];
+static int completed[CHUNKS], ncompleted;
+static uint8_t *data;
+
+static void on_done(struct fat32_aio_t *a, void *ctx) {
+    (void)ctx;
+    completed[ncompleted++] = (int)(a - aio);
+}
+
+// Size of 'path' as a fresh mount sees it
+static uint32_t on_disk_size(struct blkdev_t *dev, const char *path) {
+    struct fat32_fs_t fs;
+    struct fat32_file_t f;
+    uint32_t size = 0xFFFFFFFF;
+
+    CHECK_EQ(fat32_mount(&fs, dev), 0);
+    if (fat32_open(&fs, path, &f) == 0) size = f.size;
+    fat32_unmount(&fs);
+    return size;
+}
+
+// File contents through a fresh mount: size from the dirent, data against the pattern
+static void check_on_disk(struct blkdev_t *dev, const char *path, uint32_t size, uint32_t seed) {
+    struct fat32_fs_t fs;
+    struct fat32_file_t f;
+    struct fat32_frag_stats_t st;
+
+    CHECK_EQ(fat32_mount(&fs, dev), 0);
+    CHECK_EQ(fat32_open(&fs, path, &f), 0);
+    CHECK_EQ(f.size, size);
+    memset(data, 0, size);
+    CHECK_EQ(fat32_read(&fs, &f, data, size), size);
+    CHECK(test_verify(data, 0, size, seed));
+    CHECK_EQ(fat32_file_fragmentation(&fs, &f, &st), 0);
+    CHECK_EQ(st.fragments, 1);      // No cluster was skipped or left behind
+    CHECK_EQ(fat32_unmount(&fs), 0);
+}
+
+// A stream of appends is mapped at once and completes, in order, only as the device is polled
+static void test_write_stream(struct fat32_fs_t *fs, struct blkdev_t *dev) {
+    struct fat32_file_t f;
+    uint32_t seed = 1, total = CHUNKS * CHUNK;
+
+    test_fill(data, 0, total + 100, seed);
+    CHECK_EQ(fat32_create(fs, "STREAM.BIN", &f), 0);
+    ncompleted = 0;
+    for (int i = 0; i < CHUNKS; i++) {
+        CHECK_EQ(fat32_write_async(fs, &f, data + i * CHUNK, CHUNK, &aio[i], on_done, NULL), 0);
+        CHECK_EQ(f.position, (i + 1) * CHUNK);
+        CHECK_EQ(f.size, (i + 1) * CHUNK);
+    }
+    CHECK_EQ(ncompleted, 0);
+    CHECK_EQ(f.aio_pending, CHUNKS);
+    for (int i = 0; i < CHUNKS; i++) CHECK(!fat32_aio_done(&aio[i]));
+
+    while (deferred.head != deferred.tail) fat32_aio_poll(fs);
+    CHECK_EQ(ncompleted, CHUNKS);
+    for (int i = 0; i < CHUNKS; i++) {
+        CHECK_EQ(completed[i], i);
+        CHECK_EQ(aio[i].result, CHUNK);
+    }
+    CHECK_EQ(f.aio_pending, 0);
+    CHECK_EQ(on_disk_size(dev, "STREAM.BIN"), 0);   // Dirent not written before close
+
+    // An unaligned tail takes the synchronous path and completes in the call
+    CHECK_EQ(fat32_write_async(fs, &f, data + total, 100, &aio[0], on_done, NULL), 0);
+    CHECK_EQ(ncompleted, CHUNKS + 1);
+    CHECK_EQ(aio[0].result, 100);
+    total += 100;
+
+    CHECK_EQ(fat32_close(fs, &f), 0);
+    check_on_disk(dev, "STREAM.BIN", total, seed);
+}
+
+// Reads into separate buffers, completed in order, each with its slice of the file
+static void test_read_stream(struct fat32_fs_t *fs) {
+    struct fat32_file_t f;
+    uint8_t *out = malloc(CHUNKS * CHUNK);
+
+    CHECK_EQ(fat32_open(fs, "STREAM.BIN", &f), 0);
+    memset(out, 0, CHUNKS * CHUNK);
+    ncompleted = 0;
+    for (int i = 0; i < CHUNKS; i++) {
+        CHECK_EQ(fat32_read_async(fs, &f, out + i * CHUNK, CHUNK, &aio[i], on_done, NULL), 0);
+    }
+    CHECK_EQ(f.position, CHUNKS * CHUNK);
+    CHECK_EQ(ncompleted, 0);
+    CHECK_EQ(fat32_aio_wait(fs, &aio[CHUNKS - 1]), CHUNK);
+    CHECK_EQ(ncompleted, CHUNKS);
+    for (int i = 0; i < CHUNKS; i++) CHECK_EQ(completed[i], i);
+    CHECK(test_verify(out, 0, CHUNKS * CHUNK, 1));
+
+    // Past the end only what is there is read: the 100-byte tail, synchronously
+    CHECK_EQ(fat32_read_async(fs, &f, out, CHUNK, &aio[0], on_done, NULL), 0);
+    CHECK_EQ(aio[0].result, 100);
+    CHECK(test_verify(out, CHUNKS * CHUNK, 100, 1));
+    free(out);
+}
+
+// The FAT sector the chain's next link goes into fails to load halfway through a
+// request that crosses into the next FAT sector
+static void test_map_failure(struct fat32_fs_t *fs, struct blkdev_t *dev) {
+    struct fat32_file_t f;
+    uint32_t seed = 2, bpc = fs->bytes_per_cluster;
+
+    test_fill(data, 0, 136 * bpc, seed);
+    CHECK_EQ(fat32_create(fs, "FAIL.BIN", &f), 0);
+    CHECK_EQ(fat32_write_async(fs, &f, data, bpc, &aio[0], NULL, NULL), 0);
+    CHECK_EQ(fat32_aio_wait(fs, &aio[0]), bpc);
+
+    // Fill up to two clusters short of the next FAT sector, so the request below links
+    // one cluster in this sector and then has to come back to it for the next
+    uint32_t boundary = (f.start_cluster / 128 + 1) * 128;
+    if (boundary - f.start_cluster < 3) boundary += 128;
+    uint32_t first = (boundary - 1 - f.start_cluster) * bpc;
+    CHECK_EQ(fat32_write_async(fs, &f, data + bpc, first - bpc, &aio[0], NULL, NULL), 0);
+    CHECK_EQ(fat32_aio_wait(fs, &aio[0]), first - bpc);
+    CHECK_EQ(f.current_cluster, boundary - 2);
+    CHECK_EQ(fs->cached_fat_sector, fs->fat_start_lba + (boundary - 1) / 128);
+
+    uint32_t start = f.start_cluster, current = f.current_cluster;
+    ncompleted = 0;
+    deferred.fail_lba = fs->fat_start_lba + (boundary - 1) / 128;
+    CHECK(fat32_write_async(fs, &f, data + first, 4 * bpc, &aio[1], on_done, NULL) < 0);
+    CHECK_EQ(deferred.failed, 1);
+    CHECK_EQ(f.position, first);
+    CHECK_EQ(f.size, first);
+    CHECK_EQ(f.start_cluster, start);
+    CHECK_EQ(f.current_cluster, current);
+    CHECK_EQ(f.aio_pending, 0);
+    CHECK_EQ(deferred.head, deferred.tail);         // Nothing was submitted
+    CHECK_EQ(ncompleted, 0);
+
+    // The same request again, now going through, on the clusters given back
+    CHECK_EQ(fat32_write_async(fs, &f, data + first, 4 * bpc, &aio[1], on_done, NULL), 0);
+    CHECK_EQ(fat32_aio_wait(fs, &aio[1]), 4 * bpc);
+    CHECK_EQ(ncompleted, 1);
+    CHECK_EQ(fat32_close(fs, &f), 0);
+    check_on_disk(dev, "FAIL.BIN", first + 4 * bpc, seed);
+}
+
+// Two files grown in alternate clusters by queued writes; the defragmenter moves one of
+// them with all of those still in flight
+static void test_defrag_pending(struct fat32_fs_t *fs, struct blkdev_t *dev) {
+    struct fat32_file_t a, b;
+    uint32_t bpc = fs->bytes_per_cluster;
+
+    test_fill(data, 0, CHUNKS * bpc, 3);
+    CHECK_EQ(fat32_create(fs, "FRAG_A.BIN", &a), 0);
+    CHECK_EQ(fat32_create(fs, "FRAG_B.BIN", &b), 0);
+    ncompleted = 0;
+    for (int i = 0; i < CHUNKS; i += 2) {
+        CHECK_EQ(fat32_write_async(fs, &a, data + i * bpc, 2 * bpc, &aio[i], on_done, NULL), 0);
+        CHECK_EQ(fat32_write_async(fs, &b, data + i * bpc, 2 * bpc, &aio[i + 1], on_done, NULL), 0);
+    }
+    CHECK_EQ(ncompleted, 0);
+
+    CHECK_EQ(fat32_defragment(fs, &a), 1);
+    CHECK_EQ(a.aio_pending, 0);
+    for (int i = 0; i < CHUNKS; i += 2) CHECK_EQ(aio[i].result, 2 * bpc);
+    CHECK_EQ(fat32_close(fs, &a), 0);
+    CHECK_EQ(fat32_close(fs, &b), 0);
+    CHECK_EQ(ncompleted, CHUNKS);
+    check_on_disk(dev, "FRAG_A.BIN", CHUNKS * bpc, 3);
+}
+
+// The checksum of a file with queued writes covers the data they carry
+static void test_checksum_pending(struct fat32_fs_t *fs) {
+    struct fat32_file_t f;
+    uint32_t crc = 0;
+
+    test_fill(data, 0, CHUNKS * CHUNK, 4);
+    CHECK_EQ(fat32_create(fs, "SUM.BIN", &f), 0);
+    ncompleted = 0;
+    for (int i = 0; i < CHUNKS; i++) {
+        CHECK_EQ(fat32_write_async(fs, &f, data + i * CHUNK, CHUNK, &aio[i], on_done, NULL), 0);
+    }
+    CHECK_EQ(ncompleted, 0);
+    CHECK_EQ(fat32_checksum(fs, &f, &crc), 0);
+    CHECK_EQ(ncompleted, CHUNKS);
+    CHECK_EQ(crc, crc32_update(0, data, CHUNKS * CHUNK));
+    CHECK_EQ(fat32_close(fs, &f), 0);
+}
+
+int main(int argc, char **argv) {
+    struct blkdev_t ram, dev;
+    struct fat32_fs_t fs;
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s fat32.img\n", argv[0]);
+        return 2;
+    }
+    if (test_ramdisk(&ram, argv[1]) != 0) {
+        fprintf(stderr, "%s: cannot load %s\n", argv[0], argv[1]);
+        return 1;
+    }
+    deferred.ram = &ram;
+    deferred.fail_lba = 0xFFFFFFFF;
+    dev.ops = &deferred_ops;
+    dev.ctx = &deferred;
+    dev.sectors = ram.sectors;
+#ifdef IO_STATS
+    blkdev_stats_reset(&dev);
+#endif
+
+    CHECK_EQ(fat32_mount(&fs, &dev), 0);
+    if (test_failures) return test_exit("test_aio");
+    data = malloc(136 * fs.bytes_per_cluster);      // Past the next FAT sector, see test_map_failure
+    test_write_stream(&fs, &dev);
+    test_read_stream(&fs);
+    test_map_failure(&fs, &dev);
+    test_defrag_pending(&fs, &dev);
+    test_checksum_pending(&fs);
+    CHECK_EQ(fs.sectors.in_use, 0);     // Every scratch sector went back to the pool
+    CHECK_EQ(fat32_unmount(&fs), 0);
+
+    free(data);
+    test_ramdisk_free(&ram);
+    return test_exit("test_aio");
+}
@@ -0,0 +1,235 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fat32.h"
+#include "crc32.h"
+#include "test.h"
+
+// Defragmenter on a FAT32 image with small clusters: files written in interleaved
+// one-cluster pieces are moved into single runs, file by file and volume-wide,
+// with their data, CRCs and the FAT checked afterwards. On a volume filled up to
+// the last cluster the same files must be skipped and left exactly as they were.
+
+#define FILES  3
+#define ROUNDS 8
+
+struct test_file_t {
+    const char *path;
+    uint32_t seed;
+    uint32_t size;
+};
+
+static struct test_file_t files[FILES] = {
+    { "A.BIN", 1, 0 }, { "B.BIN", 2, 0 }, { "C.BIN", 3, 0 },
+};
+
+static uint8_t *data;   // Scratch for whole files
+
+// FAT entry straight from the device, past the engine's cache (flushed by the caller)
+static uint32_t fat_entry(struct fat32_fs_t *fs, uint32_t c) {
+    uint32_t sector[128];
+    if (blk_read(fs->dev, fs->fat_start_lba + c / 128, 1, sector) != 0) return 0xFFFFFFFF;
+    return sector[c % 128] & 0x0FFFFFFF;
+}
+
+// Walks a chain from the on-disk FAT, marking its clusters in 'owned'. The chain has to
+// hold exactly the clusters its size needs, end in EOF and share no cluster with another
+static uint32_t check_chain(struct fat32_fs_t *fs, uint32_t start, uint32_t size, uint8_t *owned) {
+    uint32_t want = (size + fs->bytes_per_cluster - 1) / fs->bytes_per_cluster;
+    uint32_t n = 0, c = start;
+
+    while (c >= 2 && c < 0x0FFFFFF8 && n <= want) {
+        if (c >= fs->total_clusters + 2) break;
+        CHECK(!owned[c]);
+        owned[c] = 1;
+        n++;
+        c = fat_entry(fs, c);
+    }
+    CHECK_EQ(n, want);
+    CHECK(c >= 0x0FFFFFF8);
+    return n;
+}
+
+// Every cluster in use belongs to exactly one of the root directory, hello_world.txt and
+// the test files (plus 'extra' clusters of a filler file), and nothing else is allocated
+static void check_volume(struct fat32_fs_t *fs, const char *filler) {
+    uint8_t *owned = calloc(fs->total_clusters + 2, 1);
+    struct fat32_file_t f;
+    uint32_t chained = 0, used = 0;
+
+    chained += check_chain(fs, fs->root_cluster, fs->bytes_per_cluster, owned);
+    CHECK_EQ(fat32_open(fs, "hello_world.txt", &f), 0);
+    chained += check_chain(fs, f.start_cluster, f.size, owned);
+    for (int i = 0; i < FILES; i++) {
+        CHECK_EQ(fat32_open(fs, files[i].path, &f), 0);
+        CHECK_EQ(f.size, files[i].size);
+        chained += check_chain(fs, f.start_cluster, f.size, owned);
+    }
+    if (filler) {
+        CHECK_EQ(fat32_open(fs, filler, &f), 0);
+        chained += check_chain(fs, f.start_cluster, f.size, owned);
+    }
+
+    for (uint32_t c = 2; c < fs->total_clusters + 2; c++) {
+        if (fat_entry(fs, c) != 0) used++;
+    }
+    CHECK_EQ(used, chained);
+    free(owned);
+}
+
+// Contents through fat32_read and fat32_checksum, against the pattern and its CRC
+static void check_data(struct fat32_fs_t *fs, const struct test_file_t *t) {
+    struct fat32_file_t f;
+    uint32_t crc = 0;
+
+    CHECK_EQ(fat32_open(fs, t->path, &f), 0);
+    CHECK_EQ(fat32_read(fs, &f, data, t->size), t->size);
+    CHECK(test_verify(data, 0, t->size, t->seed));
+    test_fill(data, 0, t->size, t->seed);
+    CHECK_EQ(fat32_checksum(fs, &f, &crc), 0);
+    CHECK_EQ(crc, crc32_update(0, data, t->size));
+}
+
+static uint32_t file_fragments(struct fat32_fs_t *fs, const char *path) {
+    struct fat32_file_t f;
+    struct fat32_frag_stats_t st;
+    CHECK_EQ(fat32_open(fs, path, &f), 0);
+    CHECK_EQ(fat32_file_fragmentation(fs, &f, &st), 0);
+    return st.fragments;
+}
+
+// ROUNDS one-cluster pieces per file, round robin, so every file ends up in ROUNDS runs.
+// The last piece is short, so the sizes are not cluster multiples
+static void write_interleaved(struct fat32_fs_t *fs) {
+    struct fat32_file_t f[FILES];
+    uint32_t bpc = fs->bytes_per_cluster;
+
+    for (int i = 0; i < FILES; i++) {
+        CHECK_EQ(fat32_create(fs, files[i].path, &f[i]), 0);
+        files[i].size = (ROUNDS - 1) * bpc + bpc / 2 + 3 * i;
+    }
+    for (int r = 0; r < ROUNDS; r++) {
+        for (int i = 0; i < FILES; i++) {
+            uint32_t off = r * bpc;
+            uint32_t n = files[i].size - off < bpc ? files[i].size - off : bpc;
+            test_fill(data, off, n, files[i].seed);
+            CHECK_EQ(fat32_write(fs, &f[i], data, n), n);
+        }
+    }
+    for (int i = 0; i < FILES; i++) {
+        CHECK_EQ(fat32_close(fs, &f[i]), 0);
+        CHECK_EQ(file_fragments(fs, files[i].path), ROUNDS);
+    }
+}
+
+static void test_defragment(const char *image) {
+    struct blkdev_t dev;
+    struct fat32_fs_t fs;
+    struct fat32_file_t f;
+    struct fat32_frag_stats_t st;
+    struct fat32_defrag_report_t rep;
+
+    CHECK_EQ(test_ramdisk(&dev, image), 0);
+    CHECK_EQ(fat32_mount(&fs, &dev), 0);
+    write_interleaved(&fs);
+
+    // Root, hello_world.txt and the test files are all chains; every cluster of those is its own run
+    CHECK_EQ(fat32_volume_fragmentation(&fs, &st), 0);
+    CHECK_EQ(st.fragments, 2 + FILES * ROUNDS);
+    CHECK_EQ(st.score, 100);
+
+    // One file by hand; its handle keeps working on the new chain
+    CHECK_EQ(fat32_open(&fs, files[0].path, &f), 0);
+    CHECK_EQ(fat32_seek(&fs, &f, 2 * fs.bytes_per_cluster + 7), 0);
+    CHECK_EQ(fat32_defragment(&fs, &f), 1);
+    CHECK_EQ(fat32_read(&fs, &f, data, 100), 100);
+    CHECK(test_verify(data, 2 * fs.bytes_per_cluster + 7, 100, files[0].seed));
+    CHECK_EQ(fat32_defragment(&fs, &f), 0);     // Already one run
+    CHECK_EQ(file_fragments(&fs, files[0].path), 1);
+    check_data(&fs, &files[0]);
+    check_volume(&fs, NULL);
+
+    // The rest through the volume walk: hello_world.txt is scanned but already contiguous
+    CHECK_EQ(fat32_defragment_volume(&fs, 0, &rep), 0);
+    CHECK_EQ(rep.files_scanned, 1 + FILES);
+    CHECK_EQ(rep.files_moved, FILES - 1);
+    CHECK_EQ(rep.files_skipped, 0);
+    CHECK_EQ(rep.fragments_before, 2 + (FILES - 1) * ROUNDS);
+    CHECK_EQ(rep.fragments_after, 1 + FILES);
+    CHECK_EQ(fat32_volume_fragmentation(&fs, &st), 0);
+    CHECK_EQ(st.fragments, 2 + FILES);
+    CHECK_EQ(st.score, 0);
+    CHECK_EQ(fs.sectors.in_use, 0);     // Every scratch sector went back to the pool
+    CHECK_EQ(fat32_unmount(&fs), 0);
+
+    // Everything again from a fresh mount
+    CHECK_EQ(fat32_mount(&fs, &dev), 0);
+    for (int i = 0; i < FILES; i++) {
+        CHECK_EQ(file_fragments(&fs, files[i].path), 1);
+        check_data(&fs, &files[i]);
+    }
+    check_volume(&fs, NULL);
+    CHECK_EQ(fat32_unmount(&fs), 0);
+    test_ramdisk_free(&dev);
+}
+
+// With no free cluster left there is no gap for any fragmented file to move into
+static void test_no_gap(const char *image) {
+    struct blkdev_t dev;
+    struct fat32_fs_t fs;
+    struct fat32_file_t f;
+    struct fat32_frag_stats_t st;
+    struct fat32_defrag_report_t rep;
+    uint32_t crc[FILES], start[FILES];
+
+    CHECK_EQ(test_ramdisk(&dev, image), 0);
+    CHECK_EQ(fat32_mount(&fs, &dev), 0);
+    write_interleaved(&fs);
+
+    CHECK_EQ(fat32_create(&fs, "FILL.BIN", &f), 0);
+    memset(data, 0xA5, fs.bytes_per_cluster);
+    while (fat32_write(&fs, &f, data, fs.bytes_per_cluster) == (int)fs.bytes_per_cluster) {}
+    CHECK_EQ(fat32_close(&fs, &f), 0);
+    CHECK_EQ(fat32_volume_fragmentation(&fs, &st), 0);
+    CHECK_EQ(st.clusters, fs.total_clusters);
+
+    for (int i = 0; i < FILES; i++) {
+        CHECK_EQ(fat32_open(&fs, files[i].path, &f), 0);
+        CHECK_EQ(fat32_checksum(&fs, &f, &crc[i]), 0);
+        start[i] = f.start_cluster;
+    }
+    CHECK_EQ(fat32_open(&fs, files[0].path, &f), 0);
+    CHECK_EQ(fat32_defragment(&fs, &f), -2);
+
+    CHECK_EQ(fat32_defragment_volume(&fs, 0, &rep), 0);
+    CHECK_EQ(rep.files_scanned, 2 + FILES);
+    CHECK_EQ(rep.files_moved, 0);
+    CHECK_EQ(rep.files_skipped, FILES);
+    CHECK_EQ(rep.fragments_after, rep.fragments_before);
+
+    for (int i = 0; i < FILES; i++) {
+        uint32_t now = 0;
+        CHECK_EQ(fat32_open(&fs, files[i].path, &f), 0);
+        CHECK_EQ(f.start_cluster, start[i]);
+        CHECK_EQ(file_fragments(&fs, files[i].path), ROUNDS);
+        CHECK_EQ(fat32_checksum(&fs, &f, &now), 0);
+        CHECK_EQ(now, crc[i]);
+        check_data(&fs, &files[i]);
+    }
+    check_volume(&fs, "FILL.BIN");
+    CHECK_EQ(fs.sectors.in_use, 0);
+    CHECK_EQ(fat32_unmount(&fs), 0);
+    test_ramdisk_free(&dev);
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s fat32.img\n", argv[0]);
+        return 2;
+    }
+    data = malloc(ROUNDS * 64 * 1024);
+    test_defragment(argv[1]);
+    test_no_gap(argv[1]);
+    free(data);
+    return test_exit("test_defrag");
+}
@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "exfat.h"
+#include "test.h"
+
+// exFAT engine against an image from mksdimg.py --exfat: mount, lookups through the
+// root and a subdirectory, and reads of NoFatChain and FAT-chained files, whole and
+// from odd offsets across cluster boundaries. Ends with an append that has to turn
+// a NoFatChain file into a chained one.
+
+static uint8_t buf[64 * 1024] __attribute__((aligned(64)));
+
+static void check_lookups(struct exfat_fs_t *fs) {
+    struct exfat_file_t f;
+
+    CHECK_EQ(exfat_open(fs, "hello_world.txt", &f), 0);
+    CHECK(f.contiguous);
+    CHECK_EQ(exfat_read(fs, &f, buf, sizeof(buf)), 132);
+    CHECK(memcmp(buf, "Hello from the exFAT test image! ", 33) == 0);
+
+    CHECK_EQ(exfat_open(fs, "/HELLO_WORLD.TXT", &f), 0);      // Names compare up-cased
+    CHECK_EQ(exfat_open(fs, "hello_world.tx", &f), -2);
+    CHECK_EQ(exfat_open(fs, "missing.bin", &f), -2);
+    CHECK_EQ(exfat_open(fs, "hello_world.txt/x", &f), -2);    // Not a directory
+    CHECK_EQ(exfat_open(fs, "/", &f), -3);
+    CHECK_EQ(exfat_open(fs, "Sub Dir/nested.bin", &f), 0);
+    CHECK_EQ(exfat_open(fs, "sub dir/NESTED.BIN", &f), 0);
+    CHECK_EQ(exfat_open(fs, "Sub Dir/hello_world.txt", &f), -2);
+}
+
+// Whole file in one call, then again in 1000-byte steps that straddle sectors and clusters
+static void check_file(struct exfat_fs_t *fs, const char *path, uint32_t size, uint32_t seed, int contiguous) {
+    struct exfat_file_t f;
+
+    CHECK_EQ(exfat_open(fs, path, &f), 0);
+    CHECK_EQ(f.size, size);
+    CHECK_EQ(f.contiguous, contiguous);
+    CHECK_EQ(exfat_read(fs, &f, buf, sizeof(buf)), size);
+    CHECK(test_verify(buf, 0, size, seed));
+    CHECK_EQ(exfat_read(fs, &f, buf, 1), 0);  // At EOF
+
+    CHECK_EQ(exfat_seek(fs, &f, 0), 0);
+    for (uint32_t off = 0; off < size; off += 1000) {
+        uint32_t want = size - off < 1000 ? size - off : 1000;
+        CHECK_EQ(exfat_read(fs, &f, buf + 1, 1000), want);   // Unaligned destination
+        CHECK(test_verify(buf + 1, off, want, seed));
+    }
+
+    // Backwards seeks restart a chained file's walk from its first cluster
+    uint32_t off = size - fs->bytes_per_cluster - 100;
+    CHECK_EQ(exfat_seek(fs, &f, off), 0);
+    CHECK_EQ(exfat_read(fs, &f, buf, 200), 200);
+    CHECK(test_verify(buf, off, 200, seed));
+    CHECK_EQ(exfat_seek(fs, &f, 300), 0);
+    CHECK_EQ(exfat_read(fs, &f, buf, fs->bytes_per_cluster), fs->bytes_per_cluster);
+    CHECK(test_verify(buf, 300, fs->bytes_per_cluster, seed));
+    CHECK_EQ(exfat_seek(fs, &f, size + 1), -1);
+    exfat_close(fs, &f);
+}
+
+// contig.bin is followed by chain.bin's clusters, so growing it breaks the run
+static void check_append(struct exfat_fs_t *fs, struct blkdev_t *dev) {
+    struct exfat_file_t f;
+    uint32_t bpc = fs->bytes_per_cluster, size = 5 * bpc;
+
+    CHECK_EQ(exfat_open(fs, "contig.bin", &f), 0);
+    CHECK_EQ(exfat_seek(fs, &f, size), 0);
+    test_fill(buf, size, bpc + 10, 1);
+    CHECK_EQ(exfat_write(fs, &f, buf, bpc + 10), bpc + 10);
+    CHECK(!f.contiguous);
+    CHECK_EQ(exfat_close(fs, &f), 0);
+
+    struct exfat_fs_t again;
+    CHECK_EQ(exfat_mount(&again, dev), 0);
+    CHECK_EQ(exfat_open(&again, "contig.bin", &f), 0);
+    CHECK_EQ(f.size, size + bpc + 10);
+    CHECK(!f.contiguous);
+    CHECK_EQ(exfat_read(&again, &f, buf, sizeof(buf)), size + bpc + 10);
+    CHECK(test_verify(buf, 0, size + bpc + 10, 1));
+
+    check_file(&again, "chain.bin", 5 * bpc, 2, 0); // Untouched by the new clusters
+    CHECK_EQ(again.sectors.in_use, 0);
+    CHECK_EQ(exfat_unmount(&again), 0);
+}
+
+int main(int argc, char **argv) {
+    struct blkdev_t dev;
+    struct exfat_fs_t fs;
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s exfat.img\n", argv[0]);
+        return 2;
+    }
+    if (test_ramdisk(&dev, argv[1]) != 0) {
+        fprintf(stderr, "%s: cannot load %s\n", argv[0], argv[1]);
+        return 1;
+    }
+
+    CHECK_EQ(exfat_mount(&fs, &dev), 0);
+    if (test_failures) return test_exit("test_exfat");
+    CHECK_EQ(exfat_mount(&fs, &dev), -9);      // Already mounted, left as it is
+    if (fs.bytes_per_cluster * 7 > sizeof(buf)) {
+        fprintf(stderr, "%s: clusters too large for the test buffer\n", argv[0]);
+        return 1;
+    }
+    check_lookups(&fs);
+    check_file(&fs, "contig.bin", 5 * fs.bytes_per_cluster, 1, 1);
+    check_file(&fs, "chain.bin", 5 * fs.bytes_per_cluster, 2, 0);
+    check_file(&fs, "Sub Dir/nested.bin", fs.bytes_per_cluster * 3 / 2, 3, 1);
+    check_append(&fs, &dev);
+    CHECK_EQ(fs.sectors.in_use, 0);     // Every scratch sector went back to the pool
+    CHECK_EQ(exfat_unmount(&fs), 0);
+
+    test_ramdisk_free(&dev);
+    return test_exit("test_exfat");
+}
@@ -0,0 +1,282 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fat32.h"
+#include "test.h"
+
+// Directory updates on the RAM-disk image: files and directories created in nested
+// directories, found again after a fresh mount, and the per-directory free-slot hint
+// keeping the cost of a create flat as a directory grows over several clusters. Long
+// names: case-insensitive lookup, LFN chains tied to their 8.3 entry by the checksum,
+// and ~N aliases that stay unique across many names sharing a base, for no more reads
+// than 8.3 names. Sector reads are counted by a pass-through device under the file system.
+
+#define FILES 400
+
+struct counting_t {
+    struct blkdev_t *ram;
+    uint32_t reads;             // Sectors
+};
+
+static int counting_read(void *ctx, uint32_t lba, uint32_t count, void *buf) {
+    struct counting_t *c = ctx;
+    c->reads += count;
+    return blk_read(c->ram, lba, count, buf);
+}
+
+static int counting_write(void *ctx, uint32_t lba, uint32_t count, const void *buf) {
+    struct counting_t *c = ctx;
+    return blk_write(c->ram, lba, count, buf);
+}
+
+static const struct blkdev_ops_t counting_ops = { counting_read, counting_write, NULL, NULL, NULL };
+
+static struct counting_t counting;
+static uint32_t short_reads;    // Cost of the FILES 8.3 creates in test_hint
+
+static void count_entry(void *ctx, const struct fat32_dir_entry_t *ent) {
+    (void)ent;
+    (*(int *)ctx)++;
+}
+
+// Each file holds its own path, so a reopen that lands on the wrong entry shows
+static void create_with_path(struct fat32_fs_t *fs, const char *path) {
+    struct fat32_file_t f;
+    uint32_t len = (uint32_t)strlen(path);
+    CHECK_EQ(fat32_create(fs, path, &f), 0);
+    CHECK_EQ(fat32_write(fs, &f, path, len), len);
+    CHECK_EQ(fat32_close(fs, &f), 0);
+}
+
+static void check_path(struct fat32_fs_t *fs, const char *open_as, const char *path) {
+    struct fat32_file_t f;
+    char buf[300];
+    uint32_t len = (uint32_t)strlen(path);
+    CHECK_EQ(fat32_open(fs, open_as, &f), 0);
+    CHECK_EQ(f.size, len);
+    CHECK_EQ(fat32_read(fs, &f, buf, len), len);
+    CHECK(memcmp(buf, path, len) == 0);
+}
+
+// Three levels of directories, files at each, all found again from a fresh mount
+static void test_nested(struct fat32_fs_t *fs, struct blkdev_t *dev) {
+    static const char *paths[] = { "/TOP/ONE.TXT", "/TOP/MID/TWO.TXT", "/TOP/MID/LOW/THREE.TXT" };
+    struct fat32_fs_t again;
+    int n;
+
+    CHECK_EQ(fat32_mkdir(fs, "/TOP"), 0);
+    CHECK_EQ(fat32_mkdir(fs, "/TOP/MID"), 0);
+    CHECK_EQ(fat32_mkdir(fs, "/TOP/MID/LOW"), 0);
+    CHECK_EQ(fat32_mkdir(fs, "/NONE/MID"), -2);         // Parent missing
+    for (int i = 0; i < 3; i++) create_with_path(fs, paths[i]);
+
+    CHECK_EQ(fat32_mount(&again, dev), 0);
+    for (int i = 0; i < 3; i++) check_path(&again, paths[i], paths[i]);
+    n = 0;
+    CHECK_EQ(fat32_listdir(&again, "/TOP/MID", count_entry, &n), 4);    // ".", "..", LOW, TWO.TXT
+    CHECK_EQ(n, 4);
+    CHECK_EQ(fat32_listdir(&again, "/TOP/MID/LOW", NULL, NULL), 3);
+    CHECK_EQ(fat32_unmount(&again), 0);
+}
+
+// FILES 8.3 creates in one directory run over several clusters of entries. With the
+// hint, the last hundred cost no more reads than the first hundred
+static void test_hint(struct fat32_fs_t *fs, struct blkdev_t *dev) {
+    struct fat32_fs_t again;
+    char path[32];
+    uint32_t reads[FILES / 100 + 1];
+
+    CHECK_EQ(fat32_mkdir(fs, "/MANY"), 0);
+    for (int i = 0; i < FILES; i++) {
+        if (i % 100 == 0) reads[i / 100] = counting.reads;
+        snprintf(path, sizeof(path), "/MANY/F%05d.DAT", i);
+        create_with_path(fs, path);
+    }
+    reads[FILES / 100] = counting.reads;
+    CHECK(FILES * 32 > 2 * fs->bytes_per_cluster);     // The directory does span clusters
+    uint32_t first = reads[1] - reads[0], last = reads[FILES / 100] - reads[FILES / 100 - 1];
+    CHECK(last <= first + first / 10);
+    short_reads = reads[FILES / 100] - reads[0];
+
+    CHECK_EQ(fat32_mount(&again, dev), 0);
+    CHECK_EQ(fat32_listdir(&again, "/MANY", NULL, NULL), FILES + 2);
+    for (int i = 0; i < FILES; i += 37) {
+        snprintf(path, sizeof(path), "/MANY/F%05d.DAT", i);
+        check_path(&again, path, path);
+    }
+    CHECK_EQ(fat32_unmount(&again), 0);
+}
+
+// The 8.3 names of a directory, sorted
+static char names[FILES + 8][11];
+static int nnames;
+
+static void collect_name(void *ctx, const struct fat32_dir_entry_t *ent) {
+    (void)ctx;
+    if (nnames < FILES + 8) memcpy(names[nnames++], ent->name, 11);
+}
+
+static int by_name(const void *a, const void *b) {
+    return memcmp(a, b, 11);
+}
+
+static int unique_names(struct fat32_fs_t *fs, const char *dir) {
+    nnames = 0;
+    CHECK(fat32_listdir(fs, dir, collect_name, NULL) > 0);
+    qsort(names, nnames, 11, by_name);
+    for (int i = 1; i < nnames; i++) {
+        if (memcmp(names[i - 1], names[i], 11) == 0) return 0;
+    }
+    return 1;
+}
+
+// "BASE    EXT" as the path "dir/BASE.EXT"
+static void short_path(char *out, const char *dir, const char *name) {
+    int k = sprintf(out, "%s/", dir);
+    for (int i = 0; i < 8 && name[i] != ' '; i++) out[k++] = name[i];
+    if (name[8] != ' ') out[k++] = '.';
+    for (int i = 8; i < 11 && name[i] != ' '; i++) out[k++] = name[i];
+    out[k] = 0;
+}
+
+static uint8_t checksum_83(const uint8_t *name) {
+    uint8_t sum = 0;
+    for (int i = 0; i < 11; i++) sum = (uint8_t)(((sum & 1) << 7) + (sum >> 1) + name[i]);
+    return sum;
+}
+
+// Every LFN chain in the directory's first cluster, parsed straight from the device: the
+// ordinals count down from the 0x40-marked part, every part carries the checksum of the
+// 8.3 entry that follows, and the name spelled out leads back to that entry. Returns the
+// number of chains
+static int check_chains(struct fat32_fs_t *fs, const char *dir) {
+    struct fat32_file_t d, f;
+    uint8_t sector[512];
+    char name[FAT32_LFN_MAX + 1], path[300];
+    uint32_t parts = 0, expect = 0;
+    uint8_t sum = 0;
+    int chains = 0;
+
+    CHECK_EQ(fat32_open(fs, dir, &d), 0);
+    uint32_t lba = fat32_cluster_to_lba(fs, d.start_cluster);
+    for (uint32_t s = 0; s < fs->sectors_per_cluster; s++) {
+        CHECK_EQ(blk_read(fs->dev, lba + s, 1, sector), 0);
+        for (int i = 0; i < 16; i++) {
+            const struct fat32_dir_entry_t *e = (const struct fat32_dir_entry_t *)sector + i;
+            const struct fat32_lfn_entry_t *l = (const struct fat32_lfn_entry_t *)e;
+            if (e->name[0] == 0x00) return chains;
+            if (e->attr == 0x0F) {
+                if (l->ord & 0x40) {
+                    parts = expect = l->ord & 0x3F;
+                    sum = l->checksum;
+                    memset(name, 0, sizeof(name));
+                } else {
+                    CHECK_EQ(l->ord, expect);
+                    CHECK_EQ(l->checksum, sum);
+                }
+                uint16_t part[13];
+                memcpy(part, l->name1, 10);
+                memcpy(part + 5, l->name2, 12);
+                memcpy(part + 11, l->name3, 4);
+                for (int j = 0; j < 13; j++) {
+                    if (part[j] != 0 && part[j] != 0xFFFF) name[(expect - 1) * 13 + j] = (char)part[j];
+                }
+                expect--;
+                continue;
+            }
+            if (parts) {
+                CHECK_EQ(expect, 0);
+                CHECK_EQ(checksum_83(e->name), sum);
+                snprintf(path, sizeof(path), "%s/%s", dir, name);
+                CHECK_EQ(fat32_open(fs, path, &f), 0);
+                CHECK_EQ(f.dir_sector, lba + s);
+                CHECK_EQ(f.dir_offset, i * 32);
+                chains++;
+            }
+            parts = 0;
+        }
+    }
+    return chains;
+}
+
+// FILES long names that all shorten to the same base, created for no more reads than the
+// same number of 8.3 names, each reachable by its long name in any case and by its alias
+static void test_long_names(struct fat32_fs_t *fs, struct blkdev_t *dev) {
+    static const char *dir = "/Long Names";
+    struct fat32_fs_t again;
+    char path[300], upper[300];
+
+    CHECK_EQ(fat32_mkdir(fs, dir), 0);
+    uint32_t before = counting.reads;
+    for (int i = 0; i < FILES; i++) {
+        snprintf(path, sizeof(path), "%s/a long file name %03d.txt", dir, i);
+        create_with_path(fs, path);
+    }
+    CHECK(counting.reads - before <= short_reads + short_reads / 10);
+
+    CHECK_EQ(fat32_mount(&again, dev), 0);
+    CHECK(unique_names(&again, dir));
+    CHECK_EQ(nnames, FILES + 2);
+    for (int i = 0; i < FILES; i += 23) {
+        snprintf(path, sizeof(path), "%s/a long file name %03d.txt", dir, i);
+        for (int k = 0; ; k++) {
+            upper[k] = (path[k] >= 'a' && path[k] <= 'z') ? path[k] - 32 : path[k];
+            if (!path[k]) break;
+        }
+        check_path(&again, upper, path);
+    }
+    for (int i = 2; i < nnames; i += 41) {      // Past "." and ".."
+        struct fat32_file_t f;
+        short_path(path, dir, names[i]);
+        CHECK_EQ(fat32_open(&again, path, &f), 0);
+    }
+    CHECK(check_chains(&again, dir) >= 20);
+
+    // Tails continue above the ones on disk after a remount. They count per directory,
+    // not per base: in the root the image has HELLO_~1.TXT and "Long Names" took LONGNA~2
+    snprintf(path, sizeof(path), "%s/a long file name, once more.txt", dir);
+    create_with_path(&again, path);
+    CHECK(unique_names(&again, dir));
+    struct fat32_file_t alias_dir, long_dir;
+    CHECK_EQ(fat32_open(&again, "/LONGNA~2", &alias_dir), 0);
+    CHECK_EQ(fat32_open(&again, dir, &long_dir), 0);
+    CHECK_EQ(alias_dir.start_cluster, long_dir.start_cluster);
+    create_with_path(&again, "/hello_world_2.txt");
+    check_path(&again, "/HELLO_~3.TXT", "/hello_world_2.txt");
+    check_path(&again, "/Hello_World_2.TXT", "/hello_world_2.txt");
+    CHECK(unique_names(&again, "/"));
+    CHECK_EQ(again.sectors.in_use, 0);
+    CHECK_EQ(fat32_unmount(&again), 0);
+}
+
+int main(int argc, char **argv) {
+    struct blkdev_t ram, dev;
+    struct fat32_fs_t fs;
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s fat32.img\n", argv[0]);
+        return 2;
+    }
+    if (test_ramdisk(&ram, argv[1]) != 0) {
+        fprintf(stderr, "%s: cannot load %s\n", argv[0], argv[1]);
+        return 1;
+    }
+    counting.ram = &ram;
+    dev.ops = &counting_ops;
+    dev.ctx = &counting;
+    dev.sectors = ram.sectors;
+#ifdef IO_STATS
+    blkdev_stats_reset(&dev);
+#endif
+
+    CHECK_EQ(fat32_mount(&fs, &dev), 0);
+    if (test_failures) return test_exit("test_lfn");
+    test_nested(&fs, &dev);
+    test_hint(&fs, &dev);
+    test_long_names(&fs, &dev);
+    CHECK_EQ(fs.sectors.in_use, 0);     // Every scratch sector went back to the pool
+    CHECK_EQ(fat32_unmount(&fs), 0);
+
+    test_ramdisk_free(&ram);
+    return test_exit("test_lfn");
+}
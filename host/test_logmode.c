@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fat32.h"
+#include "test.h"
+
+// Append/log mode: what reaches the card, and when. A second mount of the same RAM
+// disk stands in for a reader after power loss: it only sees what the log handle has
+// flushed (data, FAT and dirent). Needs clusters of a few sectors at least, so that
+// a size threshold below one cluster means something.
+
+#define RECORD 100
+
+static uint8_t buf[256 * 1024];
+
+// Size of 'path' as a fresh mount sees it, with the contents up to there checked
+static uint32_t on_disk(struct blkdev_t *dev, const char *path, uint32_t seed) {
+    struct fat32_fs_t fs;
+    struct fat32_file_t f;
+    uint32_t size = 0xFFFFFFFF;
+
+    CHECK_EQ(fat32_mount(&fs, dev), 0);
+    if (fat32_open(&fs, path, &f) == 0) {
+        size = f.size;
+        CHECK(size <= sizeof(buf));
+        CHECK_EQ(fat32_read(&fs, &f, buf, size), size);
+        CHECK(test_verify(buf, 0, size, seed));
+    }
+    fat32_unmount(&fs);
+    return size;
+}
+
+// One record of the pattern at the handle's position
+static void append(struct fat32_fs_t *fs, struct fat32_file_t *f, uint32_t n, uint32_t seed) {
+    uint8_t rec[RECORD * 4];
+    uint32_t at = f->position;
+    test_fill(rec, at, n, seed);
+    CHECK_EQ(fat32_write(fs, f, rec, n), n);
+    CHECK_EQ(f->position, at + n);
+}
+
+// Pending data goes out in whole sectors once the threshold is reached, not before
+static void test_threshold(struct fat32_fs_t *fs, struct blkdev_t *dev) {
+    struct fat32_file_t f;
+    uint32_t seed = 1, written = 0;
+
+    CHECK_EQ(fat32_create(fs, "THRESH.LOG", &f), 0);
+    CHECK_EQ(fat32_set_log_mode(fs, &f, 2048, 0), 0);
+    while (written + RECORD < 2048) {
+        append(fs, &f, RECORD, seed);
+        written += RECORD;
+    }
+    CHECK_EQ(on_disk(dev, "THRESH.LOG", seed), 0);
+
+    append(fs, &f, RECORD, seed);   // 2100 pending: four sectors leave, 52 bytes stay
+    written += RECORD;
+    CHECK_EQ(on_disk(dev, "THRESH.LOG", seed), 2048);
+
+    // Across cluster boundaries, the card always holds a sector multiple below the threshold
+    while (written < 3 * fs->bytes_per_cluster + 777) {
+        append(fs, &f, RECORD, seed);
+        written += RECORD;
+        uint32_t size = on_disk(dev, "THRESH.LOG", seed);
+        CHECK_EQ(size % 512, 0);
+        CHECK(size <= written && written - size < 2048);
+    }
+    CHECK_EQ(fat32_close(fs, &f), 0);
+    CHECK_EQ(on_disk(dev, "THRESH.LOG", seed), written);
+}
+
+// Every 'interval' writes the partial tail goes out too; the next flush rewrites that sector
+static void test_interval(struct fat32_fs_t *fs, struct blkdev_t *dev) {
+    struct fat32_file_t f;
+    uint32_t seed = 2, written = 0, flushed = 0;
+
+    CHECK_EQ(fat32_create(fs, "INTERVAL.LOG", &f), 0);
+    CHECK_EQ(fat32_set_log_mode(fs, &f, 0, 4), 0);
+    for (int i = 1; i <= 40; i++) {
+        append(fs, &f, 37 + i, seed);
+        written += 37 + i;
+        if (i % 4 == 0) flushed = written;
+        CHECK_EQ(on_disk(dev, "INTERVAL.LOG", seed), flushed);
+    }
+    CHECK_EQ(fat32_close(fs, &f), 0);
+    CHECK_EQ(on_disk(dev, "INTERVAL.LOG", seed), written);
+}
+
+// fsync makes everything written so far durable, the tail included; appends carry on after it
+static void test_fsync(struct fat32_fs_t *fs, struct blkdev_t *dev) {
+    struct fat32_file_t f;
+    uint32_t seed = 3, written = 0;
+
+    CHECK_EQ(fat32_create(fs, "SYNC.LOG", &f), 0);
+    CHECK_EQ(fat32_set_log_mode(fs, &f, 0, 0), 0);
+    for (int round = 0; round < 5; round++) {
+        for (int i = 0; i < 7; i++) {
+            append(fs, &f, RECORD + round, seed);
+            written += RECORD + round;
+        }
+        CHECK(on_disk(dev, "SYNC.LOG", seed) < written);
+        CHECK_EQ(fat32_fsync(fs, &f), 0);
+        CHECK_EQ(on_disk(dev, "SYNC.LOG", seed), written);
+        CHECK_EQ(fat32_fsync(fs, &f), 0);       // Nothing new: no change
+        CHECK_EQ(on_disk(dev, "SYNC.LOG", seed), written);
+    }
+    CHECK_EQ(fat32_close(fs, &f), 0);
+    CHECK_EQ(on_disk(dev, "SYNC.LOG", seed), written);
+}
+
+// Log handles only append: seeks are refused and leave the position alone. Log mode on a
+// file that ends mid-sector picks up from the partial sector
+static void test_seek_and_reopen(struct fat32_fs_t *fs, struct blkdev_t *dev) {
+    struct fat32_file_t f;
+    uint32_t seed = 4;
+
+    CHECK_EQ(fat32_create(fs, "REOPEN.LOG", &f), 0);
+    append(fs, &f, 300, seed);          // Plain writes first
+    CHECK_EQ(fat32_close(fs, &f), 0);
+
+    CHECK_EQ(fat32_open(fs, "REOPEN.LOG", &f), 0);
+    CHECK_EQ(fat32_set_log_mode(fs, &f, 0, 0), 0);
+    CHECK_EQ(f.position, 300);
+    CHECK_EQ(fat32_seek(fs, &f, 0), -1);
+    CHECK_EQ(fat32_seek(fs, &f, 300), -1);
+    CHECK_EQ(f.position, 300);
+    append(fs, &f, 250, seed);
+    CHECK_EQ(fat32_seek(fs, &f, 100), -1);
+    CHECK_EQ(f.position, 550);
+    CHECK_EQ(on_disk(dev, "REOPEN.LOG", seed), 300);
+    CHECK_EQ(fat32_close(fs, &f), 0);
+    CHECK_EQ(on_disk(dev, "REOPEN.LOG", seed), 550);
+
+    CHECK_EQ(fat32_open(fs, "REOPEN.LOG", &f), 0);   // Plain again after close
+    CHECK_EQ(fat32_seek(fs, &f, 100), 0);
+    CHECK_EQ(fat32_read(fs, &f, buf, 50), 50);
+    CHECK(test_verify(buf, 100, 50, seed));
+}
+
+int main(int argc, char **argv) {
+    struct blkdev_t dev;
+    struct fat32_fs_t fs;
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s fat32.img\n", argv[0]);
+        return 2;
+    }
+    if (test_ramdisk(&dev, argv[1]) != 0) {
+        fprintf(stderr, "%s: cannot load %s\n", argv[0], argv[1]);
+        return 1;
+    }
+    CHECK_EQ(fat32_mount(&fs, &dev), 0);
+    if (test_failures) return test_exit("test_logmode");
+    CHECK_EQ(fat32_mount(&fs, &dev), -7);      // Already mounted, left as it is
+    if (fs.bytes_per_cluster < 4096) {
+        fprintf(stderr, "%s: needs clusters of 4 KB or more\n", argv[0]);
+        return 1;
+    }
+
+    test_threshold(&fs, &dev);
+    test_interval(&fs, &dev);
+    test_fsync(&fs, &dev);
+    test_seek_and_reopen(&fs, &dev);
+    CHECK_EQ(fs.sectors.in_use, 0);     // Every scratch sector went back to the pool
+    CHECK_EQ(fat32_unmount(&fs), 0);
+
+    test_ramdisk_free(&dev);
+    return test_exit("test_logmode");
+}
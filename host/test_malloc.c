@@ -0,0 +1,332 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/malloc.h"     // Not the C library's <malloc.h>
+#include "cache.h"
+#include "test.h"
+
+// The bare-metal allocator (src/malloc.c built with -DHOSTED_HEAP, its entry points
+// renamed so the C library keeps its own) over a static region standing in for the
+// linker-script heap. Blocks carry a fill pattern that is checked before every free
+// and move; the bins are checked through malloc_get_stats, which must come back to
+// an empty heap whenever everything has been freed.
+//
+// With --bench it runs malloc_bench instead; pmu_cycles counts nanoseconds here.
+
+#define HEAP_SIZE (4 * 1024 * 1024)
+#define DMA_SIZE  (64 * 1024)
+
+#define STR_(x) #x
+#define STR(x)  STR_(x)
+
+// The regions memlayout.ld provides on the board
+__asm__(".bss\n"
+        ".balign 4096\n"
+        ".globl __heap_start\n__heap_start:\n.space " STR(HEAP_SIZE) "\n"
+        ".globl __heap_end\n__heap_end:\n"
+        ".balign 4096\n"
+        ".globl __dma_start\n__dma_start:\n.space " STR(DMA_SIZE) "\n"
+        ".globl __dma_end\n__dma_end:\n"
+        ".text\n");
+
+extern unsigned char __heap_start[], __heap_end[];
+extern unsigned char __dma_start[], __dma_end[];
+
+#define HDR   (2 * sizeof(size_t))      // Chunk header in front of every payload
+#define SLOTS 512
+
+struct block_t {
+    uint8_t *p;
+    size_t size;
+    uint32_t seed;
+};
+
+static struct block_t slot[SLOTS];
+static uint32_t rng = 1;
+
+static uint32_t next_rand(void) {
+    rng = rng * 1103515245 + 12345;
+    return rng >> 8;
+}
+
+static int in_heap(const void *p, size_t size) {
+    return (const uint8_t *)p >= __heap_start + HDR && (const uint8_t *)p + size <= __heap_end;
+}
+
+// The heap with nothing allocated: no free chunks, all of it top
+static void check_empty(void) {
+    struct malloc_stats_t st;
+    malloc_get_stats(&st);
+    CHECK_EQ(st.in_use, 0);
+    CHECK_EQ(st.free_chunks, 0);
+    CHECK_EQ(st.free_bytes, 0);
+    CHECK_EQ(st.top, HEAP_SIZE);
+    CHECK_EQ(st.fragmentation, 0);
+}
+
+static void set_block(struct block_t *b, uint8_t *p, size_t size) {
+    b->p = p;
+    b->size = size;
+    b->seed = next_rand();
+    test_fill(p, 0, (uint32_t)size, b->seed);
+}
+
+// Live blocks never overlap: sorted by address, each ends before the next starts
+static int by_address(const void *a, const void *b) {
+    const struct block_t *x = a, *y = b;
+    return (x->p > y->p) - (x->p < y->p);
+}
+
+static void check_disjoint(void) {
+    static struct block_t live[SLOTS];
+    int n = 0;
+    for (int i = 0; i < SLOTS; i++) {
+        if (slot[i].p) live[n++] = slot[i];
+    }
+    qsort(live, n, sizeof(live[0]), by_address);
+    for (int i = 1; i < n; i++) {
+        CHECK(live[i - 1].p + live[i - 1].size + HDR <= live[i].p);
+    }
+}
+
+static void basics(void) {
+    uint8_t *p, *q;
+
+    CHECK(malloc(0) == NULL);
+    p = malloc(1);
+    CHECK(p != NULL && in_heap(p, 1));
+    CHECK_EQ((uintptr_t)p % 8, 0);
+    free(p);
+    free(NULL);
+
+    // calloc zeroes, and refuses a product that overflows
+    p = malloc(1000);
+    memset(p, 0xEE, 1000);
+    free(p);
+    q = calloc(10, 100);
+    CHECK(q == p);
+    for (int i = 0; i < 1000; i++) {
+        if (q[i]) { CHECK_EQ(q[i], 0); break; }
+    }
+    free(q);
+    volatile size_t huge = (size_t)-1 / 2;     // Kept from the compiler's size checks
+    CHECK(calloc(huge, 4) == NULL);
+    CHECK(malloc(2 * huge - 2) == NULL);
+
+    // Alignments must be powers of two
+    CHECK(memalign(48, 100) == NULL);
+    p = aligned_alloc(256, 100);
+    CHECK(p != NULL && (uintptr_t)p % 256 == 0);
+    free(p);
+    check_empty();
+}
+
+// Freed neighbours merge, whichever side is freed first, and the merged chunk is reused
+static void coalescing(void) {
+    struct malloc_stats_t st;
+    uint8_t *a = malloc(1000), *b = malloc(1000), *c = malloc(1000), *guard = malloc(16);
+    size_t chunk = (size_t)(b - a);
+
+    CHECK_EQ(c - b, chunk);
+    free(a);
+    free(c);
+    malloc_get_stats(&st);
+    CHECK_EQ(st.free_chunks, 2);
+    CHECK_EQ(st.free_bytes, 2 * chunk);
+
+    free(b);                            // Joins both sides
+    malloc_get_stats(&st);
+    CHECK_EQ(st.free_chunks, 1);
+    CHECK_EQ(st.free_bytes, 3 * chunk);
+    CHECK_EQ(st.largest_free, st.top);  // The top is still bigger
+
+    uint8_t *all = malloc(3 * chunk - HDR);
+    CHECK(all == a);
+    malloc_get_stats(&st);
+    CHECK_EQ(st.free_chunks, 0);
+
+    // A split leaves the remainder binned, and it is found again
+    free(all);
+    uint8_t *small = malloc(200);
+    CHECK(small == a);
+    uint8_t *rest = malloc(2 * chunk);
+    CHECK(rest > small && rest < guard);
+    free(small);
+    free(rest);
+    free(guard);                        // Everything folds back into the top
+    check_empty();
+}
+
+// In place where possible: shrinking, growing into the top or into a free neighbour
+static void resizing(void) {
+    uint8_t *a = malloc(100), *b = malloc(100), *guard = malloc(16);
+
+    test_fill(a, 0, 100, 7);
+    free(b);
+    CHECK(realloc(a, 180) == a);        // Takes b
+    CHECK(test_verify(a, 0, 100, 7));
+    CHECK(realloc(a, 40) == a);
+    CHECK(test_verify(a, 0, 40, 7));
+
+    uint8_t *moved = realloc(a, 4000);  // Too big for the hole: moves
+    CHECK(moved != a && moved > guard);
+    CHECK(test_verify(moved, 0, 40, 7));
+    CHECK(realloc(moved, 64 * 1024) == moved);    // Last chunk: grows into the top
+    CHECK(test_verify(moved, 0, 40, 7));
+    CHECK(realloc(moved, 0) == NULL);
+    free(guard);
+    check_empty();
+}
+
+// Random malloc/memalign/realloc/free over SLOTS live blocks
+static void random_ops(void) {
+    for (int op = 0; op < 200000; op++) {
+        struct block_t *b = &slot[next_rand() % SLOTS];
+        uint32_t r = next_rand();
+        size_t size = (r & 3) == 0 ? 1 + next_rand() % 16384 : 1 + next_rand() % 600;
+
+        if (b->p) {
+            if (!test_verify(b->p, 0, (uint32_t)b->size, b->seed)) {
+                CHECK(!"block contents intact");
+                return;
+            }
+        }
+        switch ((r >> 2) % 4) {
+        case 0:                         // Free
+            free(b->p);
+            b->p = NULL;
+            break;
+        case 1: {                       // Resize, keeping the common prefix
+            uint8_t *p = realloc(b->p, size);
+            CHECK(p != NULL && in_heap(p, size) && (uintptr_t)p % 8 == 0);
+            if (!p) return;
+            if (b->p) {
+                size_t keep = size < b->size ? size : b->size;
+                CHECK(test_verify(p, 0, (uint32_t)keep, b->seed));
+            }
+            set_block(b, p, size);
+            break;
+        }
+        default: {                      // Replace, plain or aligned
+            size_t align = (r >> 4) % 2 ? (size_t)8 << ((r >> 5) % 10) : 0;
+            free(b->p);
+            uint8_t *p = align ? memalign(align, size) : malloc(size);
+            CHECK(p != NULL && in_heap(p, size));
+            if (!p) return;
+            if (align) CHECK_EQ((uintptr_t)p % align, 0);
+            set_block(b, p, size);
+            break;
+        }
+        }
+        if (op % 5000 == 0) check_disjoint();
+    }
+
+    for (int i = 0; i < SLOTS; i++) {
+        if (slot[i].p) CHECK(test_verify(slot[i].p, 0, (uint32_t)slot[i].size, slot[i].seed));
+        free(slot[i].p);
+        slot[i].p = NULL;
+    }
+    check_empty();
+}
+
+// Running out is reported as such; freeing makes the space usable again
+static void exhaustion(void) {
+    struct malloc_stats_t st;
+    int n = 0;
+
+    malloc_stats_reset();
+    CHECK(malloc(HEAP_SIZE) == NULL);
+    malloc_get_stats(&st);
+    CHECK_EQ(st.fail_heap_end, 1);
+
+    while (n < SLOTS && (slot[n].p = malloc(16 * 1024 - HDR)) != NULL) n++;
+    CHECK(n > 0 && n < SLOTS);
+
+    // Every other block back: plenty free in total, but no run of 32 KB
+    for (int i = 0; i < n; i += 2) {
+        free(slot[i].p);
+        slot[i].p = NULL;
+    }
+    CHECK(malloc(32 * 1024) == NULL);
+    malloc_get_stats(&st);
+    CHECK_EQ(st.fail_fragmented, 1);
+    CHECK(st.fragmentation >= 90);
+    uint8_t *hole = malloc(16 * 1024 - HDR);    // A hole is still good for its own size
+    CHECK(hole != NULL);
+    free(hole);
+
+    for (int i = 0; i < SLOTS; i++) {
+        free(slot[i].p);
+        slot[i].p = NULL;
+    }
+    uint8_t *big = malloc(HEAP_SIZE / 2);
+    CHECK(big != NULL);
+    free(big);
+    check_empty();
+}
+
+// Pool blocks are whole cache lines from one slab; a freed block is the next one handed out
+static void pools(void) {
+    struct mem_pool_t pool;
+    uint8_t *b[4];
+
+    CHECK_EQ(pool_init(&pool, 100, 4), 0);
+    CHECK_EQ(pool.block_size, CACHE_ALIGN_UP(100));
+    for (int i = 0; i < 4; i++) {
+        b[i] = pool_alloc(&pool);
+        CHECK(b[i] != NULL && in_heap(b[i], pool.block_size));
+        CHECK_EQ((uintptr_t)b[i] % CACHE_LINE_SIZE, 0);
+        memset(b[i], i, pool.block_size);
+        for (int j = 0; j < i; j++) CHECK(b[j] != b[i]);
+    }
+    CHECK_EQ(pool.in_use, 4);
+    CHECK(pool_alloc(&pool) == NULL);   // Exhausted
+    CHECK_EQ(pool.in_use, 4);
+
+    pool_free(&pool, b[2]);
+    pool_free(&pool, NULL);
+    CHECK_EQ(pool.in_use, 3);
+    CHECK(pool_alloc(&pool) == b[2]);
+    CHECK(pool_alloc(&pool) == NULL);
+    for (int i = 0; i < 4; i++) {
+        if (i != 2) CHECK_EQ(b[i][pool.block_size - 1], i);   // Neighbours untouched
+        pool_free(&pool, b[i]);
+    }
+    CHECK_EQ(pool.in_use, 0);
+    for (int i = 0; i < 4; i++) CHECK(pool_alloc(&pool) != NULL);
+    pool_destroy(&pool);
+    CHECK(pool_alloc(&pool) == NULL);
+    check_empty();
+
+    CHECK_EQ(pool_init(&pool, 512, HEAP_SIZE / 512), -1);    // Slab larger than the heap
+}
+
+// DMA blocks are whole granules from their own region, first fit
+static void dma(void) {
+    uint8_t *a = dma_alloc(1), *b = dma_alloc(DMA_GRANULE + 1), *c = dma_alloc(DMA_GRANULE);
+
+    CHECK(a == __dma_start);
+    CHECK(b == a + DMA_GRANULE);
+    CHECK(c == b + 2 * DMA_GRANULE);
+    dma_free(b);
+    CHECK(dma_alloc(3 * DMA_GRANULE) == c + DMA_GRANULE);   // The hole is too small
+    CHECK(dma_alloc(2 * DMA_GRANULE) == b);
+    CHECK(dma_alloc(DMA_SIZE) == NULL);
+}
+
+int main(int argc, char **argv) {
+    malloc_init();
+    if (argc == 2 && strcmp(argv[1], "--bench") == 0) {
+        malloc_bench();
+        return 0;
+    }
+
+    basics();
+    coalescing();
+    resizing();
+    random_ops();
+    exhaustion();
+    pools();
+    dma();
+    return test_exit("test_malloc");
+}
@@ -0,0 +1,272 @@
+#include "bench.h"
+
+#ifdef STORAGE_BENCH
+#include "fat32.h"
+#include "uart.h"
+#include "timer.h"
+#include "malloc.h"
+
+// Storage benchmark suite. Every result is one CSV line:
+//   RESULT,<test>,<param>,<ops>,<bytes>,<total_us>,<ops_per_s>,<kib_per_s>,<p50_us>,<p90_us>,<p99_us>,<max_us>
+// between "BENCH BEGIN" and "BENCH DONE". tools/run_bench.sh collects them and
+// tools/bench_compare.py compares two runs.
+
+#define BENCH_SEQ_BYTES     (2 * 1024 * 1024)   // Per sequential file
+#define BENCH_RAW_SECTORS   2048                // 1 MB raw region
+#define BENCH_RANDOM_READS  256
+#define BENCH_FILES         64
+#define BENCH_LISTINGS      16
+#define BENCH_MAX_SAMPLES   4096
+
+static uint32_t *samples;   // Per-operation latency, timer ticks
+static uint32_t nsamples;
+
+static void sample(uint64_t t0) {
+    if (nsamples < BENCH_MAX_SAMPLES) samples[nsamples++] = (uint32_t)(timer_count() - t0);
+}
+
+static void sort_samples(void) {
+    // Shell sort: a few thousand samples, no recursion
+    for (uint32_t gap = nsamples / 2; gap > 0; gap /= 2) {
+        for (uint32_t i = gap; i < nsamples; i++) {
+            uint32_t v = samples[i], j = i;
+            for (; j >= gap && samples[j - gap] > v; j -= gap) samples[j] = samples[j - gap];
+            samples[j] = v;
+        }
+    }
+}
+
+static uint32_t percentile_us(uint32_t pct) {
+    if (nsamples == 0) return 0;
+    return (uint32_t)timer_ticks_to_us(samples[(nsamples - 1) * pct / 100]);
+}
+
+// Emit one result line from the samples gathered since the last report, then clear them
+static void report(const char *test, uint32_t param, uint32_t bytes, uint64_t ticks) {
+    uint64_t us = timer_ticks_to_us(ticks);
+    if (us == 0) us = 1;
+    sort_samples();
+    printf("RESULT,%s,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u\r\n", test, param, nsamples, bytes, (uint32_t)us,
+           (uint32_t)((uint64_t)nsamples * 1000000 / us),
+           (uint32_t)((uint64_t)bytes * 1000000 / 1024 / us),
+           percentile_us(50), percentile_us(90), percentile_us(99), percentile_us(100));
+    nsamples = 0;
+}
+
+static void report_error(const char *test, uint32_t param, int code) {
+    printf("ERROR,%s,%u,%d\r\n", test, param, code);
+    nsamples = 0;
+}
+
+// "NAME" + three decimal digits + suffix, e.g. F007.TMP
+static void make_name(char *out, const char *prefix, uint32_t n, const char *suffix) {
+    while (*prefix) *out++ = *prefix++;
+    *out++ = '0' + (n / 100) % 10;
+    *out++ = '0' + (n / 10) % 10;
+    *out++ = '0' + n % 10;
+    while (*suffix) *out++ = *suffix++;
+    *out = 0;
+}
+
+// Raw multi-block transfers straight to the block device over a 1 MB region at the start of the data area.
+// Writes put back what was read first, so the volume is left as it was
+static void bench_raw(struct fat32_fs_t *fs, uint8_t *buf, uint8_t *pristine) {
+    static const uint32_t counts[] = { 1, 8, 64, 256 };
+    uint32_t base = fs->data_start_lba;
+
+    if (blk_read(fs->dev, base, BENCH_RAW_SECTORS, pristine) != 0) {
+        report_error("raw_read", 0, -1);
+        return;
+    }
+
+    for (uint32_t k = 0; k < sizeof(counts) / sizeof(counts[0]); k++) {
+        uint32_t n = counts[k];
+        int err = 0;
+
+        uint64_t start = timer_count();
+        for (uint32_t s = 0; s < BENCH_RAW_SECTORS && !err; s += n) {
+            uint64_t t0 = timer_count();
+            err = blk_read(fs->dev, base + s, n, buf + s * 512);
+            sample(t0);
+        }
+        if (err) report_error("raw_read", n, err);
+        else report("raw_read", n, BENCH_RAW_SECTORS * 512, timer_count() - start);
+
+        start = timer_count();
+        for (uint32_t s = 0; s < BENCH_RAW_SECTORS && !err; s += n) {
+            uint64_t t0 = timer_count();
+            err = blk_write(fs->dev, base + s, n, pristine + s * 512);
+            sample(t0);
+        }
+        if (err) report_error("raw_write", n, err);
+        else report("raw_write", n, BENCH_RAW_SECTORS * 512, timer_count() - start);
+    }
+}
+
+// Sequential write then read of a fresh file per request size. Close is part of the
+// write total (it flushes the FAT) but not a sample of its own
+static void bench_sequential(struct fat32_fs_t *fs, uint8_t *buf) {
+    static const uint32_t sizes[] = { 512, 4096, 65536, 1024 * 1024 };
+    struct fat32_file_t file;
+    char name[16];
+
+    for (uint32_t k = 0; k < sizeof(sizes) / sizeof(sizes[0]); k++) {
+        uint32_t req = sizes[k];
+        make_name(name, "SEQ", k, ".DAT");
+
+        int res = fat32_create(fs, name, &file);
+        if (res != 0) {
+            report_error("seq_write", req, res);
+            continue;
+        }
+        uint64_t start = timer_count();
+        for (uint32_t done = 0; done < BENCH_SEQ_BYTES; done += req) {
+            uint64_t t0 = timer_count();
+            res = fat32_write(fs, &file, buf, req);
+            sample(t0);
+            if (res != (int)req) break;
+        }
+        fat32_close(fs, &file);
+        if (res != (int)req) report_error("seq_write", req, res);
+        else report("seq_write", req, BENCH_SEQ_BYTES, timer_count() - start);
+
+        res = fat32_open(fs, name, &file);
+        if (res != 0) {
+            report_error("seq_read", req, res);
+            continue;
+        }
+        start = timer_count();
+        for (uint32_t done = 0; done < BENCH_SEQ_BYTES; done += req) {
+            uint64_t t0 = timer_count();
+            res = fat32_read(fs, &file, buf, req);
+            sample(t0);
+            if (res != (int)req) break;
+        }
+        fat32_close(fs, &file);
+        if (res != (int)req) report_error("seq_read", req, res);
+        else report("seq_read", req, BENCH_SEQ_BYTES, timer_count() - start);
+    }
+}
+
+// 4 KB reads at pseudo-random 4 KB-aligned offsets of a 2 MB file from the sequential pass
+static void bench_random(struct fat32_fs_t *fs, uint8_t *buf) {
+    struct fat32_file_t file;
+    uint32_t seed = 12345;
+
+    int res = fat32_open(fs, "SEQ001.DAT", &file);
+    if (res != 0) {
+        report_error("rand_read", 4096, res);
+        return;
+    }
+    uint32_t blocks = file.size / 4096;
+
+    uint64_t start = timer_count();
+    for (uint32_t i = 0; i < BENCH_RANDOM_READS; i++) {
+        seed = seed * 1103515245 + 12345;
+        uint32_t off = ((seed >> 8) % blocks) * 4096;
+        uint64_t t0 = timer_count();
+        res = fat32_seek(fs, &file, off);
+        if (res == 0) res = fat32_read(fs, &file, buf, 4096);
+        sample(t0);
+        if (res != 4096) break;
+    }
+    fat32_close(fs, &file);
+    if (res != 4096) report_error("rand_read", 4096, res);
+    else report("rand_read", 4096, BENCH_RANDOM_READS * 4096, timer_count() - start);
+}
+
+static void count_entry(void *ctx, const struct fat32_dir_entry_t *ent) {
+    (void)ent;
+    (*(uint32_t *)ctx)++;
+}
+
+// Metadata: create+close and open+close of small files in a new directory, then
+// repeated listings of it
+static void bench_metadata(struct fat32_fs_t *fs) {
+    struct fat32_file_t file;
+    char path[32];
+    int res = fat32_mkdir(fs, "BENCHDIR");
+    if (res != 0) {
+        report_error("create", BENCH_FILES, res);
+        return;
+    }
+
+    uint64_t start = timer_count();
+    for (uint32_t i = 0; i < BENCH_FILES && res == 0; i++) {
+        make_name(path, "BENCHDIR/F", i, ".TMP");
+        uint64_t t0 = timer_count();
+        res = fat32_create(fs, path, &file);
+        if (res == 0) res = fat32_close(fs, &file);
+        sample(t0);
+    }
+    if (res != 0) {
+        report_error("create", BENCH_FILES, res);
+        return;
+    }
+    report("create", BENCH_FILES, 0, timer_count() - start);
+
+    start = timer_count();
+    for (uint32_t i = 0; i < BENCH_FILES && res == 0; i++) {
+        make_name(path, "BENCHDIR/F", i, ".TMP");
+        uint64_t t0 = timer_count();
+        res = fat32_open(fs, path, &file);
+        if (res == 0) res = fat32_close(fs, &file);
+        sample(t0);
+    }
+    if (res != 0) report_error("open", BENCH_FILES, res);
+    else report("open", BENCH_FILES, 0, timer_count() - start);
+
+    uint32_t entries = 0;
+    start = timer_count();
+    for (uint32_t i = 0; i < BENCH_LISTINGS; i++) {
+        entries = 0;
+        uint64_t t0 = timer_count();
+        res = fat32_listdir(fs, "BENCHDIR", count_entry, &entries);
+        sample(t0);
+        if (res < 0) break;
+    }
+    if (res < 0) report_error("listdir", BENCH_FILES, res);
+    else if (entries < BENCH_FILES) report_error("listdir", BENCH_FILES, (int)entries);
+    else report("listdir", BENCH_FILES, 0, timer_count() - start);
+}
+
+int storage_bench(struct blkdev_t *dev) {
+    struct fat32_fs_t fs;
+
+    int res = fat32_mount(&fs, dev);
+    if (res != 0) {
+        printf("ERROR,mount,0,%d\r\nBENCH DONE\r\n", res);
+        return -1;
+    }
+
+    samples = malloc(BENCH_MAX_SAMPLES * sizeof(uint32_t));
+    uint8_t *buf = memalign(CACHE_LINE_SIZE, 1024 * 1024);
+    uint8_t *pristine = memalign(CACHE_LINE_SIZE, BENCH_RAW_SECTORS * 512);
+    if (!samples || !buf || !pristine) {
+        printf("ERROR,alloc,0,-1\r\nBENCH DONE\r\n");
+        free(pristine);
+        free(buf);
+        free(samples);
+        fat32_unmount(&fs);
+        return -1;
+    }
+    nsamples = 0;
+    for (uint32_t i = 0; i < 1024 * 1024; i++) buf[i] = (uint8_t)(i * 31 + (i >> 9));
+
+    printf("BENCH BEGIN timer_hz=%u cluster=%u\r\n", timer_freq(), fs.bytes_per_cluster);
+    printf("# RESULT,test,param,ops,bytes,total_us,ops_per_s,kib_per_s,p50_us,p90_us,p99_us,max_us\r\n");
+
+    bench_raw(&fs, buf, pristine);
+    bench_sequential(&fs, buf);
+    bench_random(&fs, buf);
+    bench_metadata(&fs);
+
+    printf("BENCH DONE\r\n");
+
+    free(pristine);
+    free(buf);
+    free(samples);
+    fat32_unmount(&fs);
+    return 0;
+}
+#endif
@@ -0,0 +1,11 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+// Throughput and latency percentiles for the SD driver and FAT32 layer, built with
+// -DSTORAGE_BENCH. Results go to the UART as RESULT,... lines (see bench.c)
+#ifdef STORAGE_BENCH
+#include "blkdev.h"
+
+int storage_bench(struct blkdev_t *dev);
+#endif
+#endif
@@ -0,0 +1,64 @@
+#include "blkdev.h"
+#include <string.h>
+
+// --- Asynchronous Requests ---
+
+int blk_submit(struct blkdev_t *dev, struct blk_req_t *req) {
+    req->dev = dev;
+    if (!dev->ops->submit) {
+        if (req->op == BLK_OP_READ) req->res = blk_read(dev, req->lba, req->count, req->buf);
+        else if (req->op == BLK_OP_WRITE) req->res = blk_write(dev, req->lba, req->count, req->buf);
+        else req->res = blk_flush(dev);
+        req->done(req);
+        return 0;
+    }
+
+#ifdef IO_STATS
+    if (req->op == BLK_OP_READ) dev->stats.reads++;
+    else if (req->op == BLK_OP_WRITE) dev->stats.writes++;
+    else dev->stats.flushes++;
+#endif
+    if (req->op != BLK_OP_FLUSH && dev->sectors &&
+        (req->lba >= dev->sectors || req->count > dev->sectors - req->lba)) {
+        blk_complete(req, -2);
+        return 0;
+    }
+    return dev->ops->submit(dev->ctx, req);
+}
+
+void blk_complete(struct blk_req_t *req, int res) {
+#ifdef IO_STATS
+    struct blkdev_t *dev = req->dev;
+    uint32_t *sectors = 0;
+    if (req->op == BLK_OP_READ) sectors = &dev->stats.sectors_read;
+    else if (req->op == BLK_OP_WRITE) sectors = &dev->stats.sectors_written;
+    res = blk_account(dev, res, sectors, req->count);
+#endif
+    req->res = res;
+    req->done(req);
+}
+
+// --- RAM Disk ---
+
+// RAM disk: ctx is the backing memory; blk_read/blk_write have already bounds-checked
+
+static int ram_read(void *ctx, uint32_t lba, uint32_t count, void *buf) {
+    memcpy(buf, (uint8_t *)ctx + (size_t)lba * BLKDEV_SECTOR, (size_t)count * BLKDEV_SECTOR);
+    return 0;
+}
+
+static int ram_write(void *ctx, uint32_t lba, uint32_t count, const void *buf) {
+    memcpy((uint8_t *)ctx + (size_t)lba * BLKDEV_SECTOR, buf, (size_t)count * BLKDEV_SECTOR);
+    return 0;
+}
+
+static const struct blkdev_ops_t ram_ops = { ram_read, ram_write, NULL, NULL, NULL };
+
+void ramdisk_init(struct blkdev_t *dev, void *mem, uint32_t sectors) {
+    dev->ops = &ram_ops;
+    dev->ctx = mem;
+    dev->sectors = sectors;
+#ifdef IO_STATS
+    blkdev_stats_reset(dev);
+#endif
+}
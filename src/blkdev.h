@@ -0,0 +1,133 @@
+#ifndef BLKDEV_H
+#define BLKDEV_H
+
+#include <stdint.h>
+
+// Block device: 512-byte sectors behind a small ops table, so the filesystems run
+// unchanged on the SD controller, a RAM disk or, in the native build, an image file.
+// Every op returns 0 on success and a negative code on failure.
+
+#define BLKDEV_SECTOR 512
+
+struct blk_req_t;
+
+struct blkdev_ops_t {
+    int (*read)(void *ctx, uint32_t lba, uint32_t count, void *buf);
+    int (*write)(void *ctx, uint32_t lba, uint32_t count, const void *buf);
+    int (*flush)(void *ctx);    // Optional: make completed writes durable
+
+    // Optional asynchronous path (see blk_submit). submit queues the request and
+    // returns; poll finishes what has completed and returns how many that was
+    int (*submit)(void *ctx, struct blk_req_t *req);
+    int (*poll)(void *ctx);
+};
+
+// Request accounting, built with -DIO_STATS. Snapshot by copying dev->stats
+#ifdef IO_STATS
+struct blkdev_stats_t {
+    uint32_t reads;             // Requests, whatever their length
+    uint32_t writes;
+    uint32_t flushes;
+    uint32_t sectors_read;      // Sectors moved by successful requests
+    uint32_t sectors_written;
+    uint32_t errors;            // Failed requests of any kind
+};
+#endif
+
+struct blkdev_t {
+    const struct blkdev_ops_t *ops;
+    void *ctx;                  // Backend state, passed to every op
+    uint32_t sectors;           // Capacity, 0 if the backend does not know it
+#ifdef IO_STATS
+    struct blkdev_stats_t stats;
+#endif
+};
+
+#ifdef IO_STATS
+static inline void blkdev_stats_reset(struct blkdev_t *dev) {
+    dev->stats = (struct blkdev_stats_t){ 0 };
+}
+
+static inline int blk_account(struct blkdev_t *dev, int ret, uint32_t *sectors, uint32_t count) {
+    if (ret != 0) dev->stats.errors++;
+    else if (sectors) *sectors += count;
+    return ret;
+}
+#define BLK_ACCOUNT(dev, ret, field, count) blk_account(dev, ret, field, count)
+#else
+#define BLK_ACCOUNT(dev, ret, field, count) (ret)
+#endif
+
+// Requests past the end of a device of known size fail with -2 before reaching the backend
+static inline int blk_read(struct blkdev_t *dev, uint32_t lba, uint32_t count, void *buf) {
+#ifdef IO_STATS
+    dev->stats.reads++;
+#endif
+    if (dev->sectors && (lba >= dev->sectors || count > dev->sectors - lba)) return BLK_ACCOUNT(dev, -2, 0, 0);
+    return BLK_ACCOUNT(dev, dev->ops->read(dev->ctx, lba, count, buf), &dev->stats.sectors_read, count);
+}
+
+static inline int blk_write(struct blkdev_t *dev, uint32_t lba, uint32_t count, const void *buf) {
+#ifdef IO_STATS
+    dev->stats.writes++;
+#endif
+    if (dev->sectors && (lba >= dev->sectors || count > dev->sectors - lba)) return BLK_ACCOUNT(dev, -2, 0, 0);
+    return BLK_ACCOUNT(dev, dev->ops->write(dev->ctx, lba, count, buf), &dev->stats.sectors_written, count);
+}
+
+static inline int blk_flush(struct blkdev_t *dev) {
+    if (!dev->ops->flush) return 0;
+#ifdef IO_STATS
+    dev->stats.flushes++;
+#endif
+    return BLK_ACCOUNT(dev, dev->ops->flush(dev->ctx), 0, 0);
+}
+
+// --- Asynchronous Requests ---
+// blk_submit hands a request to the device; its done callback runs once, with res set,
+// from blk_poll on a backend with a submit op, or before blk_submit returns on one
+// without (the request then simply runs synchronously). Either way a device executes
+// requests in submission order, and a synchronous blk_read/write/flush is ordered after
+// every request submitted before it. The request and its buffer belong to the device
+// until done has run
+
+enum blk_op_t {
+    BLK_OP_READ,
+    BLK_OP_WRITE,
+    BLK_OP_FLUSH,
+};
+
+struct blk_req_t {
+    uint32_t op;                // enum blk_op_t
+    uint32_t lba;
+    uint32_t count;             // Sectors, unused by BLK_OP_FLUSH
+    void *buf;
+    void (*done)(struct blk_req_t *req);
+    void *ctx;                  // For the submitter
+    int res;                    // 0 or a negative code, valid in done
+    struct blkdev_t *dev;       // Set by blk_submit
+};
+
+// 0 once the request is accepted (done will run), negative if it was refused
+int blk_submit(struct blkdev_t *dev, struct blk_req_t *req);
+
+// For backends: account a finished request and run its done callback
+void blk_complete(struct blk_req_t *req, int res);
+
+static inline int blk_poll(struct blkdev_t *dev) {
+    return dev->ops->poll ? dev->ops->poll(dev->ctx) : 0;
+}
+
+// --- Backends ---
+
+// H3 SD controller (sdhc.c); sd_init() must have succeeded
+void sd_blkdev_init(struct blkdev_t *dev);
+
+// RAM disk over caller-provided memory of sectors * 512 bytes (blkdev.c)
+void ramdisk_init(struct blkdev_t *dev, void *mem, uint32_t sectors);
+
+// Disk image file, native build only (host/blkdev_file.c)
+int file_blkdev_open(struct blkdev_t *dev, const char *path);
+void file_blkdev_close(struct blkdev_t *dev);
+
+#endif
@@ -27,12 +27,18 @@ void cache_clean(void *addr, size_t size) {
 }
 
 // Invalidate D-cache lines covering [addr, addr+size)
+// A partial line at either end also holds bytes outside the range, so those two are
+// cleaned as well rather than thrown away
 void cache_invalidate(void *addr, size_t size) {
     uintptr_t start = CACHE_ALIGN_DOWN(addr);
     uintptr_t end   = CACHE_ALIGN_UP((uintptr_t)addr + size);
 
     for (uintptr_t p = start; p < end; p += CACHE_LINE_SIZE) {
-        __asm__ volatile ("mcr p15, 0, %0, c7, c6, 1" :: "r"(p) : "memory");
+        if (p < (uintptr_t)addr || p + CACHE_LINE_SIZE > (uintptr_t)addr + size) {
+            __asm__ volatile ("mcr p15, 0, %0, c7, c14, 1" :: "r"(p) : "memory");
+        } else {
+            __asm__ volatile ("mcr p15, 0, %0, c7, c6, 1" :: "r"(p) : "memory");
+        }
     }
     dsb();
 }
@@ -48,20 +54,91 @@ void cache_clean_invalidate(void *addr, size_t size) {
     dsb();
 }
 
+// --- Set/way ---
+
+#define SW_INVALIDATE       0
+#define SW_CLEAN            1
+#define SW_CLEAN_INVALIDATE 2
+
+// One operation on every line of every data or unified level below the Level of Coherency
+static void dcache_setway(int op) {
+    uint32_t clidr;
+    __asm__ volatile ("mrc p15, 1, %0, c0, c0, 1" : "=r"(clidr));
+    uint32_t loc = (clidr >> 24) & 7;
+
+    for (uint32_t level = 0; level < loc; level++) {
+        if (((clidr >> (level * 3)) & 7) < 2) continue; // No cache or I-cache only
+
+        uint32_t ccsidr;
+        __asm__ volatile ("mcr p15, 2, %0, c0, c0, 0" :: "r"(level << 1));
+        isb();
+        __asm__ volatile ("mrc p15, 1, %0, c0, c0, 0" : "=r"(ccsidr));
+
+        uint32_t line_shift = (ccsidr & 7) + 4;
+        uint32_t max_way = (ccsidr >> 3) & 0x3FF;
+        uint32_t max_set = (ccsidr >> 13) & 0x7FFF;
+        uint32_t way_shift = max_way ? __builtin_clz(max_way) : 0;
+
+        for (uint32_t way = 0; way <= max_way; way++) {
+            for (uint32_t set = 0; set <= max_set; set++) {
+                uint32_t sw = (way << way_shift) | (set << line_shift) | (level << 1);
+                if (op == SW_INVALIDATE) {
+                    __asm__ volatile ("mcr p15, 0, %0, c7, c6, 2" :: "r"(sw) : "memory");
+                } else if (op == SW_CLEAN) {
+                    __asm__ volatile ("mcr p15, 0, %0, c7, c10, 2" :: "r"(sw) : "memory");
+                } else {
+                    __asm__ volatile ("mcr p15, 0, %0, c7, c14, 2" :: "r"(sw) : "memory");
+                }
+            }
+        }
+    }
+    dsb();
+}
+
 // Clean entire D-cache
 void cache_clean_all(void) {
-    __asm__ volatile ("mcr p15, 0, %0, c7, c10, 0" :: "r"(0) : "memory");
-    dsb();
+    dcache_setway(SW_CLEAN);
 }
 
-// Invalidate entire D-cache
+// Invalidate entire D-cache (discards dirty data anywhere in memory, boot use only)
 void cache_invalidate_all(void) {
-    __asm__ volatile ("mcr p15, 0, %0, c7, c6, 0" :: "r"(0) : "memory");
-    dsb();
+    dcache_setway(SW_INVALIDATE);
 }
 
 // Clean + Invalidate entire D-cache
 void cache_clean_invalidate_all(void) {
-    __asm__ volatile ("mcr p15, 0, %0, c7, c14, 0" :: "r"(0) : "memory");
-    dsb();
+    dcache_setway(SW_CLEAN_INVALIDATE);
+}
+
+// --- DMA ---
+
+// Uncached DMA region, mapped non-cacheable by start.S
+extern unsigned char __dma_start[];
+extern unsigned char __dma_end[];
+
+int cache_is_coherent(const void *addr, size_t size) {
+    return (const unsigned char *)addr >= __dma_start && (const unsigned char *)addr + size <= __dma_end;
+}
+
+// Before the device runs: a buffer it reads is cleaned out to memory; a buffer it
+// writes must hold no dirty line that could be evicted on top of the incoming data
+void cache_dma_prepare(void *addr, size_t size, int dir) {
+    if (cache_is_coherent(addr, size)) return;
+
+    if (size >= CACHE_SETWAY_THRESHOLD) {
+        if (dir == CACHE_DMA_TO_DEVICE) cache_clean_all();
+        else cache_clean_invalidate_all();
+    } else {
+        if (dir == CACHE_DMA_TO_DEVICE) cache_clean(addr, size);
+        else cache_clean_invalidate(addr, size);
+    }
+}
+
+// After the device has written memory: drop lines the core may have prefetched meanwhile.
+// Nothing in the buffer is dirty by now, so the set/way path can clean safely
+void cache_dma_complete(void *addr, size_t size, int dir) {
+    if (dir != CACHE_DMA_FROM_DEVICE || cache_is_coherent(addr, size)) return;
+
+    if (size >= CACHE_SETWAY_THRESHOLD) cache_clean_invalidate_all();
+    else cache_invalidate(addr, size);
 }
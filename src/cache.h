@@ -4,22 +4,33 @@
 #include <stdint.h>
 #include <stddef.h>
 
-// Cache line size for Cortex-A7
-#define CACHE_LINE_SIZE 32
+// L1 data cache line size for Cortex-A7
+#define CACHE_LINE_SIZE 64
 
 // Align helpers
 #define CACHE_ALIGN_DOWN(addr) ((uintptr_t)(addr) & ~(CACHE_LINE_SIZE - 1))
 #define CACHE_ALIGN_UP(addr)   (((uintptr_t)(addr) + CACHE_LINE_SIZE - 1) & ~(CACHE_LINE_SIZE - 1))
 
+// Above this, walking every line of every level by set/way beats walking the buffer
+#define CACHE_SETWAY_THRESHOLD (256 * 1024)
+
 // Core operations
 void cache_clean(void *addr, size_t size);
 void cache_invalidate(void *addr, size_t size);
 void cache_clean_invalidate(void *addr, size_t size);
 
-// Whole-cache operations (rarely needed)
+// Whole-cache operations by set/way, every level up to the point of coherency (this core only)
 void cache_clean_all(void);
 void cache_invalidate_all(void);
 void cache_clean_invalidate_all(void);
 
+// Maintenance around a transfer done by a bus master. Buffers in the uncached DMA
+// region need none; PIO transfers go through the CPU and need none either
+#define CACHE_DMA_TO_DEVICE   0 // Memory is read by the device (card write)
+#define CACHE_DMA_FROM_DEVICE 1 // Memory is written by the device (card read)
+
+int  cache_is_coherent(const void *addr, size_t size);
+void cache_dma_prepare(void *addr, size_t size, int dir);
+void cache_dma_complete(void *addr, size_t size, int dir);
 
 #endif
@@ -0,0 +1,58 @@
+#include "crc32.h"
+
+// Slicing-by-8: eight 256-entry tables let the inner loop fold eight bytes per round
+// with independent lookups instead of one dependent lookup per byte.
+// Cortex-A7 NEON has no 64-bit carry-less multiply (PMULL), and folding built from
+// VMULL.P8 costs more per byte than these lookups, so this is the only kernel.
+
+typedef uint32_t __attribute__((may_alias)) word_t;
+
+#define CRC32_POLY  0xEDB88320  // Reflected 0x04C11DB7
+#define CRC32C_POLY 0x82F63B78  // Reflected 0x1EDC6F41
+
+static uint32_t crc32_table[8][256];
+static uint32_t crc32c_table[8][256];
+
+// Tables are built on first use. Entry [0][1] is never zero once built, and start.S
+// does not clear .bss, so it is compared against its known value rather than a flag
+static void build_tables(uint32_t (*t)[256], uint32_t poly) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) c = (c & 1) ? (c >> 1) ^ poly : c >> 1;
+        t[0][i] = c;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int s = 1; s < 8; s++) t[s][i] = (t[s - 1][i] >> 8) ^ t[0][t[s - 1][i] & 0xFF];
+    }
+}
+
+static uint32_t crc_slice8(const uint32_t (*t)[256], uint32_t crc, const uint8_t *p, size_t len) {
+    crc = ~crc;
+
+    while (len > 0 && ((uintptr_t)p & 3)) {
+        crc = t[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+        len--;
+    }
+
+    while (len >= 8) {
+        uint32_t a = *(const word_t *)p ^ crc;  // Little-endian: byte 0 in the low bits
+        uint32_t b = *(const word_t *)(p + 4);
+        crc = t[7][a & 0xFF] ^ t[6][(a >> 8) & 0xFF] ^ t[5][(a >> 16) & 0xFF] ^ t[4][a >> 24] ^
+              t[3][b & 0xFF] ^ t[2][(b >> 8) & 0xFF] ^ t[1][(b >> 16) & 0xFF] ^ t[0][b >> 24];
+        p += 8;
+        len -= 8;
+    }
+
+    while (len-- > 0) crc = t[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+uint32_t crc32_update(uint32_t crc, const void *buf, size_t len) {
+    if (crc32_table[0][1] != 0x77073096) build_tables(crc32_table, CRC32_POLY);
+    return crc_slice8(crc32_table, crc, buf, len);
+}
+
+uint32_t crc32c_update(uint32_t crc, const void *buf, size_t len) {
+    if (crc32c_table[0][1] != 0xF26B8303) build_tables(crc32c_table, CRC32C_POLY);
+    return crc_slice8(crc32c_table, crc, buf, len);
+}
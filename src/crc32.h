@@ -0,0 +1,15 @@
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Incremental CRC-32 (IEEE 802.3 / zlib) and CRC-32C (Castagnoli).
+// Start with crc = 0 and feed the data in any number of pieces:
+//     crc = crc32_update(0, a, n); crc = crc32_update(crc, b, m);
+// The result equals one call over a followed by b.
+
+uint32_t crc32_update(uint32_t crc, const void *buf, size_t len);
+uint32_t crc32c_update(uint32_t crc, const void *buf, size_t len);
+
+#endif
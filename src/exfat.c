@@ -0,0 +1,650 @@
+#include "exfat.h"
+#include <string.h>
+#include "cache.h"
+
+#define EXFAT_EOF  0xFFFFFFFF
+#define EXFAT_BAD  0xFFFFFFF7
+#define EXFAT_FREE 0x00000000
+
+// Longest entry set: file + stream + 17 name entries (255 characters)
+#define EXFAT_SET_MAX 19
+
+// Internal MBR Partition Entry Structure
+struct mbr_partition_entry_t {
+    uint8_t  status;
+    uint8_t  chs_start[3];
+    uint8_t  type;
+    uint8_t  chs_end[3];
+    uint32_t lba_start;
+    uint32_t sector_count;
+} __attribute__((packed));
+
+// Cursor over the 32-byte entries of a directory, one sector buffered at a time
+struct dir_iter_t {
+    uint32_t cluster;
+    uint32_t slot;              // Entry index within the cluster
+    int      contiguous;
+    uint32_t clusters_left;     // Bounds NoFatChain directories, which have no EOF marker
+    uint32_t loaded_lba;
+    int      dirty;
+    int      error;
+    uint8_t *buffer;            // A sector from the mount's pool, taken and returned by the caller
+};
+
+// --- Internal Helpers ---
+
+static int valid_cluster(uint32_t cluster) {
+    return cluster >= 2 && cluster < EXFAT_BAD;
+}
+
+static int flush_fat(struct exfat_fs_t *fs) {
+    if (!fs->fat_dirty) return 0;
+    if (blk_write(fs->dev, fs->cached_fat_sector, 1, fs->fat_buffer) != 0) return -1;
+    fs->fat_dirty = 0;
+    return 0;
+}
+
+static int load_fat_sector(struct exfat_fs_t *fs, uint32_t fat_sector) {
+    if (fs->cached_fat_sector == fat_sector) return 0;
+    if (flush_fat(fs) != 0) return -1;
+    if (blk_read(fs->dev, fat_sector, 1, fs->fat_buffer) != 0) return -1;
+    fs->cached_fat_sector = fat_sector;
+    return 0;
+}
+
+static uint32_t get_next_cluster(struct exfat_fs_t *fs, uint32_t current_cluster) {
+    uint32_t fat_offset = current_cluster * 4;
+    if (load_fat_sector(fs, fs->fat_start_lba + (fat_offset / 512)) != 0) return EXFAT_EOF;
+    return *(uint32_t *)&fs->fat_buffer[fat_offset % 512];
+}
+
+// FAT updates are write-back: flushed when another FAT sector is needed or on close
+static int set_next_cluster(struct exfat_fs_t *fs, uint32_t current_cluster, uint32_t next_cluster) {
+    uint32_t fat_offset = current_cluster * 4;
+    if (load_fat_sector(fs, fs->fat_start_lba + (fat_offset / 512)) != 0) return -1;
+    *(uint32_t *)&fs->fat_buffer[fat_offset % 512] = next_cluster;
+    fs->fat_dirty = 1;
+    return 0;
+}
+
+static int flush_bitmap(struct exfat_fs_t *fs) {
+    if (!fs->bitmap_dirty) return 0;
+    if (blk_write(fs->dev, fs->cached_bitmap_sector, 1, fs->bitmap_buffer) != 0) return -1;
+    fs->bitmap_dirty = 0;
+    return 0;
+}
+
+static int load_bitmap_sector(struct exfat_fs_t *fs, uint32_t sector) {
+    if (fs->cached_bitmap_sector == sector) return 0;
+    if (flush_bitmap(fs) != 0) return -1;
+    if (blk_read(fs->dev, sector, 1, fs->bitmap_buffer) != 0) return -1;
+    fs->cached_bitmap_sector = sector;
+    return 0;
+}
+
+// Returns 1 if the cluster is free, 0 if in use, -1 on I/O error
+static int cluster_is_free(struct exfat_fs_t *fs, uint32_t cluster) {
+    uint32_t bit = cluster - 2;
+    if (load_bitmap_sector(fs, fs->bitmap_start_lba + bit / 4096) != 0) return -1;
+    return !(fs->bitmap_buffer[(bit / 8) % 512] & (1U << (bit % 8)));
+}
+
+static int cluster_mark(struct exfat_fs_t *fs, uint32_t cluster, int used) {
+    uint32_t bit = cluster - 2;
+    if (load_bitmap_sector(fs, fs->bitmap_start_lba + bit / 4096) != 0) return -1;
+    uint8_t *b = &fs->bitmap_buffer[(bit / 8) % 512];
+    if (used) *b |= (uint8_t)(1U << (bit % 8));
+    else *b &= (uint8_t)~(1U << (bit % 8));
+    fs->bitmap_dirty = 1;
+    return 0;
+}
+
+// Scan the allocation bitmap from the hint, skipping fully used bytes
+static uint32_t find_free_cluster(struct exfat_fs_t *fs) {
+    uint32_t end = fs->cluster_count + 2;
+    uint32_t c = fs->alloc_hint;
+
+    for (uint32_t scanned = 0; scanned < fs->cluster_count; ) {
+        if (c >= end) c = 2;
+        uint32_t bit = c - 2;
+        if (load_bitmap_sector(fs, fs->bitmap_start_lba + bit / 4096) != 0) return 0;
+        uint8_t byte = fs->bitmap_buffer[(bit / 8) % 512];
+        if (byte == 0xFF && (bit % 8) == 0) {
+            c += 8; scanned += 8;
+            continue;
+        }
+        if (!(byte & (1U << (bit % 8)))) {
+            fs->alloc_hint = c + 1;
+            return c;
+        }
+        c++; scanned++;
+    }
+    return 0;
+}
+
+static uint16_t upcase(uint16_t c) {
+    return (c >= 'a' && c <= 'z') ? (uint16_t)(c - 32) : c;
+}
+
+// NameHash of the stream extension, over the up-cased UTF-16 name
+static uint16_t name_hash(const char *name, int len) {
+    uint16_t hash = 0;
+    for (int i = 0; i < len; i++) {
+        uint16_t c = upcase((uint8_t)name[i]);
+        hash = (uint16_t)(((hash & 1) ? 0x8000 : 0) + (hash >> 1) + (c & 0xFF));
+        hash = (uint16_t)(((hash & 1) ? 0x8000 : 0) + (hash >> 1) + (c >> 8));
+    }
+    return hash;
+}
+
+static uint16_t set_checksum(const uint8_t *set, uint32_t count) {
+    uint16_t sum = 0;
+    for (uint32_t i = 0; i < count * 32; i++) {
+        if (i == 2 || i == 3) continue; // The checksum field itself
+        sum = (uint16_t)(((sum & 1) ? 0x8000 : 0) + (sum >> 1) + set[i]);
+    }
+    return sum;
+}
+
+static void dir_iter_start(struct dir_iter_t *it, uint32_t cluster, uint32_t slot,
+                           int contiguous, uint32_t clusters) {
+    it->cluster = cluster;
+    it->slot = slot;
+    it->contiguous = contiguous;
+    it->clusters_left = clusters;
+    it->loaded_lba = 0;
+    it->dirty = 0;
+    it->error = 0;
+}
+
+static int dir_iter_flush(struct exfat_fs_t *fs, struct dir_iter_t *it) {
+    if (!it->dirty) return 0;
+    if (blk_write(fs->dev, it->loaded_lba, 1, it->buffer) != 0) return -1;
+    it->dirty = 0;
+    return 0;
+}
+
+// Current entry, or NULL past the end of the directory (it->error set on I/O failure)
+static uint8_t *dir_iter_entry(struct exfat_fs_t *fs, struct dir_iter_t *it) {
+    if (!valid_cluster(it->cluster)) return NULL;
+    uint32_t lba = exfat_cluster_to_lba(fs, it->cluster) + it->slot / 16;
+    if (lba != it->loaded_lba) {
+        if (dir_iter_flush(fs, it) != 0 || blk_read(fs->dev, lba, 1, it->buffer) != 0) {
+            it->error = 1;
+            return NULL;
+        }
+        it->loaded_lba = lba;
+    }
+    return it->buffer + (it->slot % 16) * 32;
+}
+
+static void dir_iter_advance(struct exfat_fs_t *fs, struct dir_iter_t *it) {
+    if (++it->slot < fs->sectors_per_cluster * 16) return;
+    it->slot = 0;
+    if (it->contiguous) {
+        it->cluster = (--it->clusters_left > 0) ? it->cluster + 1 : EXFAT_EOF;
+    } else {
+        it->cluster = get_next_cluster(fs, it->cluster);
+    }
+}
+
+// Search one directory. The stream extension's length and NameHash reject almost every
+// non-matching set before its name entries are looked at.
+static int dir_lookup(struct exfat_fs_t *fs, uint32_t dir_cluster, int dir_contiguous, uint32_t dir_clusters,
+                      const char *name, int len, struct exfat_file_t *out, uint16_t *attr) {
+    struct dir_iter_t it;
+    uint16_t hash = name_hash(name, len);
+    uint8_t *e;
+    int res = -2;
+
+    it.buffer = pool_alloc(&fs->sectors);
+    if (!it.buffer) return -1;
+    dir_iter_start(&it, dir_cluster, 0, dir_contiguous, dir_clusters);
+    while ((e = dir_iter_entry(fs, &it)) != NULL) {
+        if (e[0] == EXFAT_ENTRY_EOD) goto done;
+        if (e[0] != EXFAT_ENTRY_FILE) {
+            dir_iter_advance(fs, &it);
+            continue;
+        }
+
+        struct exfat_file_entry_t file;
+        memcpy(&file, e, 32);
+        uint32_t set_cluster = it.cluster, set_slot = it.slot;
+        dir_iter_advance(fs, &it);
+
+        e = dir_iter_entry(fs, &it);
+        if (e == NULL) break;
+        if (e[0] != EXFAT_ENTRY_STREAM || file.secondary_count < 2) continue;
+
+        struct exfat_stream_entry_t stream;
+        memcpy(&stream, e, 32);
+        dir_iter_advance(fs, &it);
+
+        uint32_t remaining = file.secondary_count - 1;
+        int match = (stream.name_length == len && stream.name_hash == hash);
+        int pos = 0;
+        for (; remaining > 0; remaining--) {
+            if (match) {
+                e = dir_iter_entry(fs, &it);
+                if (e == NULL) break;
+                if (e[0] == EXFAT_ENTRY_NAME) {
+                    const struct exfat_name_entry_t *n = (const struct exfat_name_entry_t *)e;
+                    for (int j = 0; j < 15 && pos < len; j++, pos++) {
+                        if (upcase(n->name[j]) != upcase((uint8_t)name[pos])) match = 0;
+                    }
+                }
+            }
+            dir_iter_advance(fs, &it);
+        }
+
+        if (match && pos == len) {
+            if (stream.data_length > 0xFFFFFFFFu) { res = -4; goto done; } // Beyond the 32-bit handle
+            out->start_cluster = stream.first_cluster;
+            out->current_cluster = stream.first_cluster;
+            out->current_index = 0;
+            out->size = (uint32_t)stream.data_length;
+            out->valid_size = (uint32_t)stream.valid_data_length;
+            out->position = 0;
+            out->contiguous = (stream.flags & EXFAT_FLAG_NO_FAT_CHAIN) != 0;
+            out->dir_cluster = set_cluster;
+            out->dir_slot = set_slot;
+            out->dir_contiguous = dir_contiguous;
+            *attr = file.attr;
+            res = 0;
+            goto done;
+        }
+    }
+    if (it.error) res = -1;
+
+done:
+    pool_free(&fs->sectors, it.buffer);
+    return res;
+}
+
+static uint32_t file_clusters(struct exfat_fs_t *fs, uint32_t size) {
+    return (size + fs->bytes_per_cluster - 1) / fs->bytes_per_cluster;
+}
+
+// LBA holding the byte at file->position. Contiguous files need no FAT lookups at all
+static uint32_t file_lba(struct exfat_fs_t *fs, struct exfat_file_t *file) {
+    uint32_t index = file->position / fs->bytes_per_cluster;
+    uint32_t sector = (file->position % fs->bytes_per_cluster) / 512;
+
+    if (file->contiguous) return exfat_cluster_to_lba(fs, file->start_cluster + index) + sector;
+
+    if (index < file->current_index) {
+        file->current_cluster = file->start_cluster;
+        file->current_index = 0;
+    }
+    while (file->current_index < index) {
+        uint32_t next = get_next_cluster(fs, file->current_cluster);
+        if (!valid_cluster(next)) return 0;
+        file->current_cluster = next;
+        file->current_index++;
+    }
+    return exfat_cluster_to_lba(fs, file->current_cluster) + sector;
+}
+
+// Whole sectors that are physically contiguous from file->position onwards
+static uint32_t file_run_sectors(struct exfat_fs_t *fs, struct exfat_file_t *file) {
+    if (file->contiguous) {
+        return (file_clusters(fs, file->size) * fs->bytes_per_cluster - file->position) / 512;
+    }
+    return (fs->bytes_per_cluster - file->position % fs->bytes_per_cluster) / 512;
+}
+
+// Make sure clusters back the file up to 'end' bytes and grow DataLength to match. A NoFatChain file stays contiguous
+// while the cluster after its run is free; otherwise its run is given a real FAT chain.
+static int ensure_alloc(struct exfat_fs_t *fs, struct exfat_file_t *file, uint32_t end) {
+    uint32_t have = (file->start_cluster == 0) ? 0 : file_clusters(fs, file->size);
+    uint32_t need = file_clusters(fs, end);
+    uint32_t last = 0;
+
+    if (have > 0) {
+        if (file->contiguous) {
+            last = file->start_cluster + have - 1;
+        } else {
+            last = file->start_cluster;
+            for (uint32_t i = 1; i < have; i++) last = get_next_cluster(fs, last);
+        }
+    }
+
+    while (have < need) {
+        if (have == 0) {
+            uint32_t c = find_free_cluster(fs);
+            if (c == 0) return -1;
+            if (cluster_mark(fs, c, 1) != 0) return -1;
+            file->start_cluster = c;
+            file->current_cluster = c;
+            file->current_index = 0;
+            file->contiguous = 1;
+            last = c;
+            have++;
+            continue;
+        }
+
+        if (file->contiguous) {
+            uint32_t c = last + 1;
+            if (c < fs->cluster_count + 2 && cluster_is_free(fs, c) == 1) {
+                if (cluster_mark(fs, c, 1) != 0) return -1;
+                last = c;
+                have++;
+                continue;
+            }
+            for (uint32_t x = file->start_cluster; x < last; x++) {
+                if (set_next_cluster(fs, x, x + 1) != 0) return -1;
+            }
+            if (set_next_cluster(fs, last, EXFAT_EOF) != 0) return -1;
+            file->contiguous = 0;
+            file->current_cluster = file->start_cluster;
+            file->current_index = 0;
+        }
+
+        uint32_t c = find_free_cluster(fs);
+        if (c == 0) return -1;
+        if (cluster_mark(fs, c, 1) != 0) return -1;
+        if (set_next_cluster(fs, last, c) != 0) return -1;
+        if (set_next_cluster(fs, c, EXFAT_EOF) != 0) return -1;
+        last = c;
+        have++;
+    }
+    if (end > file->size) file->size = end; // DataLength, unwritten bytes stay past ValidDataLength
+    return 0;
+}
+
+// Write into already allocated space, using one multi-block transfer per physical run
+static int write_span(struct exfat_fs_t *fs, struct exfat_file_t *file, const uint8_t *ptr, uint32_t size) {
+    uint32_t bytes_written = 0;
+    int res = -1;
+    uint8_t *scratch = pool_alloc(&fs->sectors);
+    if (!scratch) return -1;
+
+    while (size > 0) {
+        uint32_t lba = file_lba(fs, file);
+        if (lba == 0) goto done;
+        uint32_t byte_idx = file->position % 512;
+        int is_aligned = (((uintptr_t)ptr & 0x3) == 0);
+
+        if (byte_idx != 0 || size < 512) {
+            // Sectors wholly past ValidDataLength have nothing worth reading back
+            if (file->position - byte_idx < file->valid_size) {
+                if (blk_read(fs->dev, lba, 1, scratch) != 0) goto done;
+            } else {
+                memset(scratch, 0, 512);
+            }
+            uint32_t chunk = 512 - byte_idx;
+            if (chunk > size) chunk = size;
+            memcpy(scratch + byte_idx, ptr, chunk);
+            if (blk_write(fs->dev, lba, 1, scratch) != 0) goto done;
+            ptr += chunk; size -= chunk; file->position += chunk; bytes_written += chunk;
+        } else if (is_aligned) {
+            uint32_t n = size / 512;
+            uint32_t run = file_run_sectors(fs, file);
+            if (n > run) n = run;
+            if (blk_write(fs->dev, lba, n, ptr) != 0) goto done;
+            ptr += n * 512; size -= n * 512; file->position += n * 512; bytes_written += n * 512;
+        } else {
+            memcpy(scratch, ptr, 512);
+            if (blk_write(fs->dev, lba, 1, scratch) != 0) goto done;
+            ptr += 512; size -= 512; file->position += 512; bytes_written += 512;
+        }
+    }
+    res = bytes_written;
+
+done:
+    pool_free(&fs->sectors, scratch);
+    return res;
+}
+
+// Rewrite the stream extension from the handle and refresh the set checksum
+static int update_entry_set(struct exfat_fs_t *fs, struct exfat_file_t *file) {
+    uint8_t set[EXFAT_SET_MAX * 32];
+    struct dir_iter_t it;
+    uint8_t *e;
+    int res = -1;
+
+    it.buffer = pool_alloc(&fs->sectors);
+    if (!it.buffer) return -1;
+    dir_iter_start(&it, file->dir_cluster, file->dir_slot, file->dir_contiguous, 0xFFFFFFFF);
+    e = dir_iter_entry(fs, &it);
+    if (e == NULL || e[0] != EXFAT_ENTRY_FILE) goto done;
+    uint32_t count = ((struct exfat_file_entry_t *)e)->secondary_count + 1;
+    if (count < 2 || count > EXFAT_SET_MAX) goto done;
+
+    for (uint32_t k = 0; k < count; k++) {
+        if (k > 0) dir_iter_advance(fs, &it);
+        if ((e = dir_iter_entry(fs, &it)) == NULL) goto done;
+        memcpy(set + k * 32, e, 32);
+    }
+
+    struct exfat_stream_entry_t *stream = (struct exfat_stream_entry_t *)(set + 32);
+    stream->flags = EXFAT_FLAG_ALLOC_POSSIBLE | (file->contiguous ? EXFAT_FLAG_NO_FAT_CHAIN : 0);
+    stream->first_cluster = file->start_cluster;
+    stream->data_length = file->size;
+    stream->valid_data_length = file->valid_size;
+    ((struct exfat_file_entry_t *)set)->set_checksum = set_checksum(set, count);
+
+    dir_iter_start(&it, file->dir_cluster, file->dir_slot, file->dir_contiguous, 0xFFFFFFFF);
+    for (uint32_t k = 0; k < count; k++) {
+        if (k > 0) dir_iter_advance(fs, &it);
+        if ((e = dir_iter_entry(fs, &it)) == NULL) goto done;
+        memcpy(e, set + k * 32, 32);
+        it.dirty = 1;
+    }
+    res = dir_iter_flush(fs, &it);
+
+done:
+    pool_free(&fs->sectors, it.buffer);
+    return res;
+}
+
+// --- Public API ---
+
+uint32_t exfat_cluster_to_lba(struct exfat_fs_t *fs, uint32_t cluster) {
+    if (cluster < 2) return 0;
+    return fs->heap_start_lba + ((cluster - 2) * fs->sectors_per_cluster);
+}
+
+// Geometry from the boot sector, then the Allocation Bitmap from the root directory.
+// 'buffer' holds the boot sector first and is the directory cursor's sector after that
+static int read_volume(struct exfat_fs_t *fs, uint8_t *buffer) {
+    uint32_t partition_lba = 0;
+
+    // 1. Read Sector 0
+    if (blk_read(fs->dev, 0, 1, buffer) != 0) return -1;
+
+    struct exfat_bootsector_t *bs = (struct exfat_bootsector_t *)buffer;
+
+    // 2. MBR Check
+    if (memcmp(bs->fs_name, "EXFAT   ", 8) != 0) {
+        struct mbr_partition_entry_t *part = (struct mbr_partition_entry_t *)(buffer + 0x1BE);
+        memcpy(&partition_lba, &part->lba_start, 4);
+        if (partition_lba == 0) return -2;
+
+        if (blk_read(fs->dev, partition_lba, 1, buffer) != 0) return -3;
+        if (memcmp(bs->fs_name, "EXFAT   ", 8) != 0) return -4;
+    }
+    if (bs->bytes_per_sector_shift != 9) return -5;
+
+    fs->sectors_per_cluster = 1U << bs->sectors_per_cluster_shift;
+    fs->bytes_per_cluster = fs->sectors_per_cluster * 512;
+    fs->fat_start_lba = partition_lba + bs->fat_offset;
+    fs->heap_start_lba = partition_lba + bs->cluster_heap_offset;
+    fs->root_cluster = bs->root_cluster;
+    fs->cluster_count = bs->cluster_count;
+    fs->cached_fat_sector = 0xFFFFFFFF;
+    fs->fat_dirty = 0;
+    fs->cached_bitmap_sector = 0xFFFFFFFF;
+    fs->bitmap_dirty = 0;
+    fs->alloc_hint = 2;
+
+    // 3. Locate the Allocation Bitmap in the root directory
+    struct dir_iter_t it;
+    uint8_t *e;
+    it.buffer = buffer;
+    dir_iter_start(&it, fs->root_cluster, 0, 0, 0);
+    while ((e = dir_iter_entry(fs, &it)) != NULL && e[0] != EXFAT_ENTRY_EOD) {
+        if (e[0] == EXFAT_ENTRY_BITMAP) break;
+        dir_iter_advance(fs, &it);
+    }
+    if (e == NULL || e[0] != EXFAT_ENTRY_BITMAP) return -6;
+
+    struct exfat_bitmap_entry_t bitmap;
+    memcpy(&bitmap, e, 32);
+
+    // Sector lookups into the bitmap assume it is one run of clusters
+    uint32_t c = bitmap.first_cluster;
+    uint32_t n = file_clusters(fs, (uint32_t)bitmap.data_length);
+    for (uint32_t i = 1; i < n; i++) {
+        uint32_t next = get_next_cluster(fs, c);
+        if (next != c + 1) return -7;
+        c = next;
+    }
+    fs->bitmap_start_lba = exfat_cluster_to_lba(fs, bitmap.first_cluster);
+    return 0;
+}
+
+// A mounted fs is refused (-9): its pool would be lost. Unmount it first
+int exfat_mount(struct exfat_fs_t *fs, struct blkdev_t *dev) {
+    if (fs->mounted == EXFAT_MOUNTED) return -9;
+    fs->dev = dev;
+    if (pool_init(&fs->sectors, 512, EXFAT_SCRATCH_SECTORS) != 0) return -8;
+
+    uint8_t *buffer = pool_alloc(&fs->sectors);
+    int res = read_volume(fs, buffer);
+    pool_free(&fs->sectors, buffer);
+    if (res != 0) {
+        pool_destroy(&fs->sectors);
+        return res;
+    }
+    fs->mounted = EXFAT_MOUNTED;
+    return 0;
+}
+
+// Write back the bitmap and FAT caches and release the scratch sectors. Close files first
+int exfat_unmount(struct exfat_fs_t *fs) {
+    int res = flush_bitmap(fs);
+    if (res == 0) res = flush_fat(fs);
+    if (res == 0) res = blk_flush(fs->dev);
+    pool_destroy(&fs->sectors);
+    fs->mounted = 0;
+    return res;
+}
+
+int exfat_open(struct exfat_fs_t *fs, const char *path, struct exfat_file_t *out) {
+    uint32_t dir_cluster = fs->root_cluster;
+    int dir_contiguous = 0;
+    uint32_t dir_clusters = 0;
+    const char *p = path;
+    if (*p == '/') p++;
+    if (*p == '\0') return -3;
+
+    while (*p) {
+        const char *end = p;
+        while (*end && *end != '/') end++;
+        int len = end - p;
+        if (len > EXFAT_NAME_MAX) return -2;
+
+        uint16_t attr;
+        int res = dir_lookup(fs, dir_cluster, dir_contiguous, dir_clusters, p, len, out, &attr);
+        if (res != 0) return res;
+
+        p = end;
+        if (*p == '/') p++;
+        if (*p == '\0') return 0;
+
+        if (!(attr & EXFAT_ATTR_DIRECTORY)) return -2;
+        dir_cluster = out->start_cluster;
+        dir_contiguous = out->contiguous;
+        dir_clusters = file_clusters(fs, out->size);
+    }
+    return -3;
+}
+
+int exfat_read(struct exfat_fs_t *fs, struct exfat_file_t *file, void *buf, uint32_t size) {
+    if (file->position >= file->size) return 0;
+    if (file->position + size > file->size) size = file->size - file->position;
+
+    uint8_t *ptr = (uint8_t *)buf;
+    uint32_t bytes_read = 0;
+    uint8_t *scratch = pool_alloc(&fs->sectors);
+    if (!scratch) return -1;
+
+    // Only data below ValidDataLength is on the card
+    uint32_t on_disk = (file->position < file->valid_size) ? file->valid_size - file->position : 0;
+    if (on_disk > size) on_disk = size;
+
+    while (on_disk > 0) {
+        uint32_t lba = file_lba(fs, file);
+        if (lba == 0) break;
+        uint32_t byte_idx = file->position % 512;
+        int is_aligned = (((uintptr_t)ptr & 0x3) == 0);
+
+        if (byte_idx == 0 && on_disk >= 512 && is_aligned) {
+            uint32_t n = on_disk / 512;
+            uint32_t run = file_run_sectors(fs, file);
+            if (n > run) n = run;
+            if (blk_read(fs->dev, lba, n, ptr) != 0) break;
+            ptr += n * 512; on_disk -= n * 512; file->position += n * 512; bytes_read += n * 512;
+        } else {
+            if (blk_read(fs->dev, lba, 1, scratch) != 0) break;
+            uint32_t chunk = 512 - byte_idx;
+            if (chunk > on_disk) chunk = on_disk;
+            memcpy(ptr, scratch + byte_idx, chunk);
+            ptr += chunk; on_disk -= chunk; file->position += chunk; bytes_read += chunk;
+        }
+    }
+    pool_free(&fs->sectors, scratch);
+    if (on_disk > 0) return bytes_read; // I/O error
+
+    uint32_t zeros = size - bytes_read;
+    memset(ptr, 0, zeros);
+    file->position += zeros;
+    return bytes_read + zeros;
+}
+
+int exfat_write(struct exfat_fs_t *fs, struct exfat_file_t *file, const void *buf, uint32_t size) {
+    if (file->dir_cluster == 0) return -9; // Safety: Invalid file handle
+    if (size == 0) return 0;
+
+    uint32_t end = file->position + size;
+    if (end < file->position) return -1; // Past the 32-bit handle
+    if (ensure_alloc(fs, file, end) != 0) return -1;
+
+    // A write past ValidDataLength must first make the gap read back as zeros
+    if (file->position > file->valid_size) {
+        uint8_t *zero = pool_alloc(&fs->sectors);
+        if (!zero) return -1;
+        uint32_t target = file->position;
+        memset(zero, 0, 512);
+        file->position = file->valid_size;
+        while (file->position < target) {
+            uint32_t chunk = 512 - file->position % 512;
+            if (chunk > target - file->position) chunk = target - file->position;
+            if (write_span(fs, file, zero, chunk) < 0) break;
+        }
+        pool_free(&fs->sectors, zero);
+        if (file->position < target) return -1;
+    }
+
+    int res = write_span(fs, file, (const uint8_t *)buf, size);
+    if (res < 0) return res;
+
+    if (file->position > file->valid_size) file->valid_size = file->position;
+    if (update_entry_set(fs, file) != 0) return -2;
+    return res;
+}
+
+int exfat_seek(struct exfat_fs_t *fs, struct exfat_file_t *file, uint32_t offset) {
+    (void)fs;
+    if (offset > file->size) return -1;
+    file->position = offset; // Chained files catch up lazily in file_lba
+    return 0;
+}
+
+int exfat_close(struct exfat_fs_t *fs, struct exfat_file_t *file) {
+    (void)file;
+    if (flush_bitmap(fs) != 0) return -1;
+    if (flush_fat(fs) != 0) return -1;
+    return 0;
+}
@@ -0,0 +1,161 @@
+#ifndef EXFAT_H
+#define EXFAT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "cache.h"
+#include "malloc.h"
+#include "blkdev.h"
+
+// --- On-Disk Structures ---
+
+// Full 512-byte exFAT Boot Sector Definition
+struct exfat_bootsector_t {
+    uint8_t  jmp_boot[3];                // 0x00
+    uint8_t  fs_name[8];                 // 0x03 "EXFAT   "
+    uint8_t  must_be_zero[53];           // 0x0B (where the FAT BPB would be)
+    uint64_t partition_offset;           // 0x40
+    uint64_t volume_length;              // 0x48
+    uint32_t fat_offset;                 // 0x50 (sectors, from volume start)
+    uint32_t fat_length;                 // 0x54
+    uint32_t cluster_heap_offset;        // 0x58
+    uint32_t cluster_count;              // 0x5C
+    uint32_t root_cluster;               // 0x60
+    uint32_t volume_serial;              // 0x64
+    uint16_t fs_revision;                // 0x68
+    uint16_t volume_flags;               // 0x6A
+    uint8_t  bytes_per_sector_shift;     // 0x6C
+    uint8_t  sectors_per_cluster_shift;  // 0x6D
+    uint8_t  num_fats;                   // 0x6E
+    uint8_t  drive_select;               // 0x6F
+    uint8_t  percent_in_use;             // 0x70
+    uint8_t  reserved[7];                // 0x71
+    uint8_t  boot_code[390];             // 0x78
+    uint16_t boot_signature;             // 0x1FE (0xAA55)
+} __attribute__((packed));
+
+// Directory entry types
+#define EXFAT_ENTRY_EOD       0x00
+#define EXFAT_ENTRY_BITMAP    0x81
+#define EXFAT_ENTRY_UPCASE    0x82
+#define EXFAT_ENTRY_LABEL     0x83
+#define EXFAT_ENTRY_FILE      0x85
+#define EXFAT_ENTRY_STREAM    0xC0
+#define EXFAT_ENTRY_NAME      0xC1
+
+// Stream extension flags
+#define EXFAT_FLAG_ALLOC_POSSIBLE  0x01
+#define EXFAT_FLAG_NO_FAT_CHAIN    0x02
+
+#define EXFAT_ATTR_DIRECTORY  0x10
+
+// Primary entry of a file's entry set (0x85)
+struct exfat_file_entry_t {
+    uint8_t  type;
+    uint8_t  secondary_count;
+    uint16_t set_checksum;
+    uint16_t attr;
+    uint16_t reserved1;
+    uint32_t create_ts;
+    uint32_t modify_ts;
+    uint32_t access_ts;
+    uint8_t  create_10ms;
+    uint8_t  modify_10ms;
+    uint8_t  create_utc;
+    uint8_t  modify_utc;
+    uint8_t  access_utc;
+    uint8_t  reserved2[7];
+} __attribute__((packed));
+
+// Stream extension (0xC0), always the first secondary entry
+struct exfat_stream_entry_t {
+    uint8_t  type;
+    uint8_t  flags;
+    uint8_t  reserved1;
+    uint8_t  name_length;       // In UTF-16 characters
+    uint16_t name_hash;         // Hash of the up-cased name
+    uint16_t reserved2;
+    uint64_t valid_data_length; // Bytes actually written, the rest reads as zero
+    uint32_t reserved3;
+    uint32_t first_cluster;
+    uint64_t data_length;       // File size (allocation is rounded up to clusters)
+} __attribute__((packed));
+
+// File name (0xC1), 15 UTF-16 characters each
+struct exfat_name_entry_t {
+    uint8_t  type;
+    uint8_t  flags;
+    uint16_t name[15];
+} __attribute__((packed));
+
+// Allocation bitmap (0x81), lives in the root directory
+struct exfat_bitmap_entry_t {
+    uint8_t  type;
+    uint8_t  flags;
+    uint8_t  reserved[18];
+    uint32_t first_cluster;
+    uint64_t data_length;
+} __attribute__((packed));
+
+#define EXFAT_NAME_MAX 255
+
+// --- Runtime Structures ---
+
+// Scratch sectors per mount: exfat_write holds its zero source across write_span's scratch
+#define EXFAT_SCRATCH_SECTORS 2
+
+// A value rather than a flag: the struct may sit in .bss, which start.S does not clear
+#define EXFAT_MOUNTED 0x4D6E7845
+
+struct exfat_fs_t {
+    struct blkdev_t *dev;
+    uint32_t fat_start_lba;
+    uint32_t heap_start_lba;
+    uint32_t sectors_per_cluster;
+    uint32_t bytes_per_cluster;
+    uint32_t root_cluster;
+    uint32_t cluster_count;
+
+    // Allocation bitmap (kept contiguous by every formatter, checked at mount)
+    uint32_t bitmap_start_lba;
+    uint32_t alloc_hint;        // Cluster to start the next free search from
+
+    // Single Sector FAT Cache
+    uint32_t cached_fat_sector;
+    uint8_t  fat_buffer[512] __attribute__((aligned(CACHE_LINE_SIZE)));
+    int      fat_dirty;
+
+    // Single Sector Bitmap Cache
+    uint32_t cached_bitmap_sector;
+    uint8_t  bitmap_buffer[512] __attribute__((aligned(CACHE_LINE_SIZE)));
+    int      bitmap_dirty;
+
+    struct mem_pool_t sectors;  // One-sector scratch buffers, released by exfat_unmount
+    uint32_t mounted;           // EXFAT_MOUNTED from mount to unmount
+};
+
+struct exfat_file_t {
+    uint32_t start_cluster;
+    uint32_t current_cluster;   // Only tracked for FAT-chained files
+    uint32_t current_index;     // Cluster ordinal of current_cluster within the file
+    uint32_t size;              // DataLength
+    uint32_t valid_size;        // ValidDataLength, bytes past it read as zero
+    uint32_t position;
+    int      contiguous;        // NoFatChain: clusters are start_cluster, start_cluster+1, ...
+    uint32_t dir_cluster;       // Cluster holding the 0x85 entry
+    uint32_t dir_slot;          // Entry index within that cluster
+    int      dir_contiguous;    // Whether the parent directory itself is NoFatChain
+};
+
+// --- API ---
+
+int exfat_mount(struct exfat_fs_t *fs, struct blkdev_t *dev);
+int exfat_unmount(struct exfat_fs_t *fs);
+int exfat_open(struct exfat_fs_t *fs, const char *path, struct exfat_file_t *out);
+int exfat_read(struct exfat_fs_t *fs, struct exfat_file_t *file, void *buf, uint32_t size);
+int exfat_write(struct exfat_fs_t *fs, struct exfat_file_t *file, const void *buf, uint32_t size);
+int exfat_seek(struct exfat_fs_t *fs, struct exfat_file_t *file, uint32_t offset);
+int exfat_close(struct exfat_fs_t *fs, struct exfat_file_t *file);
+
+uint32_t exfat_cluster_to_lba(struct exfat_fs_t *fs, uint32_t cluster);
+#endif // EXFAT_H
@@ -1,6 +1,9 @@
 #include "fat32.h"
-#include "sdhc.h"
+#include <string.h>
 #include "cache.h"
+#include "crc32.h"
+#include "prof.h"
+#include "trace.h"
 
 #define FAT_EOF 0x0FFFFFFF
 #define FAT_FREE 0x00000000
@@ -15,67 +18,600 @@ struct mbr_partition_entry_t {
     uint32_t sector_count;
 } __attribute__((packed));
 
+// --- I/O Accounting ---
+
+#ifdef IO_STATS
+#define IO_STAT(stmt) do { stmt; } while (0)
+
+// Open for the rest of an API function: charges what the device and FAT saw meanwhile to the op
+struct io_scope_t {
+    struct fat32_fs_t *fs;
+    enum fat32_op_t op;
+    struct blkdev_stats_t dev0;
+    uint32_t lookups0;
+};
+
+static inline struct io_scope_t io_scope_begin(struct fat32_fs_t *fs, enum fat32_op_t op) {
+    struct io_scope_t s = { fs, op, fs->dev->stats, fs->stats.fat_lookups };
+    fs->stats.op[op].calls++;
+    return s;
+}
+
+static inline void io_scope_end(struct io_scope_t *s) {
+    struct fat32_op_cost_t *c = &s->fs->stats.op[s->op];
+    const struct blkdev_stats_t *d = &s->fs->dev->stats;
+    c->dev_reads += d->reads - s->dev0.reads;
+    c->dev_writes += d->writes - s->dev0.writes;
+    c->sectors_read += d->sectors_read - s->dev0.sectors_read;
+    c->sectors_written += d->sectors_written - s->dev0.sectors_written;
+    c->fat_lookups += s->fs->stats.fat_lookups - s->lookups0;
+}
+
+#define IO_OP(fs, op) \
+    struct io_scope_t io_scope __attribute__((cleanup(io_scope_end))) = io_scope_begin(fs, op)
+#else
+#define IO_STAT(stmt) do { } while (0)
+#define IO_OP(fs, op)
+#endif
+
 // --- Internal Helpers ---
 
-static void format_83_name(const char *path, int len, char *dest) {
+#define ATTR_LFN 0x0F
+#define LFN_CHARS 13
+
+// A lookup name, prepared once per path component
+struct name_key_t {
+    const char *name;
+    int len;
+    uint8_t folded[FAT32_LFN_MAX]; // Upper-cased, compared directly against LFN parts
+    int has_short;                 // Name is also a valid 8.3 name
+    char short_name[11];
+    int has_long;                  // Short enough to match an LFN chain
+};
+
+// State of the LFN chain preceding the current directory entry
+struct lfn_match_t {
+    int active;             // Chain still matches the key
+    uint8_t checksum;
+    uint32_t expect;        // Next expected ordinal
+};
+
+static uint8_t fold_char(uint32_t c) {
+    if (c >= 'a' && c <= 'z') c -= 32;
+    return (c > 0xFF) ? 0 : (uint8_t)c; // Wider code units never match an 8-bit name
+}
+
+static int short_char_ok(char c) {
+    if ((uint8_t)c <= 0x20 || (uint8_t)c >= 0x7F) return 0;
+    for (const char *bad = "\"*+,./:;<=>?[\\]|"; *bad; bad++) {
+        if (c == *bad) return 0;
+    }
+    return 1;
+}
+
+// Build an 8.3 name. Returns 0 if 'name' does not fit, 1 if it fits exactly, 2 if only when upper-cased
+static int format_83_name(const char *name, int len, char *dest) {
     memset(dest, ' ', 11);
-    int i = 0, ext_mode = 0, dest_idx = 0;
-    for (i = 0; i < len; i++) {
-        char c = path[i];
-        if (c == '.') { ext_mode = 1; dest_idx = 8; continue; }
-        if (c >= 'a' && c <= 'z') c -= 32;
-        if (ext_mode) { if (dest_idx < 11) dest[dest_idx++] = c; }
-        else { if (dest_idx < 8) dest[dest_idx++] = c; }
+    if (len == 1 && name[0] == '.') { dest[0] = '.'; return 1; }
+    if (len == 2 && name[0] == '.' && name[1] == '.') { dest[0] = '.'; dest[1] = '.'; return 1; }
+
+    int dot = -1;
+    for (int i = 0; i < len; i++) {
+        if (name[i] == '.') { if (dot >= 0) return 0; dot = i; }
+    }
+    int base_len = (dot >= 0) ? dot : len;
+    int ext_len = (dot >= 0) ? len - dot - 1 : 0;
+    if (base_len < 1 || base_len > 8 || ext_len > 3 || (dot >= 0 && ext_len == 0)) return 0;
+
+    int res = 1;
+    for (int i = 0; i < len; i++) {
+        if (i == dot) continue;
+        char c = name[i];
+        if (c >= 'a' && c <= 'z') { c -= 32; res = 2; }
+        if (!short_char_ok(c)) return 0;
+        dest[(i < base_len) ? i : 8 + (i - dot - 1)] = c;
+    }
+    return res;
+}
+
+static void name_key_init(struct name_key_t *key, const char *name, int len) {
+    key->name = name;
+    key->len = len;
+    for (int i = 0; i < len && i < FAT32_LFN_MAX; i++) key->folded[i] = fold_char((uint8_t)name[i]);
+    key->has_short = (format_83_name(name, len, key->short_name) != 0);
+    key->has_long = (len <= FAT32_LFN_MAX);
+}
+
+static uint8_t lfn_checksum(const uint8_t *short_name) {
+    uint8_t sum = 0;
+    for (int i = 0; i < 11; i++) sum = (uint8_t)(((sum & 1) << 7) + (sum >> 1) + short_name[i]);
+    return sum;
+}
+
+static uint16_t lfn_get_char(const struct fat32_lfn_entry_t *e, int j) {
+    if (j < 5) return e->name1[j];
+    if (j < 11) return e->name2[j - 5];
+    return e->name3[j - 11];
+}
+
+static void lfn_set_char(struct fat32_lfn_entry_t *e, int j, uint16_t c) {
+    if (j < 5) e->name1[j] = c;
+    else if (j < 11) e->name2[j - 5] = c;
+    else e->name3[j - 11] = c;
+}
+
+// Feed one LFN entry. Each part carries its ordinal, so it is compared in place against
+// the key without reassembling the UTF-16 name. A chain is dropped on its first mismatch
+// and its remaining parts are skipped on the ordinal/checksum test alone.
+static void lfn_step(struct lfn_match_t *m, const struct name_key_t *key, const struct fat32_lfn_entry_t *e) {
+    uint32_t ord = e->ord & 0x1F;
+
+    if (e->ord & 0x40) {
+        // The part count bounds the name length, so most chains are rejected right here
+        m->active = (ord != 0 && key->len <= (int)(ord * LFN_CHARS) && key->len > (int)((ord - 1) * LFN_CHARS));
+        m->checksum = e->checksum;
+        m->expect = ord;
+        if (!m->active) return;
+    } else if (!m->active || ord != m->expect || e->checksum != m->checksum) {
+        m->active = 0;
+        return;
+    }
+
+    int base = (ord - 1) * LFN_CHARS;
+    for (int j = 0; j < LFN_CHARS; j++) {
+        uint16_t c = lfn_get_char(e, j);
+        if (base + j >= key->len) {
+            if (c != 0x0000 && c != 0xFFFF) m->active = 0; // Stored name is longer
+            break;
+        }
+        if (fold_char(c) != key->folded[base + j] || c == 0) { m->active = 0; break; }
+    }
+    m->expect = ord - 1;
+}
+
+// Bring a FAT sector into the single-sector cache, writing the old one back if dirty
+static int fat_load(struct fat32_fs_t *fs, uint32_t fat_sector) {
+    if (fs->cached_fat_sector == fat_sector) {
+        TRACE_EVENT(TRACE_FAT_HIT, fat_sector, 0);
+        IO_STAT(fs->stats.fat_hits++);
+        return 0;
+    }
+    TRACE_EVENT(TRACE_FAT_MISS, fat_sector, fs->fat_dirty);
+    IO_STAT(fs->stats.fat_misses++);
+    if (fs->fat_dirty) {
+        IO_STAT(fs->stats.fat_writebacks++);
+        blk_write(fs->dev, fs->cached_fat_sector, 1, fs->fat_buffer);
+        fs->fat_dirty = 0;
+    }
+    if (blk_read(fs->dev, fat_sector, 1, fs->fat_buffer) != 0) {
+        fs->cached_fat_sector = 0xFFFFFFFF; // The buffer may hold part of the failed read
+        return -1;
     }
+    fs->cached_fat_sector = fat_sector;
+    return 0;
 }
 
 static uint32_t get_next_cluster(struct fat32_fs_t *fs, uint32_t current_cluster) {
+    PROF_SCOPE("get_next_cluster");
+    IO_STAT(fs->stats.fat_lookups++);
     uint32_t fat_offset = current_cluster * 4;
     uint32_t fat_sector = fs->fat_start_lba + (fat_offset / 512);
     uint32_t ent_offset = fat_offset % 512;
 
-    if (fs->cached_fat_sector != fat_sector) {
-        if (fs->fat_dirty) {
-            cache_clean(fs->fat_buffer, 512);
-            sd_write_block(fs->cached_fat_sector, fs->fat_buffer);
-            fs->fat_dirty = 0;
-        }
-        if (sd_read_block(fat_sector, fs->fat_buffer) != 0) return FAT_EOF;
-        cache_invalidate(fs->fat_buffer, 512);
-        fs->cached_fat_sector = fat_sector;
-    }
+    if (fat_load(fs, fat_sector) != 0) return FAT_EOF;
     uint32_t *entry = (uint32_t *)&fs->fat_buffer[ent_offset];
     return (*entry) & 0x0FFFFFFF;
 }
 
-static int set_next_cluster(struct fat32_fs_t *fs, uint32_t current_cluster, uint32_t next_cluster) {
+// Update a FAT entry in the cached sector only. It reaches the card when the cache moves on or is flushed
+static int set_fat_entry(struct fat32_fs_t *fs, uint32_t current_cluster, uint32_t next_cluster) {
     uint32_t fat_offset = current_cluster * 4;
     uint32_t fat_sector = fs->fat_start_lba + (fat_offset / 512);
     uint32_t ent_offset = fat_offset % 512;
 
-    if (fs->cached_fat_sector != fat_sector) {
-        if (fs->fat_dirty) {
-            cache_clean(fs->fat_buffer, 512);
-            sd_write_block(fs->cached_fat_sector, fs->fat_buffer);
-        }
-        if (sd_read_block(fat_sector, fs->fat_buffer) != 0) return -1;
-        cache_invalidate(fs->fat_buffer, 512);
-        fs->cached_fat_sector = fat_sector;
-    }
+    if (fat_load(fs, fat_sector) != 0) return -1;
     uint32_t *entry = (uint32_t *)&fs->fat_buffer[ent_offset];
     *entry = (*entry & 0xF0000000) | (next_cluster & 0x0FFFFFFF);
     fs->fat_dirty = 1;
-    cache_clean(fs->fat_buffer, 512);
-    return sd_write_block(fat_sector, fs->fat_buffer);
+    return 0;
+}
+
+static int flush_fat(struct fat32_fs_t *fs) {
+    if (!fs->fat_dirty) return 0;
+    IO_STAT(fs->stats.fat_writebacks++);
+    if (blk_write(fs->dev, fs->cached_fat_sector, 1, fs->fat_buffer) != 0) return -1;
+    fs->fat_dirty = 0;
+    return 0;
+}
+
+static int set_next_cluster(struct fat32_fs_t *fs, uint32_t current_cluster, uint32_t next_cluster) {
+    if (set_fat_entry(fs, current_cluster, next_cluster) != 0) return -1;
+    return flush_fat(fs);
 }
 
 static uint32_t find_free_cluster(struct fat32_fs_t *fs) {
-    for (uint32_t i = 2; i < fs->total_clusters; i++) {
-        if (get_next_cluster(fs, i) == FAT_FREE) return i;
+    PROF_SCOPE("find_free_cluster");
+    IO_STAT(fs->stats.free_scans++);
+    // Scans the cached sector directly: one cache lookup per 128 entries, not per entry.
+    // Everything below free_hint is in use, so the result is still the lowest free cluster
+    uint32_t *entries = (uint32_t *)fs->fat_buffer;
+    for (uint32_t i = fs->free_hint; i < fs->total_clusters + 2; i++) {
+        if (i == fs->free_hint || i % 128 == 0) {
+            IO_STAT(fs->stats.free_scan_sectors++);
+            if (fat_load(fs, fs->fat_start_lba + i / 128) != 0) return 0;
+        }
+        if ((entries[i % 128] & 0x0FFFFFFF) == FAT_FREE) {
+            TRACE_EVENT(TRACE_CLUSTER_ALLOC, i, 0);
+            fs->free_hint = i; // Callers may yet decide not to take it
+            return i;
+        }
     }
     return 0; 
 }
 
+// Clusters are cleared from a zero-filled buffer with multi-block writes
+#define ZERO_BURST_SECTORS 8
+
+static int zero_cluster(struct fat32_fs_t *fs, uint32_t cluster) {
+    uint32_t lba = fat32_cluster_to_lba(fs, cluster);
+    uint32_t left = fs->sectors_per_cluster;
+    IO_STAT(fs->stats.clusters_zeroed++);
+    while (left > 0) {
+        uint32_t n = (left > ZERO_BURST_SECTORS) ? ZERO_BURST_SECTORS : left;
+        if (blk_write(fs->dev, lba, n, fs->zero_burst) != 0) return -1;
+        lba += n; left -= n;
+    }
+    return 0;
+}
+
+// Bulk transfers (defragmenter copies, checksums) share one mount-owned burst buffer
+#define BULK_SECTORS 64
+
+static uint8_t *bulk_buffer(struct fat32_fs_t *fs) {
+    if (!fs->bulk_buf) fs->bulk_buf = arena_alloc_aligned(&fs->arena, BULK_SECTORS * 512, CACHE_LINE_SIZE);
+    return fs->bulk_buf;
+}
+
+static uint32_t entry_cluster(const struct fat32_dir_entry_t *d) {
+    return ((uint32_t)d->cluster_hi << 16) | d->cluster_lo;
+}
+
+// Search a single directory by long or 8.3 name. Returns 0 if found, -2 if not, -1 on I/O error
+static int dir_lookup(struct fat32_fs_t *fs, uint32_t dir_cluster, const struct name_key_t *key,
+                      struct fat32_dir_entry_t *ent, uint32_t *ent_sector, uint32_t *ent_offset) {
+    uint32_t search_cluster = dir_cluster;
+    struct lfn_match_t m = { 0 };
+    int res = -2;
+
+    uint8_t *buffer = pool_alloc(&fs->sectors);
+    if (!buffer) return -1;
+    IO_STAT(fs->stats.dir_lookups++);
+    while (search_cluster >= 2 && search_cluster < FAT_EOF) {
+        uint32_t lba = fat32_cluster_to_lba(fs, search_cluster);
+        for (uint32_t s = 0; s < fs->sectors_per_cluster; s++) {
+            IO_STAT(fs->stats.dir_sectors++);
+            if (blk_read(fs->dev, lba + s, 1, buffer) != 0) { res = -1; goto done; }
+            struct fat32_dir_entry_t *entries = (struct fat32_dir_entry_t *)buffer;
+            for (int i = 0; i < 16; i++) {
+                if (entries[i].name[0] == 0x00) goto done;
+                if (entries[i].name[0] == 0xE5) { m.active = 0; continue; }
+                if (entries[i].attr == ATTR_LFN) {
+                    if (key->has_long) lfn_step(&m, key, (const struct fat32_lfn_entry_t *)&entries[i]);
+                    continue;
+                }
+
+                int hit = 0;
+                if (entries[i].attr & 0x08) {
+                    // Volume label, never a match
+                } else if (m.active && m.expect == 0 && m.checksum == lfn_checksum(entries[i].name)) {
+                    hit = 1;
+                } else if (key->has_short && memcmp(entries[i].name, key->short_name, 11) == 0) {
+                    hit = 1;
+                }
+                m.active = 0;
+
+                if (hit) {
+                    memcpy(ent, &entries[i], sizeof(struct fat32_dir_entry_t));
+                    *ent_sector = lba + s;
+                    *ent_offset = i * 32;
+                    res = 0;
+                    goto done;
+                }
+            }
+        }
+        search_cluster = get_next_cluster(fs, search_cluster);
+    }
+
+done:
+    pool_free(&fs->sectors, buffer);
+    return res;
+}
+
+// Walk every component but the last. Yields the parent directory cluster and the leaf name
+static int walk_parent(struct fat32_fs_t *fs, const char *path, uint32_t *dir_cluster,
+                       const char **leaf, int *leaf_len) {
+    struct name_key_t key;
+    uint32_t curr_cluster = fs->root_cluster;
+    const char *p = path;
+    if (*p == '/') p++;
+
+    while (1) {
+        const char *end = p;
+        while (*end && *end != '/') end++;
+        if (*end == '\0' || end[1] == '\0') {
+            *dir_cluster = curr_cluster;
+            *leaf = p;
+            *leaf_len = end - p;
+            return 0;
+        }
+
+        name_key_init(&key, p, end - p);
+        struct fat32_dir_entry_t ent;
+        uint32_t sector, offset;
+        int res = dir_lookup(fs, curr_cluster, &key, &ent, &sector, &offset);
+        if (res != 0) return res;
+        if (!(ent.attr & 0x10)) return -2; // Not a directory
+
+        curr_cluster = entry_cluster(&ent);
+        if (curr_cluster == 0) curr_cluster = fs->root_cluster; // ".." of a first-level dir
+        p = end + 1;
+    }
+}
+
+static struct fat32_dir_hint_t *dir_hint_get(struct fat32_fs_t *fs, uint32_t dir_cluster) {
+    for (int i = 0; i < FAT32_DIR_HINTS; i++) {
+        if (fs->dir_hints[i].dir_cluster == dir_cluster) return &fs->dir_hints[i];
+    }
+    struct fat32_dir_hint_t *h = &fs->dir_hints[fs->dir_hint_next];
+    fs->dir_hint_next = (fs->dir_hint_next + 1) % FAT32_DIR_HINTS;
+    h->dir_cluster = dir_cluster;
+    h->cluster = dir_cluster;
+    h->slot = 0;
+    h->alias_next = 0;
+    return h;
+}
+
+// Find (or make room for) 'count' consecutive free slots in a directory, resuming from the
+// cached hint. Yields the cluster and in-cluster slot index of the first one.
+static int dir_find_free_run(struct fat32_fs_t *fs, uint32_t dir_cluster, uint32_t count,
+                             uint32_t *run_cluster, uint32_t *run_slot) {
+    struct fat32_dir_hint_t *hint = dir_hint_get(fs, dir_cluster);
+    uint32_t search_cluster = hint->cluster;
+    uint32_t slot = hint->slot;
+    uint32_t slots_per_cluster = fs->sectors_per_cluster * 16;
+    uint32_t run_len = 0;
+    uint32_t first_cluster = 0, first_slot = 0;
+    int res = -3;
+
+    uint8_t *buffer = pool_alloc(&fs->sectors);
+    if (!buffer) return -1;
+    while (search_cluster >= 2 && search_cluster < FAT_EOF) {
+        uint32_t lba = fat32_cluster_to_lba(fs, search_cluster);
+        uint32_t loaded = 0xFFFFFFFF;
+
+        for (; slot < slots_per_cluster; slot++) {
+            if (slot / 16 != loaded) {
+                loaded = slot / 16;
+                if (blk_read(fs->dev, lba + loaded, 1, buffer) != 0) { res = -1; goto done; }
+            }
+            struct fat32_dir_entry_t *e = (struct fat32_dir_entry_t *)buffer + (slot % 16);
+            if (e->name[0] != 0x00 && e->name[0] != 0xE5) {
+                run_len = 0;
+                continue;
+            }
+            if (first_cluster == 0) { first_cluster = search_cluster; first_slot = slot; }
+            if (run_len++ == 0) { *run_cluster = search_cluster; *run_slot = slot; }
+            if (run_len == count) goto run_found;
+        }
+        slot = 0;
+
+        // Extend Directory if needed
+        uint32_t next = get_next_cluster(fs, search_cluster);
+        if (next >= FAT_EOF) {
+            uint32_t new_c = find_free_cluster(fs);
+            if (new_c == 0) { res = -2; goto done; } // Full
+            set_next_cluster(fs, search_cluster, new_c);
+            set_next_cluster(fs, new_c, FAT_EOF);
+            if (zero_cluster(fs, new_c) != 0) { res = -1; goto done; }
+            search_cluster = new_c;
+        } else {
+            search_cluster = next;
+        }
+    }
+    goto done;
+
+run_found:
+    // A free gap too short for this run stays hinted for the next caller
+    if (first_cluster == *run_cluster && first_slot == *run_slot) {
+        hint->cluster = search_cluster;
+        hint->slot = slot + 1;
+    } else {
+        hint->cluster = first_cluster;
+        hint->slot = first_slot;
+    }
+    res = 0;
+
+done:
+    pool_free(&fs->sectors, buffer);
+    return res;
+}
+
+// Store 'count' entries starting at a slot found by dir_find_free_run. Reports where the last one went
+static int dir_write_run(struct fat32_fs_t *fs, uint32_t cluster, uint32_t slot,
+                         const struct fat32_dir_entry_t *ents, uint32_t count,
+                         uint32_t *ent_sector, uint32_t *ent_offset) {
+    uint32_t slots_per_cluster = fs->sectors_per_cluster * 16;
+    uint32_t loaded = 0;
+    int res = 0;
+
+    uint8_t *buffer = pool_alloc(&fs->sectors);
+    if (!buffer) return -1;
+    for (uint32_t k = 0; k < count; k++, slot++) {
+        if (slot == slots_per_cluster) {
+            cluster = get_next_cluster(fs, cluster);
+            slot = 0;
+        }
+        uint32_t lba = fat32_cluster_to_lba(fs, cluster) + slot / 16;
+        if (lba != loaded) {
+            if (loaded != 0) {
+                if (blk_write(fs->dev, loaded, 1, buffer) != 0) { res = -4; goto done; }
+            }
+            if (blk_read(fs->dev, lba, 1, buffer) != 0) { res = -1; goto done; }
+            loaded = lba;
+        }
+        memcpy(buffer + (slot % 16) * 32, &ents[k], 32);
+        *ent_sector = lba;
+        *ent_offset = (slot % 16) * 32;
+    }
+    if (blk_write(fs->dev, loaded, 1, buffer) != 0) res = -4;
+
+done:
+    pool_free(&fs->sectors, buffer);
+    return res;
+}
+
+#define ALIAS_MAX 999999  // Tails up to six digits, with at least one base character left
+
+// The N of a BASE~N short name, 0 for any other name
+static uint32_t alias_tail(const uint8_t *name) {
+    int end = 8, k;
+    uint32_t n = 0, scale = 1;
+    while (end > 0 && name[end - 1] == ' ') end--;
+    for (k = end; k > 0 && name[k - 1] >= '0' && name[k - 1] <= '9'; k--) {
+        n += (uint32_t)(name[k - 1] - '0') * scale;
+        scale *= 10;
+    }
+    if (k == end || k < 2 || name[k - 1] != '~') return 0;
+    return n;
+}
+
+// Highest ~N tail among a directory's short names, whatever their base
+static int alias_scan(struct fat32_fs_t *fs, uint32_t dir_cluster, uint32_t *max) {
+    uint32_t search_cluster = dir_cluster;
+    int res = 0;
+
+    *max = 0;
+    uint8_t *buffer = pool_alloc(&fs->sectors);
+    if (!buffer) return -1;
+    while (search_cluster >= 2 && search_cluster < FAT_EOF) {
+        uint32_t lba = fat32_cluster_to_lba(fs, search_cluster);
+        for (uint32_t s = 0; s < fs->sectors_per_cluster; s++) {
+            if (blk_read(fs->dev, lba + s, 1, buffer) != 0) { res = -1; goto done; }
+            struct fat32_dir_entry_t *entries = (struct fat32_dir_entry_t *)buffer;
+            for (int i = 0; i < 16; i++) {
+                if (entries[i].name[0] == 0x00) goto done;
+                if (entries[i].name[0] == 0xE5 || entries[i].attr == ATTR_LFN) continue;
+                uint32_t n = alias_tail(entries[i].name);
+                if (n > *max) *max = n;
+            }
+        }
+        search_cluster = get_next_cluster(fs, search_cluster);
+    }
+
+done:
+    pool_free(&fs->sectors, buffer);
+    return res;
+}
+
+// Derive a unique 8.3 alias for a long name: BASE~N.EXT, with N from the directory's hint.
+// Every N handed out is above all tails on disk, so only the first alias in a directory
+// (or the first after its hint was recycled) reads the directory to find them
+static int make_short_alias(struct fat32_fs_t *fs, uint32_t dir_cluster, const char *name, int len, char *dest) {
+    char base[6], ext[3], digits[7];
+    int base_len = 0, ext_len = 0, nd = 0;
+    int dot = -1, in_ext = 0;
+
+    for (int i = 0; i < len; i++) {
+        if (name[i] == '.' && i > 0) dot = i;
+    }
+    for (int i = 0; i < len; i++) {
+        char c = name[i];
+        if (i == dot) { in_ext = 1; continue; }
+        if (c == '.' || c == ' ') continue;
+        if (c >= 'a' && c <= 'z') c -= 32;
+        if (!short_char_ok(c)) c = '_';
+        if (in_ext) { if (ext_len < 3) ext[ext_len++] = c; }
+        else if (base_len < 6) base[base_len++] = c;
+    }
+    if (base_len == 0) base[base_len++] = '_';
+
+    struct fat32_dir_hint_t *hint = dir_hint_get(fs, dir_cluster);
+    if (hint->alias_next == 0) {
+        uint32_t max;
+        if (alias_scan(fs, dir_cluster, &max) != 0) return -1;
+        hint->alias_next = max + 1;
+    }
+    if (hint->alias_next > ALIAS_MAX) return -5;
+    for (uint32_t n = hint->alias_next++; n; n /= 10) digits[nd++] = (char)('0' + n % 10);
+
+    // The base gives way to longer tails, so the whole alias stays within 8 characters
+    int k = (base_len < 7 - nd) ? base_len : 7 - nd;
+    memset(dest, ' ', 11);
+    memcpy(dest, base, k);
+    dest[k++] = '~';
+    while (nd > 0) dest[k++] = digits[--nd];
+    memcpy(dest + 8, ext, ext_len);
+    return 0;
+}
+
+// Resolve the parent of 'path', claim free slots there and write a fresh entry, preceded by
+// an LFN chain when the name is not a plain upper-case 8.3 name
+static int dir_add_entry(struct fat32_fs_t *fs, const char *path, uint8_t attr, uint32_t cluster,
+                         uint32_t *parent_cluster, uint32_t *ent_sector, uint32_t *ent_offset) {
+    uint32_t dir_cluster;
+    const char *leaf;
+    int leaf_len;
+    char short_name[11];
+    struct fat32_dir_entry_t ents[FAT32_LFN_MAX / LFN_CHARS + 2];
+
+    int res = walk_parent(fs, path, &dir_cluster, &leaf, &leaf_len);
+    if (res != 0) return res;
+    if (leaf_len == 0 || leaf_len > FAT32_LFN_MAX) return -3;
+
+    uint32_t parts = 0;
+    int fit = format_83_name(leaf, leaf_len, short_name);
+    if (fit != 1) {
+        // Lower-case 8.3 names keep their upper-cased form as alias, anything else gets ~N
+        if (fit == 0) {
+            res = make_short_alias(fs, dir_cluster, leaf, leaf_len, short_name);
+            if (res != 0) return res;
+        }
+        parts = (leaf_len + LFN_CHARS - 1) / LFN_CHARS;
+        uint8_t sum = lfn_checksum((const uint8_t *)short_name);
+
+        for (uint32_t k = 0; k < parts; k++) {
+            uint32_t ord = parts - k; // Last part is stored first
+            struct fat32_lfn_entry_t *l = (struct fat32_lfn_entry_t *)&ents[k];
+            l->ord = (uint8_t)(ord | ((k == 0) ? 0x40 : 0));
+            l->attr = ATTR_LFN;
+            l->type = 0;
+            l->checksum = sum;
+            l->cluster_lo = 0;
+            for (int j = 0; j < LFN_CHARS; j++) {
+                int pos = (ord - 1) * LFN_CHARS + j;
+                uint16_t c = (pos < leaf_len) ? (uint8_t)leaf[pos] : ((pos == leaf_len) ? 0x0000 : 0xFFFF);
+                lfn_set_char(l, j, c);
+            }
+        }
+    }
+
+    struct fat32_dir_entry_t *d = &ents[parts];
+    memset(d, 0, 32);
+    memcpy(d->name, short_name, 11);
+    d->attr = attr;
+    d->cluster_hi = (uint16_t)(cluster >> 16);
+    d->cluster_lo = (uint16_t)(cluster & 0xFFFF);
+
+    uint32_t run_cluster, run_slot;
+    res = dir_find_free_run(fs, dir_cluster, parts + 1, &run_cluster, &run_slot);
+    if (res != 0) return res;
+    res = dir_write_run(fs, run_cluster, run_slot, ents, parts + 1, ent_sector, ent_offset);
+    if (res != 0) return res;
+
+    *parent_cluster = dir_cluster;
+    return 0;
+}
+
 // --- Public API ---
 
 uint32_t fat32_cluster_to_lba(struct fat32_fs_t *fs, uint32_t cluster) {
@@ -83,15 +619,15 @@ uint32_t fat32_cluster_to_lba(struct fat32_fs_t *fs, uint32_t cluster) {
     return fs->data_start_lba + ((cluster - 2) * fs->sectors_per_cluster);
 }
 
-int fat32_mount(struct fat32_fs_t *fs) {
-    uint8_t buffer[512] __attribute__((aligned(32)));
+// Geometry from the boot sector, behind an MBR or at sector 0
+static int read_bpb(struct fat32_fs_t *fs, uint8_t *buffer) {
     uint32_t partition_lba = 0;
 
     // 1. Read Sector 0
-    if (sd_read_block(0, buffer) != 0) return -1;
-    cache_invalidate(buffer, 512);
+    if (blk_read(fs->dev, 0, 1, buffer) != 0) return -1;
 
     struct fat32_bootsector_t *bpb = (struct fat32_bootsector_t *)buffer;
+    if (memcmp(bpb->oem_name, "EXFAT   ", 8) == 0) return -5; // Use exfat_mount
 
     // 2. MBR Check
     if (bpb->bytes_per_sector != 512) {
@@ -99,9 +635,9 @@ int fat32_mount(struct fat32_fs_t *fs) {
         memcpy(&partition_lba, &part->lba_start, 4);
         if (partition_lba == 0) return -2;
 
-        if (sd_read_block(partition_lba, buffer) != 0) return -3;
-        cache_invalidate(buffer, 512);
+        if (blk_read(fs->dev, partition_lba, 1, buffer) != 0) return -3;
         bpb = (struct fat32_bootsector_t *)buffer;
+        if (memcmp(bpb->oem_name, "EXFAT   ", 8) == 0) return -5;
         if (bpb->bytes_per_sector != 512) return -4;
     }
 
@@ -112,160 +648,94 @@ int fat32_mount(struct fat32_fs_t *fs) {
     uint32_t root_dir_lba = fs->fat_start_lba + (bpb->num_fats * fs->fat_size_sectors);
     fs->data_start_lba = root_dir_lba;
     fs->root_cluster = bpb->root_cluster;
-    fs->total_clusters = bpb->total_sectors_32 / bpb->sectors_per_cluster;
+    fs->total_clusters = (bpb->total_sectors_32 - (root_dir_lba - partition_lba)) / bpb->sectors_per_cluster;
     fs->cached_fat_sector = 0xFFFFFFFF;
     fs->fat_dirty = 0;
+    fs->free_hint = 2;
+    memset(fs->dir_hints, 0, sizeof(fs->dir_hints));
+    fs->dir_hint_next = 0;
     return 0;
 }
 
-int fat32_open(struct fat32_fs_t *fs, const char *path, struct fat32_file_t *out) {
-    char target_name[11];
-    uint32_t curr_cluster = fs->root_cluster;
-    const char *p = path;
-    if (*p == '/') p++;
+// A mounted fs is refused (-7): its arena and pool would be lost. Unmount it first
+int fat32_mount(struct fat32_fs_t *fs, struct blkdev_t *dev) {
+    if (fs->mounted == FAT32_MOUNTED) return -7;
+    fs->dev = dev;
+    IO_STAT(fat32_stats_reset(fs));
+    IO_OP(fs, FAT32_OP_MOUNT);
 
-    while (*p) {
-        const char *end = p;
-        while (*end && *end != '/') end++;
-        int len = end - p;
-        
-        format_83_name(p, len, target_name);
-        
-        uint32_t search_cluster = curr_cluster;
-        int found = 0;
-        struct fat32_dir_entry_t found_entry;
-        uint32_t found_dir_sector = 0;
-        uint32_t found_dir_offset = 0;
-
-        while (search_cluster >= 2 && search_cluster < FAT_EOF) {
-            uint32_t lba = fat32_cluster_to_lba(fs, search_cluster);
-            uint8_t buffer[512] __attribute__((aligned(32)));
-
-            for (uint32_t s = 0; s < fs->sectors_per_cluster; s++) {
-                if (sd_read_block(lba + s, buffer) != 0) return -1;
-                cache_invalidate(buffer, 512);
-                struct fat32_dir_entry_t *entries = (struct fat32_dir_entry_t *)buffer;
-                for (int i = 0; i < 16; i++) {
-                    if (entries[i].name[0] == 0x00) goto chain_end;
-                    if (entries[i].name[0] == 0xE5) continue;
-                    if (memcmp(entries[i].name, target_name, 11) == 0) {
-                        found = 1;
-                        memcpy(&found_entry, &entries[i], sizeof(struct fat32_dir_entry_t));
-                        found_dir_sector = lba + s;
-                        found_dir_offset = i * 32;
-                        goto entry_found;
-                    }
-                }
-            }
-            search_cluster = get_next_cluster(fs, search_cluster);
-        }
-chain_end:
-        if (!found) return -2;
-
-entry_found:
-        curr_cluster = (found_entry.cluster_hi << 16) | found_entry.cluster_lo;
-        p = end;
-        if (*p == '/') p++;
-        if (*p == '\0') {
-            out->start_cluster = curr_cluster;
-            out->current_cluster = curr_cluster;
-            out->size = found_entry.size;
-            out->position = 0;
-            out->dir_sector = found_dir_sector;
-            out->dir_offset = found_dir_offset;
-            return 0;
-        }
+    // Everything that lives as long as the mount comes from its arena and sector pool
+    arena_init(&fs->arena, FAT32_ARENA_BLOCK);
+    fs->bulk_buf = 0;
+    fs->zero_burst = arena_alloc_aligned(&fs->arena, ZERO_BURST_SECTORS * 512, CACHE_LINE_SIZE);
+    if (!fs->zero_burst) return -6;
+    memset(fs->zero_burst, 0, ZERO_BURST_SECTORS * 512);
+    if (pool_init(&fs->sectors, 512, FAT32_SCRATCH_SECTORS) != 0) {
+        arena_reset(&fs->arena);
+        return -6;
     }
-    return -3;
+
+    uint8_t *buffer = pool_alloc(&fs->sectors);
+    int res = read_bpb(fs, buffer);
+    pool_free(&fs->sectors, buffer);
+    if (res != 0) {
+        pool_destroy(&fs->sectors);
+        arena_reset(&fs->arena);
+        return res;
+    }
+    fs->mounted = FAT32_MOUNTED;
+    return 0;
 }
 
-// Create a file (simple implementation: assumes path contains existing parent dirs)
-int fat32_create(struct fat32_fs_t *fs, const char *path, struct fat32_file_t *out) {
-    char target_name[11];
-    uint32_t parent_cluster = fs->root_cluster;
-    
-    // Parse Path - Find Parent Dir
-    const char *p = path;
-    const char *last_slash = NULL;
-    
-    if (*p == '/') p++;
-    
-    // Walk to find last component
-    const char *temp = p;
-    while (*temp) {
-        if (*temp == '/') last_slash = temp;
-        temp++;
-    }
-
-    // If path has subdirs, we need to navigate there first (Omitted for brevity, assuming Root)
-    // To properly support "DIR/FILE.TXT", we would reuse the logic in fat32_open
-    // For now, we assume creation in the implied root/current context or handle simple parsing.
-    
-    // Simple: Extract Filename
-    const char *filename_start = (last_slash) ? last_slash + 1 : p;
-    format_83_name(filename_start, 0xFF, target_name); // 0xFF uses string length
-    
-    // Find Free Entry in Parent Cluster
-    uint32_t search_cluster = parent_cluster;
-    uint32_t free_sector = 0;
-    uint32_t free_offset = 0;
-    int found_slot = 0;
+// Write back the FAT cache and hand the mount's memory back in one go. Close files first
+int fat32_unmount(struct fat32_fs_t *fs) {
+    int res = flush_fat(fs);
+    if (res == 0) res = blk_flush(fs->dev);
+    pool_destroy(&fs->sectors);
+    arena_reset(&fs->arena);
+    fs->zero_burst = 0;
+    fs->bulk_buf = 0;
+    fs->mounted = 0;
+    return res;
+}
 
-    while (search_cluster >= 2 && search_cluster < FAT_EOF) {
-        uint32_t lba = fat32_cluster_to_lba(fs, search_cluster);
-        uint8_t buffer[512] __attribute__((aligned(32)));
+int fat32_open(struct fat32_fs_t *fs, const char *path, struct fat32_file_t *out) {
+    IO_OP(fs, FAT32_OP_OPEN);
+    struct name_key_t key;
+    uint32_t dir_cluster;
+    const char *leaf;
+    int leaf_len;
 
-        for (uint32_t s = 0; s < fs->sectors_per_cluster; s++) {
-            if (sd_read_block(lba + s, buffer) != 0) return -1;
-            cache_invalidate(buffer, 512);
+    int res = walk_parent(fs, path, &dir_cluster, &leaf, &leaf_len);
+    if (res != 0) return res;
+    if (leaf_len == 0) return -3;
+    name_key_init(&key, leaf, leaf_len);
 
-            struct fat32_dir_entry_t *entries = (struct fat32_dir_entry_t *)buffer;
-            for (int i = 0; i < 16; i++) {
-                if (entries[i].name[0] == 0x00 || entries[i].name[0] == 0xE5) {
-                    free_sector = lba + s;
-                    free_offset = i * 32;
-                    found_slot = 1;
-                    goto slot_found;
-                }
-            }
-        }
-        
-        // Extend Directory if needed
-        uint32_t next = get_next_cluster(fs, search_cluster);
-        if (next >= FAT_EOF) {
-            uint32_t new_c = find_free_cluster(fs);
-            if (new_c == 0) return -2; // Full
-            set_next_cluster(fs, search_cluster, new_c);
-            set_next_cluster(fs, new_c, FAT_EOF);
-            
-            // Clear new cluster
-            uint8_t zero[512] __attribute__((aligned(32)));
-            memset(zero, 0, 512);
-            cache_clean(zero, 512);
-            uint32_t lba_n = fat32_cluster_to_lba(fs, new_c);
-            for(uint32_t k=0; k<fs->sectors_per_cluster; k++) sd_write_block(lba_n+k, zero);
-            
-            search_cluster = new_c;
-        } else {
-            search_cluster = next;
-        }
-    }
+    struct fat32_dir_entry_t found_entry;
+    uint32_t found_dir_sector, found_dir_offset;
+    res = dir_lookup(fs, dir_cluster, &key, &found_entry, &found_dir_sector, &found_dir_offset);
+    if (res != 0) return res;
 
-slot_found:
-    if (!found_slot) return -3;
+    uint32_t cluster = entry_cluster(&found_entry);
+    out->start_cluster = cluster;
+    out->current_cluster = cluster;
+    out->size = found_entry.size;
+    out->position = 0;
+    out->dir_sector = found_dir_sector;
+    out->dir_offset = found_dir_offset;
+    out->flags = 0;
+    out->log_buf = 0;
+    out->aio_pending = 0;
+    return 0;
+}
 
-    // Create Entry
-    uint8_t sector_buf[512] __attribute__((aligned(32)));
-    if (sd_read_block(free_sector, sector_buf) != 0) return -4;
-    cache_invalidate(sector_buf, 512);
+// Create a file in an existing directory (does not check for an existing entry of the same name)
+int fat32_create(struct fat32_fs_t *fs, const char *path, struct fat32_file_t *out) {
+    IO_OP(fs, FAT32_OP_CREATE);
+    uint32_t parent_cluster, free_sector, free_offset;
 
-    struct fat32_dir_entry_t *d = (struct fat32_dir_entry_t *)(sector_buf + free_offset);
-    memset(d, 0, 32);
-    memcpy(d->name, target_name, 11);
-    d->attr = 0x20; // Archive
-    
-    cache_clean(sector_buf, 512);
-    sd_write_block(free_sector, sector_buf);
+    int res = dir_add_entry(fs, path, 0x20, 0, &parent_cluster, &free_sector, &free_offset); // Archive
+    if (res != 0) return res;
 
     out->start_cluster = 0;
     out->current_cluster = 0;
@@ -273,19 +743,114 @@ slot_found:
     out->position = 0;
     out->dir_sector = free_sector;
     out->dir_offset = free_offset;
+    out->flags = 0;
+    out->log_buf = 0;
+    out->aio_pending = 0;
 
     return 0;
 }
 
+// Create a directory with its "." and ".." entries (parent dirs must already exist)
+int fat32_mkdir(struct fat32_fs_t *fs, const char *path) {
+    IO_OP(fs, FAT32_OP_MKDIR);
+    uint32_t parent_cluster, ent_sector, ent_offset;
+
+    uint32_t new_c = find_free_cluster(fs);
+    if (new_c == 0) return -2; // Full
+    if (set_next_cluster(fs, new_c, FAT_EOF) != 0) return -1;
+    if (zero_cluster(fs, new_c) != 0) return -1;
+
+    int res = dir_add_entry(fs, path, 0x10, new_c, &parent_cluster, &ent_sector, &ent_offset);
+    if (res != 0) {
+        set_next_cluster(fs, new_c, FAT_FREE);
+        if (new_c < fs->free_hint) fs->free_hint = new_c;
+        return res;
+    }
+
+    // ".." points at cluster 0 when the parent is the root directory
+    if (parent_cluster == fs->root_cluster) parent_cluster = 0;
+
+    uint8_t *sector_buf = pool_alloc(&fs->sectors);
+    if (!sector_buf) return -1;
+    memset(sector_buf, 0, 512);
+    struct fat32_dir_entry_t *d = (struct fat32_dir_entry_t *)sector_buf;
+    memset(d[0].name, ' ', 11);
+    d[0].name[0] = '.';
+    d[0].attr = 0x10;
+    d[0].cluster_hi = (uint16_t)(new_c >> 16);
+    d[0].cluster_lo = (uint16_t)(new_c & 0xFFFF);
+    memset(d[1].name, ' ', 11);
+    d[1].name[0] = '.';
+    d[1].name[1] = '.';
+    d[1].attr = 0x10;
+    d[1].cluster_hi = (uint16_t)(parent_cluster >> 16);
+    d[1].cluster_lo = (uint16_t)(parent_cluster & 0xFFFF);
+
+    res = blk_write(fs->dev, fat32_cluster_to_lba(fs, new_c), 1, sector_buf);
+    pool_free(&fs->sectors, sector_buf);
+    return (res != 0) ? -4 : 0;
+}
+
+// Visit every entry of a directory ("" or "/" is the root). Returns the entry count
+int fat32_listdir(struct fat32_fs_t *fs, const char *path, fat32_dir_cb cb, void *ctx) {
+    IO_OP(fs, FAT32_OP_LISTDIR);
+    uint32_t dir_cluster;
+    const char *leaf;
+    int leaf_len;
+
+    int res = walk_parent(fs, path, &dir_cluster, &leaf, &leaf_len);
+    if (res != 0) return res;
+    if (leaf_len > 0) {
+        struct name_key_t key;
+        struct fat32_dir_entry_t ent;
+        uint32_t sector, offset;
+        name_key_init(&key, leaf, leaf_len);
+        res = dir_lookup(fs, dir_cluster, &key, &ent, &sector, &offset);
+        if (res != 0) return res;
+        if (!(ent.attr & 0x10)) return -3; // Not a directory
+        dir_cluster = entry_cluster(&ent);
+        if (dir_cluster == 0) dir_cluster = fs->root_cluster;
+    }
+
+    int count = 0;
+    uint8_t *buffer = pool_alloc(&fs->sectors);
+    if (!buffer) return -1;
+    while (dir_cluster >= 2 && dir_cluster < FAT_EOF) {
+        uint32_t lba = fat32_cluster_to_lba(fs, dir_cluster);
+        for (uint32_t s = 0; s < fs->sectors_per_cluster; s++) {
+            if (blk_read(fs->dev, lba + s, 1, buffer) != 0) { count = -1; goto done; }
+            struct fat32_dir_entry_t *entries = (struct fat32_dir_entry_t *)buffer;
+            for (int i = 0; i < 16; i++) {
+                if (entries[i].name[0] == 0x00) goto done;
+                if (entries[i].name[0] == 0xE5 || entries[i].attr == ATTR_LFN || (entries[i].attr & 0x08)) continue;
+                if (cb) cb(ctx, &entries[i]);
+                count++;
+            }
+        }
+        dir_cluster = get_next_cluster(fs, dir_cluster);
+    }
+
+done:
+    pool_free(&fs->sectors, buffer);
+    return count;
+}
+
 int fat32_read(struct fat32_fs_t *fs, struct fat32_file_t *file, void *buf, uint32_t size) {
+    IO_OP(fs, FAT32_OP_READ);
     if (file->position >= file->size) return 0;
     if (file->position + size > file->size) size = file->size - file->position;
 
     uint8_t *ptr = (uint8_t *)buf;
     uint32_t bytes_read = 0;
-    uint8_t scratch[512] __attribute__((aligned(32)));
+    uint8_t *scratch = pool_alloc(&fs->sectors);
+    if (!scratch) return -1;
 
     while (size > 0) {
+        // current_cluster holds the byte before position, step over cluster boundaries lazily
+        if (file->position > 0 && file->position % fs->bytes_per_cluster == 0) {
+            file->current_cluster = get_next_cluster(fs, file->current_cluster);
+        }
+
         uint32_t cluster_offset = file->position % fs->bytes_per_cluster;
         uint32_t sector_idx = cluster_offset / 512;
         uint32_t byte_idx = cluster_offset % 512;
@@ -294,56 +859,152 @@ int fat32_read(struct fat32_fs_t *fs, struct fat32_file_t *file, void *buf, uint
         int is_aligned = (((uintptr_t)ptr & 0x3) == 0); 
 
         if (byte_idx == 0 && size >= 512 && is_aligned) {
-            if (sd_read_block(lba, ptr) != 0) break;
-            cache_invalidate(ptr, 512);
+            if (blk_read(fs->dev, lba, 1, ptr) != 0) break;
             ptr += 512; size -= 512; file->position += 512; bytes_read += 512;
         } else {
-            if (sd_read_block(lba, scratch) != 0) break;
-            cache_invalidate(scratch, 512);
+            if (blk_read(fs->dev, lba, 1, scratch) != 0) break;
             uint32_t chunk = 512 - byte_idx;
             if (chunk > size) chunk = size;
             memcpy(ptr, scratch + byte_idx, chunk);
             ptr += chunk; size -= chunk; file->position += chunk; bytes_read += chunk;
         }
+    }
+    pool_free(&fs->sectors, scratch);
+    return bytes_read;
+}
 
-        if (file->position % fs->bytes_per_cluster == 0 && file->position < file->size) {
-            file->current_cluster = get_next_cluster(fs, file->current_cluster);
+// Rewrite the handle's dirent with its current start cluster and size
+static int write_dirent(struct fat32_fs_t *fs, struct fat32_file_t *file) {
+    uint8_t *scratch = pool_alloc(&fs->sectors);
+    if (!scratch) return -1;
+    int res = -1;
+    if (blk_read(fs->dev, file->dir_sector, 1, scratch) == 0) {
+        struct fat32_dir_entry_t *d = (struct fat32_dir_entry_t *)(scratch + file->dir_offset);
+        d->cluster_hi = (uint16_t)(file->start_cluster >> 16);
+        d->cluster_lo = (uint16_t)(file->start_cluster & 0xFFFF);
+        d->size = file->size;
+        res = blk_write(fs->dev, file->dir_sector, 1, scratch);
+    }
+    pool_free(&fs->sectors, scratch);
+    return res;
+}
+
+// Write out the log buffer. Whole sectors leave the buffer; with 'all' set the partial
+// tail sector is written as well (zero padded) but kept, so the next flush overwrites
+// it instead of reading it back. The dirent only ever covers data that is on the card
+static int log_flush(struct fat32_fs_t *fs, struct fat32_file_t *file, int all) {
+    uint32_t bpc = fs->bytes_per_cluster;
+    uint32_t full = file->log_fill & ~511u;
+    uint32_t len = all ? ((file->log_fill + 511) & ~511u) : full;
+    uint32_t end = file->log_start + (all ? file->log_fill : full);
+    if (len == 0 || end == file->size) return 0;
+    if (len > file->log_fill) memset(file->log_buf + file->log_fill, 0, len - file->log_fill);
+
+    uint32_t off = file->log_start;
+    uint32_t cluster = file->log_cluster;
+    uint32_t last = cluster;
+    const uint8_t *src = file->log_buf;
+    uint32_t left = len;
+
+    while (left > 0) {
+        if (cluster == 0) {
+            cluster = find_free_cluster(fs);
+            if (cluster == 0) return -1;
+            if (set_fat_entry(fs, cluster, FAT_EOF) != 0) return -1;
+            if (file->log_tail != 0) {
+                if (set_fat_entry(fs, file->log_tail, cluster) != 0) return -1;
+            } else {
+                file->start_cluster = cluster;
+                file->current_cluster = cluster;
+            }
+            file->log_tail = cluster;
+        }
+
+        uint32_t in_cluster = off % bpc;
+        uint32_t n = bpc - in_cluster;
+        if (n > left) n = left;
+        if (blk_write(fs->dev, fat32_cluster_to_lba(fs, cluster) + in_cluster / 512, n / 512, src) != 0) return -1;
+        last = cluster;
+        off += n; src += n; left -= n;
+
+        if (off % bpc == 0) {
+            cluster = (cluster == file->log_tail) ? 0 : get_next_cluster(fs, cluster);
         }
     }
-    return bytes_read;
+    if (flush_fat(fs) != 0) return -1;
+
+    file->size = end;
+    if (write_dirent(fs, file) != 0) return -1;
+
+    if (full > 0) {
+        memcpy(file->log_buf, file->log_buf + full, file->log_fill - full); // Tail < 512 <= full, no overlap
+        file->log_start += full;
+        file->log_fill -= full;
+    }
+    file->log_cluster = (len > full) ? last : cluster;
+    file->log_writes = 0;
+    return 0;
+}
+
+static int log_write(struct fat32_fs_t *fs, struct fat32_file_t *file, const uint8_t *ptr, uint32_t size) {
+    uint32_t done = 0;
+    while (done < size) {
+        uint32_t n = fs->bytes_per_cluster - file->log_fill;
+        if (n > size - done) n = size - done;
+        memcpy(file->log_buf + file->log_fill, ptr + done, n);
+        file->log_fill += n;
+        done += n;
+        if (file->log_fill == fs->bytes_per_cluster) {
+            if (log_flush(fs, file, 0) != 0) return -1;
+        }
+    }
+    file->position = file->log_start + file->log_fill;
+    file->log_writes++;
+
+    if (file->log_interval != 0 && file->log_writes >= file->log_interval) {
+        if (log_flush(fs, file, 1) != 0) return -1;
+    } else if (file->log_fill >= file->log_threshold) {
+        if (log_flush(fs, file, 0) != 0) return -1;
+    }
+    return done;
 }
 
 int fat32_write(struct fat32_fs_t *fs, struct fat32_file_t *file, const void *buf, uint32_t size) {
+    IO_OP(fs, FAT32_OP_WRITE);
     if (file->dir_sector == 0) return -9; // Safety: Invalid file handle
+    if (file->flags & FAT32_FILE_LOG) return log_write(fs, file, (const uint8_t *)buf, size);
 
     const uint8_t *ptr = (const uint8_t *)buf;
     uint32_t bytes_written = 0;
-    uint8_t scratch[512] __attribute__((aligned(32)));
+    int res = -1;
+    uint8_t *scratch = pool_alloc(&fs->sectors);
+    if (!scratch) return -1;
 
     while (size > 0) {
         if (file->start_cluster == 0) {
             uint32_t new_c = find_free_cluster(fs);
-            if (new_c == 0) return -1;
+            if (new_c == 0) goto done;
             
             set_next_cluster(fs, new_c, FAT_EOF);
-            
-            memset(scratch, 0, 512);
-            cache_clean(scratch, 512);
-            uint32_t lba = fat32_cluster_to_lba(fs, new_c);
-            for(uint32_t i=0; i<fs->sectors_per_cluster; i++) sd_write_block(lba + i, scratch);
+            zero_cluster(fs, new_c);
 
             file->start_cluster = new_c;
             file->current_cluster = new_c;
             
             // Update directory entry immediately with new start cluster
-            if (sd_read_block(file->dir_sector, scratch) == 0) {
-                cache_invalidate(scratch, 512);
-                struct fat32_dir_entry_t *d = (struct fat32_dir_entry_t *)(scratch + file->dir_offset);
-                d->cluster_hi = (uint16_t)(new_c >> 16);
-                d->cluster_lo = (uint16_t)(new_c & 0xFFFF);
-                cache_clean(scratch, 512);
-                sd_write_block(file->dir_sector, scratch);
+            write_dirent(fs, file);
+        } else if (file->position > 0 && file->position % fs->bytes_per_cluster == 0) {
+            // Step from the cluster holding the previous byte into the next one, growing the chain
+            uint32_t next = get_next_cluster(fs, file->current_cluster);
+            if (next >= FAT_EOF) {
+                uint32_t new_c = find_free_cluster(fs);
+                if (new_c == 0) goto done;
+                set_next_cluster(fs, file->current_cluster, new_c);
+                set_next_cluster(fs, new_c, FAT_EOF);
+                zero_cluster(fs, new_c);
+                next = new_c;
             }
+            file->current_cluster = next;
         }
 
         uint32_t cluster_offset = file->position % fs->bytes_per_cluster;
@@ -352,68 +1013,584 @@ int fat32_write(struct fat32_fs_t *fs, struct fat32_file_t *file, const void *bu
         uint32_t lba = fat32_cluster_to_lba(fs, file->current_cluster) + sector_idx;
 
         if (byte_idx != 0 || size < 512) {
-            sd_read_block(lba, scratch);
-            cache_invalidate(scratch, 512);
+            blk_read(fs->dev, lba, 1, scratch);
             uint32_t chunk = 512 - byte_idx;
             if (chunk > size) chunk = size;
             memcpy(scratch + byte_idx, ptr, chunk);
-            cache_clean(scratch, 512);
-            sd_write_block(lba, scratch);
+            blk_write(fs->dev, lba, 1, scratch);
             ptr += chunk; size -= chunk; file->position += chunk; bytes_written += chunk;
+        } else if (((uintptr_t)ptr & 0x3) == 0) {
+            // Whole sectors straight from the caller's buffer, up to the end of the cluster
+            uint32_t count = size / 512;
+            if (count > fs->sectors_per_cluster - sector_idx) count = fs->sectors_per_cluster - sector_idx;
+            if (blk_write(fs->dev, lba, count, ptr) != 0) break;
+            ptr += count * 512; size -= count * 512; file->position += count * 512; bytes_written += count * 512;
         } else {
             memcpy(scratch, ptr, 512);
-            cache_clean(scratch, 512);
-            sd_write_block(lba, scratch);
+            blk_write(fs->dev, lba, 1, scratch);
             ptr += 512; size -= 512; file->position += 512; bytes_written += 512;
         }
-
-        if (file->position % fs->bytes_per_cluster == 0 && size > 0) {
-            uint32_t next = get_next_cluster(fs, file->current_cluster);
-            if (next >= FAT_EOF) {
-                uint32_t new_c = find_free_cluster(fs);
-                if (new_c == 0) return -1;
-                set_next_cluster(fs, file->current_cluster, new_c);
-                set_next_cluster(fs, new_c, FAT_EOF);
-                file->current_cluster = new_c;
-                memset(scratch, 0, 512);
-                cache_clean(scratch, 512);
-                uint32_t lba_next = fat32_cluster_to_lba(fs, new_c);
-                for(uint32_t i=0; i<fs->sectors_per_cluster; i++) sd_write_block(lba_next + i, scratch);
-            } else {
-                file->current_cluster = next;
-            }
-        }
     }
 
     if (file->position > file->size) {
         file->size = file->position;
-        sd_read_block(file->dir_sector, scratch);
-        cache_invalidate(scratch, 512);
-        struct fat32_dir_entry_t *d = (struct fat32_dir_entry_t *)(scratch + file->dir_offset);
-        d->size = file->size;
-        cache_clean(scratch, 512);
-        sd_write_block(file->dir_sector, scratch);
+        write_dirent(fs, file);
     }
-    return bytes_written;
+    res = bytes_written;
+
+done:
+    pool_free(&fs->sectors, scratch);
+    return res;
 }
 
 int fat32_seek(struct fat32_fs_t *fs, struct fat32_file_t *file, uint32_t offset) {
+    IO_OP(fs, FAT32_OP_SEEK);
     if (offset > file->size) return -1;
+    if (file->flags & FAT32_FILE_LOG) return -1; // Log handles only ever append
     file->position = offset;
     file->current_cluster = file->start_cluster;
-    uint32_t clusters_to_skip = offset / fs->bytes_per_cluster;
+    // Stop on the cluster holding the byte before offset, read/write step on from there
+    uint32_t clusters_to_skip = (offset == 0) ? 0 : (offset - 1) / fs->bytes_per_cluster;
     while (clusters_to_skip--) {
         file->current_cluster = get_next_cluster(fs, file->current_cluster);
     }
     return 0;
 }
 
+// Switch a handle to append-only log mode. Writes collect in a cluster-sized buffer and go to
+// the card as whole sectors once 'threshold' bytes are pending (0 = a full cluster), or after
+// every 'interval' writes including the partial tail (0 = never). fat32_fsync/fat32_close flush
+int fat32_set_log_mode(struct fat32_fs_t *fs, struct fat32_file_t *file, uint32_t threshold, uint32_t interval) {
+    if (file->dir_sector == 0) return -9;
+    uint32_t bpc = fs->bytes_per_cluster;
+
+    if (!(file->flags & FAT32_FILE_LOG)) {
+        file->log_buf = memalign(CACHE_LINE_SIZE, bpc);
+        if (!file->log_buf) return -1;
+
+        // Locate the cluster holding the sector-aligned end of file and the chain's tail
+        file->log_start = file->size & ~511u;
+        file->log_fill = file->size - file->log_start;
+        file->log_cluster = 0;
+        file->log_tail = 0;
+        uint32_t index = file->log_start / bpc;
+        uint32_t c = file->start_cluster;
+        for (uint32_t i = 0; c >= 2 && c < FAT_EOF; i++) {
+            if (i == index) file->log_cluster = c;
+            file->log_tail = c;
+            c = get_next_cluster(fs, c);
+        }
+
+        // A partial last sector is read once here, never again
+        if (file->log_fill > 0) {
+            uint32_t lba = 0;
+            if (file->log_cluster != 0) lba = fat32_cluster_to_lba(fs, file->log_cluster) + (file->log_start % bpc) / 512;
+            if (lba == 0 || blk_read(fs->dev, lba, 1, file->log_buf) != 0) {
+                free(file->log_buf);
+                file->log_buf = 0;
+                return -1;
+            }
+        }
+        file->position = file->size;
+        file->log_writes = 0;
+        file->flags |= FAT32_FILE_LOG;
+    }
+
+    file->log_threshold = (threshold == 0 || threshold > bpc) ? bpc : threshold;
+    file->log_interval = interval;
+    return 0;
+}
+
+static int aio_drain(struct fat32_fs_t *fs, struct fat32_file_t *file);
+
+// The dirent of a handle grown by async writes, once the FAT is on the card
+static int dirent_sync(struct fat32_fs_t *fs, struct fat32_file_t *file) {
+    if (!(file->flags & FAT32_FILE_DIRTY)) return 0;
+    if (write_dirent(fs, file) != 0) return -1;
+    file->flags &= ~FAT32_FILE_DIRTY;
+    return 0;
+}
+
+// Push buffered log data and the FAT cache to the card
+int fat32_fsync(struct fat32_fs_t *fs, struct fat32_file_t *file) {
+    IO_OP(fs, FAT32_OP_FSYNC);
+    aio_drain(fs, file);
+    if (file->flags & FAT32_FILE_LOG) {
+        if (log_flush(fs, file, 1) != 0) return -1;
+    }
+    if (flush_fat(fs) != 0) return -1;
+    if (dirent_sync(fs, file) != 0) return -1;
+    return blk_flush(fs->dev);
+}
+
 int fat32_close(struct fat32_fs_t *fs, struct fat32_file_t *file) {
-    (void)file;
-    if (fs->fat_dirty) {
-        cache_clean(fs->fat_buffer, 512);
-        sd_write_block(fs->cached_fat_sector, fs->fat_buffer);
-        fs->fat_dirty = 0;
+    IO_OP(fs, FAT32_OP_CLOSE);
+    int res = 0;
+    aio_drain(fs, file);
+    if (file->flags & FAT32_FILE_LOG) {
+        res = log_flush(fs, file, 1);
+        free(file->log_buf);
+        file->log_buf = 0;
+        file->flags &= ~FAT32_FILE_LOG;
     }
+    if (flush_fat(fs) != 0) return -1;
+    if (dirent_sync(fs, file) != 0) return -1;
+    return res;
+}
+
+// --- Asynchronous I/O ---
+// The cluster mapping, and for writes the allocation, is done at submission on the
+// calling core, so the handle's position and size move on at once and the next
+// request continues where this one ends. The data then moves as one block request
+// per physically contiguous run, straight from or into the caller's buffer. New
+// clusters are not zeroed, and the FAT and dirent are written back by fsync/close
+// (or when the FAT cache moves on), so a stream of appends costs no synchronous I/O.
+// Requests that are not whole sectors at a sector-aligned position, from a
+// word-aligned buffer, go through fat32_read/fat32_write and complete in the call
+
+static void aio_put(struct fat32_aio_t *aio) {
+    if (--aio->pending) return;
+    if (aio->result >= 0) aio->result = (int)aio->bytes;
+    aio->file->aio_pending--;
+    if (aio->cb) aio->cb(aio, aio->ctx);
+}
+
+static void aio_extent_done(struct blk_req_t *req) {
+    struct fat32_aio_t *aio = req->ctx;
+    if (req->res != 0 && aio->result >= 0) aio->result = req->res;
+    aio_put(aio);
+}
+
+// Runs the device until the handle's requests are complete. -1 if some are pending on a
+// device that has no poll op to complete them
+static int aio_drain(struct fat32_fs_t *fs, struct fat32_file_t *file) {
+    if (file->aio_pending && !fs->dev->ops->poll) return -1;
+    while (file->aio_pending) blk_poll(fs->dev);
     return 0;
-}
\ No newline at end of file
+}
+
+static int aio_direct(const struct fat32_file_t *file, const void *buf, uint32_t size) {
+    return !(file->flags & FAT32_FILE_LOG) && file->position % 512 == 0 && size % 512 == 0 &&
+           ((uintptr_t)buf & 3) == 0;
+}
+
+// Maps size bytes from the handle's position onto block requests in aio, growing the
+// chain if 'grow' is set. Returns the bytes mapped, which is short when the extents
+// run out, the chain ends (reads) or the volume fills up (writes, after the first cluster).
+// The handle only moves on once the whole request is mapped: on an error it is left as
+// it was and the clusters this request put on the chain are given back
+static int aio_map(struct fat32_fs_t *fs, struct fat32_file_t *file, struct fat32_aio_t *aio,
+                   uint8_t *ptr, uint32_t size, uint32_t op) {
+    uint32_t bpc = fs->bytes_per_cluster;
+    uint32_t start = file->start_cluster, current = file->current_cluster, position = file->position;
+    uint32_t first_new = 0, tail = 0; // First cluster linked here, and the end of the chain before it
+    uint32_t done = 0;
+
+    while (done < size) {
+        uint32_t cluster = current;
+        int link = 0; // A free cluster, to go on the chain once it is sure to be used
+
+        if (start == 0 || (position > 0 && position % bpc == 0)) {
+            if (start != 0) cluster = get_next_cluster(fs, current);
+            if (start == 0 || cluster < 2 || cluster >= FAT_EOF) {
+                if (op != BLK_OP_WRITE) break;
+                cluster = find_free_cluster(fs);
+                if (cluster == 0) {
+                    if (done == 0) return -1;
+                    break;
+                }
+                link = 1;
+            }
+        }
+
+        uint32_t in_cluster = position % bpc;
+        uint32_t lba = fat32_cluster_to_lba(fs, cluster) + in_cluster / 512;
+        uint32_t n = bpc - in_cluster;
+        if (n > size - done) n = size - done;
+
+        struct blk_req_t *last = aio->nreq ? &aio->req[aio->nreq - 1] : 0;
+        if (last && last->lba + last->count == lba) {
+            last->count += n / 512;
+        } else {
+            if (aio->nreq == FAT32_AIO_EXTENTS) break;
+            aio->req[aio->nreq++] = (struct blk_req_t){ op, lba, n / 512, ptr + done, aio_extent_done, aio, 0, 0 };
+        }
+
+        if (link) {
+            if (set_fat_entry(fs, cluster, FAT_EOF) != 0) goto fail;
+            if (start != 0 && set_fat_entry(fs, current, cluster) != 0) {
+                set_fat_entry(fs, cluster, FAT_FREE);
+                goto fail;
+            }
+            if (first_new == 0) {
+                first_new = cluster;
+                tail = (start != 0) ? current : 0;
+            }
+            if (start == 0) start = cluster;
+        }
+        current = cluster;
+        position += n;
+        done += n;
+    }
+
+    if (first_new != 0) file->flags |= FAT32_FILE_DIRTY;
+    file->start_cluster = start;
+    file->current_cluster = current;
+    file->position = position;
+    return (int)done;
+
+fail:
+    // Nothing has been submitted yet: cut the chain back to where it ended
+    if (first_new != 0) {
+        if (tail != 0) set_fat_entry(fs, tail, FAT_EOF);
+        for (uint32_t c = first_new; c >= 2 && c < FAT_EOF; ) {
+            uint32_t next = get_next_cluster(fs, c);
+            if (set_fat_entry(fs, c, FAT_FREE) != 0) break;
+            if (c < fs->free_hint) fs->free_hint = c;
+            c = next;
+        }
+    }
+    return -1;
+}
+
+static void aio_init(struct fat32_aio_t *aio, struct fat32_file_t *file, fat32_aio_cb cb, void *ctx) {
+    aio->nreq = 0;
+    aio->pending = 0;
+    aio->bytes = 0;
+    aio->result = 0;
+    aio->file = file;
+    aio->cb = cb;
+    aio->ctx = ctx;
+}
+
+// Submits the mapped extents. pending holds one extra reference until all are out, as
+// a backend without a submit op completes each one before blk_submit returns
+static int aio_start(struct fat32_fs_t *fs, struct fat32_aio_t *aio, int mapped) {
+    if (mapped < 0) return mapped;
+    aio->bytes = (uint32_t)mapped;
+    aio->pending = aio->nreq + 1;
+    aio->file->aio_pending++;
+    for (uint32_t i = 0; i < aio->nreq; i++) {
+        int res = blk_submit(fs->dev, &aio->req[i]);
+        if (res != 0) {
+            aio->req[i].res = res;
+            aio_extent_done(&aio->req[i]);
+        }
+    }
+    aio_put(aio);
+    return 0;
+}
+
+// Synchronous fallback: complete with the result of the plain call
+static int aio_complete(struct fat32_aio_t *aio, int result) {
+    aio->result = result;
+    if (aio->cb) aio->cb(aio, aio->ctx);
+    return 0;
+}
+
+int fat32_read_async(struct fat32_fs_t *fs, struct fat32_file_t *file, void *buf, uint32_t size,
+                     struct fat32_aio_t *aio, fat32_aio_cb cb, void *ctx) {
+    aio_init(aio, file, cb, ctx);
+    if (file->position >= file->size) size = 0;
+    else if (file->position + size > file->size) size = file->size - file->position;
+
+    if (!aio_direct(file, buf, size)) return aio_complete(aio, fat32_read(fs, file, buf, size));
+    return aio_start(fs, aio, aio_map(fs, file, aio, buf, size, BLK_OP_READ));
+}
+
+int fat32_write_async(struct fat32_fs_t *fs, struct fat32_file_t *file, const void *buf, uint32_t size,
+                      struct fat32_aio_t *aio, fat32_aio_cb cb, void *ctx) {
+    if (file->dir_sector == 0) return -9; // Safety: Invalid file handle
+    aio_init(aio, file, cb, ctx);
+
+    if (!aio_direct(file, buf, size)) return aio_complete(aio, fat32_write(fs, file, buf, size));
+    int mapped = aio_map(fs, file, aio, (uint8_t *)buf, size, BLK_OP_WRITE);
+    if (file->position > file->size) {
+        file->size = file->position;
+        file->flags |= FAT32_FILE_DIRTY;
+    }
+    return aio_start(fs, aio, mapped);
+}
+
+// Runs what has completed; returns the number of block requests finished
+int fat32_aio_poll(struct fat32_fs_t *fs) {
+    return blk_poll(fs->dev);
+}
+
+int fat32_aio_done(const struct fat32_aio_t *aio) {
+    return aio->pending == 0;
+}
+
+int fat32_aio_wait(struct fat32_fs_t *fs, struct fat32_aio_t *aio) {
+    while (aio->pending) blk_poll(fs->dev);
+    return aio->result;
+}
+// --- Defragmentation ---
+
+static uint32_t frag_score(uint32_t clusters, uint32_t fragments, uint32_t chains) {
+    if (clusters <= chains) return 0;
+    return (fragments - chains) * 100 / (clusters - chains);
+}
+
+// First run of 'count' free clusters, or 0 if the volume has no such gap
+static uint32_t find_free_run(struct fat32_fs_t *fs, uint32_t count) {
+    uint32_t run_start = 0, run_len = 0;
+    for (uint32_t i = 2; i < fs->total_clusters + 2; i++) {
+        if (get_next_cluster(fs, i) != FAT_FREE) {
+            run_len = 0;
+            continue;
+        }
+        if (run_len++ == 0) run_start = i;
+        if (run_len == count) return run_start;
+    }
+    return 0;
+}
+
+static int copy_sectors(struct fat32_fs_t *fs, uint32_t src_lba, uint32_t dst_lba, uint32_t count) {
+    uint8_t *buf = bulk_buffer(fs);
+    if (!buf) return -1;
+    while (count > 0) {
+        uint32_t n = (count > BULK_SECTORS) ? BULK_SECTORS : count;
+        if (blk_read(fs->dev, src_lba, n, buf) != 0) return -1;
+        if (blk_write(fs->dev, dst_lba, n, buf) != 0) return -1;
+        src_lba += n; dst_lba += n; count -= n;
+    }
+    return 0;
+}
+
+int fat32_file_fragmentation(struct fat32_fs_t *fs, struct fat32_file_t *file, struct fat32_frag_stats_t *st) {
+    st->clusters = 0;
+    st->fragments = 0;
+
+    uint32_t c = file->start_cluster;
+    while (c >= 2 && c < FAT_EOF) {
+        uint32_t next = get_next_cluster(fs, c);
+        st->clusters++;
+        if (next != c + 1) st->fragments++; // Run ends here
+        c = next;
+    }
+    st->score = frag_score(st->clusters, st->fragments, st->clusters ? 1 : 0);
+    return 0;
+}
+
+// Volume-wide figure from a single pass over the FAT: every chain ideally is one run
+int fat32_volume_fragmentation(struct fat32_fs_t *fs, struct fat32_frag_stats_t *st) {
+    uint32_t chains = 0;
+    st->clusters = 0;
+    st->fragments = 0;
+
+    for (uint32_t c = 2; c < fs->total_clusters + 2; c++) {
+        uint32_t next = get_next_cluster(fs, c);
+        if (next == FAT_FREE || next == 0x0FFFFFF7) continue; // Free or bad
+        st->clusters++;
+        if (next >= 0x0FFFFFF8) { chains++; st->fragments++; }
+        else if (next != c + 1) st->fragments++;
+    }
+    st->score = frag_score(st->clusters, st->fragments, chains);
+    return 0;
+}
+
+// Move a file into one contiguous run. The new copy is fully written and chained before the
+// single directory-sector write that switches the file over; only then is the old chain freed.
+int fat32_defragment(struct fat32_fs_t *fs, struct fat32_file_t *file) {
+    struct fat32_frag_stats_t st;
+
+    if (file->dir_sector == 0) return -9; // Safety: Invalid file handle
+    // Async writes still in flight would land in the old chain after it is copied and freed
+    if (aio_drain(fs, file) != 0) return -1;
+    fat32_file_fragmentation(fs, file, &st);
+    if (st.fragments <= 1) return 0;
+
+    uint32_t new_start = find_free_run(fs, st.clusters);
+    if (new_start == 0) return -2; // No gap large enough
+
+    // 1. Copy each old run into its place in the new one
+    uint32_t c = file->start_cluster;
+    uint32_t dst = new_start;
+    while (c >= 2 && c < FAT_EOF) {
+        uint32_t run = 1;
+        uint32_t next = get_next_cluster(fs, c);
+        while (next == c + run) {
+            run++;
+            next = get_next_cluster(fs, c + run - 1);
+        }
+        if (copy_sectors(fs, fat32_cluster_to_lba(fs, c), fat32_cluster_to_lba(fs, dst),
+                         run * fs->sectors_per_cluster) != 0) return -1;
+        dst += run;
+        c = next;
+    }
+
+    // 2. Chain the new run
+    for (uint32_t i = 0; i < st.clusters; i++) {
+        uint32_t n = (i + 1 < st.clusters) ? new_start + i + 1 : FAT_EOF;
+        if (set_fat_entry(fs, new_start + i, n) != 0) return -1;
+    }
+    if (flush_fat(fs) != 0) return -1;
+
+    // 3. Repoint the directory entry (commit point)
+    uint8_t *scratch = pool_alloc(&fs->sectors);
+    if (!scratch) return -1;
+    int res = blk_read(fs->dev, file->dir_sector, 1, scratch);
+    if (res == 0) {
+        struct fat32_dir_entry_t *d = (struct fat32_dir_entry_t *)(scratch + file->dir_offset);
+        d->cluster_hi = (uint16_t)(new_start >> 16);
+        d->cluster_lo = (uint16_t)(new_start & 0xFFFF);
+        res = blk_write(fs->dev, file->dir_sector, 1, scratch);
+    }
+    pool_free(&fs->sectors, scratch);
+    if (res != 0) return -1;
+
+    // 4. Release the old chain
+    c = file->start_cluster;
+    while (c >= 2 && c < FAT_EOF) {
+        uint32_t next = get_next_cluster(fs, c);
+        if (set_fat_entry(fs, c, FAT_FREE) != 0) return -1;
+        if (c < fs->free_hint) fs->free_hint = c;
+        c = next;
+    }
+    if (flush_fat(fs) != 0) return -1;
+
+    uint32_t index = (file->position == 0) ? 0 : (file->position - 1) / fs->bytes_per_cluster;
+    if (index >= st.clusters) index = st.clusters - 1;
+    file->start_cluster = new_start;
+    file->current_cluster = new_start + index;
+    if (file->flags & FAT32_FILE_LOG) {
+        index = file->log_start / fs->bytes_per_cluster;
+        file->log_cluster = (index < st.clusters) ? new_start + index : 0;
+        file->log_tail = new_start + st.clusters - 1;
+    }
+    return 1;
+}
+
+static int defrag_dir(struct fat32_fs_t *fs, uint32_t dir_cluster, uint32_t min_score,
+                      struct fat32_defrag_report_t *rep, int depth) {
+    uint32_t search_cluster = dir_cluster;
+    int res = 0;
+
+    uint8_t *buffer = pool_alloc(&fs->sectors);
+    if (!buffer) return -1;
+    while (search_cluster >= 2 && search_cluster < FAT_EOF) {
+        uint32_t lba = fat32_cluster_to_lba(fs, search_cluster);
+        for (uint32_t s = 0; s < fs->sectors_per_cluster; s++) {
+            if (blk_read(fs->dev, lba + s, 1, buffer) != 0) { res = -1; goto done; }
+            struct fat32_dir_entry_t *entries = (struct fat32_dir_entry_t *)buffer;
+            for (int i = 0; i < 16; i++) {
+                struct fat32_dir_entry_t *e = &entries[i];
+                if (e->name[0] == 0x00) goto done;
+                if (e->name[0] == 0xE5 || e->name[0] == '.' || e->attr == ATTR_LFN || (e->attr & 0x08)) continue;
+
+                uint32_t cluster = entry_cluster(e);
+                if (e->attr & 0x10) {
+                    if (depth < FAT32_DEFRAG_MAX_DEPTH && cluster >= 2) {
+                        if (defrag_dir(fs, cluster, min_score, rep, depth + 1) != 0) { res = -1; goto done; }
+                    }
+                    continue;
+                }
+
+                struct fat32_file_t file;
+                struct fat32_frag_stats_t st;
+                file.start_cluster = cluster;
+                file.current_cluster = cluster;
+                file.size = e->size;
+                file.position = 0;
+                file.dir_sector = lba + s;
+                file.dir_offset = i * 32;
+                file.flags = 0;
+                file.aio_pending = 0;
+
+                fat32_file_fragmentation(fs, &file, &st);
+                rep->files_scanned++;
+                rep->fragments_before += st.fragments;
+                if (st.fragments > 1 && st.score >= min_score) {
+                    int moved = fat32_defragment(fs, &file);
+                    if (moved == -2) rep->files_skipped++; // No gap large enough
+                    else if (moved < 0) { res = -1; goto done; }
+                    else { rep->files_moved++; st.fragments = 1; }
+                }
+                rep->fragments_after += st.fragments;
+            }
+        }
+        search_cluster = get_next_cluster(fs, search_cluster);
+    }
+
+done:
+    pool_free(&fs->sectors, buffer);
+    return res;
+}
+
+// Walk the whole tree and defragment every file whose score is at least 'min_score'
+int fat32_defragment_volume(struct fat32_fs_t *fs, uint32_t min_score, struct fat32_defrag_report_t *rep) {
+    memset(rep, 0, sizeof(*rep));
+    return defrag_dir(fs, fs->root_cluster, min_score, rep, 0);
+}
+
+// --- Verification ---
+
+// CRC-32 of the whole file, streamed through the bulk buffer with one multi-block read
+// per burst of physically consecutive clusters. The handle's position is left alone
+int fat32_checksum(struct fat32_fs_t *fs, struct fat32_file_t *file, uint32_t *crc) {
+    uint8_t *buf = bulk_buffer(fs);
+    if (!buf) return -1;
+    // The size already counts async writes in flight: sum their data, not what they replace
+    if (aio_drain(fs, file) != 0) return -1;
+    if ((file->flags & FAT32_FILE_LOG) && log_flush(fs, file, 1) != 0) return -1;
+
+    uint32_t sum = 0;
+    uint32_t left = file->size;
+    uint32_t cluster = file->start_cluster;
+
+    while (left > 0) {
+        if (cluster < 2 || cluster >= FAT_EOF) return -1; // Chain shorter than the size
+
+        // Extend the run while the chain stays physically contiguous
+        uint32_t run_start = cluster, run = 1;
+        cluster = get_next_cluster(fs, cluster);
+        while (cluster == run_start + run && run * fs->bytes_per_cluster < left) {
+            run++;
+            cluster = get_next_cluster(fs, cluster);
+        }
+
+        uint32_t bytes = run * fs->bytes_per_cluster;
+        if (bytes > left) bytes = left;
+        uint32_t lba = fat32_cluster_to_lba(fs, run_start);
+        left -= bytes;
+
+        while (bytes > 0) {
+            uint32_t chunk = (bytes > BULK_SECTORS * 512) ? BULK_SECTORS * 512 : bytes;
+            uint32_t sectors = (chunk + 511) / 512;
+            if (blk_read(fs->dev, lba, sectors, buf) != 0) return -1;
+            sum = crc32_update(sum, buf, chunk);
+            lba += sectors;
+            bytes -= chunk;
+        }
+    }
+
+    *crc = sum;
+    return 0;
+}
+
+// --- I/O Accounting API ---
+
+#ifdef IO_STATS
+void fat32_stats_reset(struct fat32_fs_t *fs) {
+    memset(&fs->stats, 0, sizeof(fs->stats));
+}
+
+void fat32_stats_snapshot(struct fat32_fs_t *fs, struct fat32_stats_t *out) {
+    *out = fs->stats;
+}
+
+void fat32_stats_diff(struct fat32_stats_t *out, const struct fat32_stats_t *after, const struct fat32_stats_t *before) {
+    // Every field is a uint32_t counter, so the structs diff as flat arrays
+    const uint32_t *a = (const uint32_t *)after, *b = (const uint32_t *)before;
+    uint32_t *o = (uint32_t *)out;
+    for (size_t i = 0; i < sizeof(*out) / sizeof(uint32_t); i++) o[i] = a[i] - b[i];
+}
+
+const char *fat32_op_name(enum fat32_op_t op) {
+    static const char *const names[FAT32_OP_COUNT] = {
+        "mount", "open", "create", "mkdir", "listdir", "read", "write", "seek", "fsync", "close"
+    };
+    return op < FAT32_OP_COUNT ? names[op] : "?";
+}
+#endif
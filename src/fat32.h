@@ -3,6 +3,9 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include "cache.h"
+#include "malloc.h"
+#include "blkdev.h"
 
 // --- On-Disk Structures ---
 
@@ -61,9 +64,77 @@ struct fat32_dir_entry_t {
     uint32_t size;
 } __attribute__((packed));
 
+// VFAT Long File Name entry (attr == 0x0F), stored in reverse order before the 8.3 entry
+struct fat32_lfn_entry_t {
+    uint8_t  ord;           // Sequence number, 0x40 marks the last (first stored) part
+    uint16_t name1[5];      // UTF-16 characters 1-5
+    uint8_t  attr;          // Always 0x0F
+    uint8_t  type;          // Always 0
+    uint8_t  checksum;      // Checksum of the 8.3 name this chain belongs to
+    uint16_t name2[6];      // UTF-16 characters 6-11
+    uint16_t cluster_lo;    // Always 0
+    uint16_t name3[2];      // UTF-16 characters 12-13
+} __attribute__((packed));
+
+#define FAT32_LFN_MAX 255
+
 // --- Runtime Structures ---
 
+#define FAT32_DIR_HINTS 8
+
+// Where the next free directory slot search should resume
+struct fat32_dir_hint_t {
+    uint32_t dir_cluster;   // First cluster of the directory (0 = unused)
+    uint32_t cluster;       // Cluster of the chain holding the first free slot
+    uint32_t slot;          // Entry index within that cluster
+    uint32_t alias_next;    // Next ~N alias tail, above every one on disk (0 = not scanned yet)
+};
+
+// I/O accounting, built with -DIO_STATS
+#ifdef IO_STATS
+enum fat32_op_t {
+    FAT32_OP_MOUNT,
+    FAT32_OP_OPEN,
+    FAT32_OP_CREATE,
+    FAT32_OP_MKDIR,
+    FAT32_OP_LISTDIR,
+    FAT32_OP_READ,
+    FAT32_OP_WRITE,
+    FAT32_OP_SEEK,
+    FAT32_OP_FSYNC,
+    FAT32_OP_CLOSE,
+    FAT32_OP_COUNT
+};
+
+// What the calls to one API function cost in total. An API call made from inside
+// another (fat32_close from fat32_fsync, say) is charged to both
+struct fat32_op_cost_t {
+    uint32_t calls;
+    uint32_t dev_reads;         // Block-device requests
+    uint32_t dev_writes;
+    uint32_t sectors_read;
+    uint32_t sectors_written;
+    uint32_t fat_lookups;       // FAT entries followed
+};
+
+struct fat32_stats_t {
+    struct fat32_op_cost_t op[FAT32_OP_COUNT];
+
+    // Internal helpers, over all calls
+    uint32_t fat_lookups;       // get_next_cluster
+    uint32_t fat_hits;          // FAT sector already in the cache
+    uint32_t fat_misses;        // FAT sector read from the device
+    uint32_t fat_writebacks;    // Dirty FAT sector written back
+    uint32_t free_scans;        // find_free_cluster calls
+    uint32_t free_scan_sectors; // FAT sectors those calls walked
+    uint32_t dir_lookups;       // Single-directory name searches
+    uint32_t dir_sectors;       // Directory sectors those searches read
+    uint32_t clusters_zeroed;
+};
+#endif
+
 struct fat32_fs_t {
+    struct blkdev_t *dev;
     uint32_t fat_start_lba;
     uint32_t data_start_lba;
     uint32_t sectors_per_cluster;
@@ -74,8 +145,49 @@ struct fat32_fs_t {
     
     // Single Sector FAT Cache
     uint32_t cached_fat_sector; 
-    uint8_t  fat_buffer[512] __attribute__((aligned(32))); 
+    uint8_t  fat_buffer[512] __attribute__((aligned(CACHE_LINE_SIZE))); 
     int      fat_dirty;
+    uint32_t free_hint;     // No free cluster below this one
+
+    // Per-Directory Free Slot Hints
+    struct fat32_dir_hint_t dir_hints[FAT32_DIR_HINTS];
+    uint32_t dir_hint_next;
+
+    // Mount-Lifetime Allocations (released together by fat32_unmount)
+    uint32_t mounted;       // FAT32_MOUNTED from mount to unmount
+    struct arena_t arena;
+    struct mem_pool_t sectors;  // One-sector scratch buffers, FAT32_SCRATCH_SECTORS of them
+    uint8_t *zero_burst;    // Zero-filled source for clearing clusters
+    uint8_t *bulk_buf;      // Burst buffer for copies and checksums, allocated on first use
+
+#ifdef IO_STATS
+    struct fat32_stats_t stats; // Cleared by fat32_mount
+#endif
+};
+
+#define FAT32_ARENA_BLOCK 8192
+
+// A value rather than a flag: the struct may sit in .bss, which start.S does not clear
+#define FAT32_MOUNTED 0x4D6E7446
+
+struct fat32_frag_stats_t {
+    uint32_t clusters;      // Clusters in use
+    uint32_t fragments;     // Physically contiguous runs
+    uint32_t score;         // 0 = one run per chain, 100 = every cluster on its own
+};
+
+#define FAT32_DEFRAG_MAX_DEPTH 8
+
+// Scratch sectors per mount. The deepest nesting is the defrag walk: one per directory
+// level, and one for the move itself
+#define FAT32_SCRATCH_SECTORS (FAT32_DEFRAG_MAX_DEPTH + 2)
+
+struct fat32_defrag_report_t {
+    uint32_t files_scanned;
+    uint32_t files_moved;
+    uint32_t files_skipped;     // Fragmented, but no free gap large enough
+    uint32_t fragments_before;
+    uint32_t fragments_after;
 };
 
 struct fat32_file_t {
@@ -85,18 +197,89 @@ struct fat32_file_t {
     uint32_t position;
     uint32_t dir_sector;    // Sector containing the dirent
     uint32_t dir_offset;    // Offset within that sector
+
+    // Append/Log Mode (fat32_set_log_mode)
+    uint32_t flags;
+    uint8_t *log_buf;       // One cluster, owned by the handle
+    uint32_t log_start;     // Sector-aligned file offset of log_buf[0]
+    uint32_t log_fill;      // Bytes buffered from log_start on
+    uint32_t log_cluster;   // Cluster holding log_start, 0 if not allocated yet
+    uint32_t log_tail;      // Last cluster of the chain
+    uint32_t log_threshold; // Flush once this many bytes are buffered
+    uint32_t log_interval;  // Flush every N writes (0 = size threshold only)
+    uint32_t log_writes;    // Writes since the last flush
+
+    uint32_t aio_pending;   // Asynchronous requests not yet complete
+};
+
+#define FAT32_FILE_LOG   0x01
+#define FAT32_FILE_DIRTY 0x02   // Size or chain changed by async writes, dirent not rewritten yet
+
+// --- Asynchronous I/O ---
+// A request is a caller-owned control block, which doubles as its token: it and the
+// buffer must stay put until it completes. Completion runs cb (if any) from
+// fat32_aio_poll, fat32_aio_wait or any other call that reaps the device, and leaves
+// the byte count or a negative code in result. Requests on one handle take effect
+// and complete in submission order
+
+#define FAT32_AIO_EXTENTS 8     // Contiguous runs per request; a request that would need more is cut short
+
+struct fat32_aio_t;
+typedef void (*fat32_aio_cb)(struct fat32_aio_t *aio, void *ctx);
+
+struct fat32_aio_t {
+    struct blk_req_t req[FAT32_AIO_EXTENTS];
+    uint32_t nreq;
+    uint32_t pending;           // Block requests in flight, 0 once complete
+    uint32_t bytes;             // Mapped at submission
+    int result;                 // Bytes transferred or a negative code, valid once complete
+    struct fat32_file_t *file;
+    fat32_aio_cb cb;
+    void *ctx;
 };
 
 // --- API ---
 
-int fat32_mount(struct fat32_fs_t *fs);
+int fat32_mount(struct fat32_fs_t *fs, struct blkdev_t *dev);
+int fat32_unmount(struct fat32_fs_t *fs);
 int fat32_open(struct fat32_fs_t *fs, const char *path, struct fat32_file_t *out);
 int fat32_read(struct fat32_fs_t *fs, struct fat32_file_t *file, void *buf, uint32_t size);
 int fat32_write(struct fat32_fs_t *fs, struct fat32_file_t *file, const void *buf, uint32_t size);
 int fat32_seek(struct fat32_fs_t *fs, struct fat32_file_t *file, uint32_t offset);
 int fat32_close(struct fat32_fs_t *fs, struct fat32_file_t *file);
+int fat32_fsync(struct fat32_fs_t *fs, struct fat32_file_t *file);
+int fat32_set_log_mode(struct fat32_fs_t *fs, struct fat32_file_t *file, uint32_t threshold, uint32_t interval);
 
 uint32_t fat32_cluster_to_lba(struct fat32_fs_t *fs, uint32_t cluster);
 
 int fat32_create(struct fat32_fs_t *fs, const char *path, struct fat32_file_t *out);
+int fat32_mkdir(struct fat32_fs_t *fs, const char *path);
+
+// Called once per live 8.3 entry (long-name parts and the volume label are skipped)
+typedef void (*fat32_dir_cb)(void *ctx, const struct fat32_dir_entry_t *ent);
+int fat32_listdir(struct fat32_fs_t *fs, const char *path, fat32_dir_cb cb, void *ctx);
+
+int fat32_file_fragmentation(struct fat32_fs_t *fs, struct fat32_file_t *file, struct fat32_frag_stats_t *st);
+int fat32_volume_fragmentation(struct fat32_fs_t *fs, struct fat32_frag_stats_t *st);
+int fat32_defragment(struct fat32_fs_t *fs, struct fat32_file_t *file);
+int fat32_defragment_volume(struct fat32_fs_t *fs, uint32_t min_score, struct fat32_defrag_report_t *rep);
+
+int fat32_checksum(struct fat32_fs_t *fs, struct fat32_file_t *file, uint32_t *crc);
+
+// 0 once submitted (aio will complete), negative if nothing was started
+int fat32_read_async(struct fat32_fs_t *fs, struct fat32_file_t *file, void *buf, uint32_t size,
+                     struct fat32_aio_t *aio, fat32_aio_cb cb, void *ctx);
+int fat32_write_async(struct fat32_fs_t *fs, struct fat32_file_t *file, const void *buf, uint32_t size,
+                      struct fat32_aio_t *aio, fat32_aio_cb cb, void *ctx);
+int fat32_aio_poll(struct fat32_fs_t *fs);
+int fat32_aio_done(const struct fat32_aio_t *aio);
+int fat32_aio_wait(struct fat32_fs_t *fs, struct fat32_aio_t *aio);
+
+#ifdef IO_STATS
+// Snapshots are plain copies of fs->stats; diff gives out = after - before (out may alias either)
+void fat32_stats_reset(struct fat32_fs_t *fs);
+void fat32_stats_snapshot(struct fat32_fs_t *fs, struct fat32_stats_t *out);
+void fat32_stats_diff(struct fat32_stats_t *out, const struct fat32_stats_t *after, const struct fat32_stats_t *before);
+const char *fat32_op_name(enum fat32_op_t op);
+#endif
 #endif // FAT32_H
\ No newline at end of file
@@ -0,0 +1,213 @@
+#include "iocore.h"
+
+#ifdef IO_CORE
+#include "smp.h"
+#include "cache.h"
+
+// Shared rings. Each index is written by one side only and has a cache line to
+// itself: the producer owns a ring's tail, the consumer its head. Slots are read
+// after an acquire of the tail and released by a store of the head
+struct io_rings_t {
+    volatile uint32_t sq_tail __attribute__((aligned(CACHE_LINE_SIZE)));    // Core 0
+    volatile uint32_t sq_head __attribute__((aligned(CACHE_LINE_SIZE)));    // I/O core
+    volatile uint32_t cq_tail __attribute__((aligned(CACHE_LINE_SIZE)));    // I/O core
+    volatile uint32_t cq_head __attribute__((aligned(CACHE_LINE_SIZE)));    // Core 0
+    struct io_sqe_t sq[IO_RING_SIZE] __attribute__((aligned(CACHE_LINE_SIZE)));
+    struct io_cqe_t cq[IO_RING_SIZE] __attribute__((aligned(CACHE_LINE_SIZE)));
+};
+
+static struct io_rings_t rings;
+static struct blkdev_t *volatile io_dev;    // Set once by io_core_start
+static uint32_t sq_claimed;                 // Core 0: slots handed out by io_get_sqe, not yet submitted
+
+// --- I/O core ---
+
+// Length of the run of requests from sq[head] that can go to the device as one
+// command: same direction, following sectors, following memory
+static uint32_t merge_run(uint32_t head, uint32_t tail, uint32_t *sectors) {
+    const struct io_sqe_t *first = &rings.sq[head % IO_RING_SIZE];
+    uint32_t n = 1, total = first->count;
+
+    if (first->op == IO_OP_FLUSH) return 1;
+    for (uint32_t i = head + 1; i != tail; i++, n++) {
+        const struct io_sqe_t *prev = &rings.sq[(i - 1) % IO_RING_SIZE];
+        const struct io_sqe_t *s = &rings.sq[i % IO_RING_SIZE];
+        if (s->op != first->op || s->lba != prev->lba + prev->count) break;
+        if ((uint8_t *)s->buf != (uint8_t *)prev->buf + prev->count * 512) break;
+        if (total + s->count > IO_MERGE_MAX) break;
+        total += s->count;
+    }
+    *sectors = total;
+    return n;
+}
+
+static int io_execute(const struct io_sqe_t *s, uint32_t sectors) {
+    switch (s->op) {
+    case IO_OP_READ:  return blk_read(io_dev, s->lba, sectors, s->buf);
+    case IO_OP_WRITE: return blk_write(io_dev, s->lba, sectors, s->buf);
+    case IO_OP_FLUSH: return blk_flush(io_dev);
+    }
+    return -1;
+}
+
+// Core IO_CORE_ID after bring-up, in place of the task pool. Sleeps in WFE until a
+// device is attached and whenever the submission ring is empty. The CQ cannot
+// overflow: io_get_sqe never lets more than IO_RING_SIZE requests be in flight
+void io_core_main(void) {
+    while (!io_dev) smp_idle();
+
+    for (;;) {
+        uint32_t head = rings.sq_head;
+        uint32_t tail = __atomic_load_n(&rings.sq_tail, __ATOMIC_ACQUIRE);
+        if (head == tail) {
+            smp_idle();
+            continue;
+        }
+
+        uint32_t sectors = 0;
+        uint32_t n = merge_run(head, tail, &sectors);
+        int res = io_execute(&rings.sq[head % IO_RING_SIZE], sectors);
+
+        uint32_t cq = rings.cq_tail;
+        for (uint32_t i = 0; i < n; i++, cq++) {
+            const struct io_sqe_t *s = &rings.sq[(head + i) % IO_RING_SIZE];
+            struct io_cqe_t *c = &rings.cq[cq % IO_RING_SIZE];
+            c->done = s->done;
+            c->ctx = s->ctx;
+            c->res = res;
+        }
+        __atomic_store_n(&rings.sq_head, head + n, __ATOMIC_RELEASE);
+        __atomic_store_n(&rings.cq_tail, cq, __ATOMIC_RELEASE);
+        smp_wake();
+    }
+}
+
+// --- Core 0 ---
+
+int io_core_start(struct blkdev_t *dev) {
+    if (smp_cores_online() <= IO_CORE_ID) return -1;
+    rings.sq_head = rings.sq_tail = 0; // .bss is not zeroed at boot
+    rings.cq_head = rings.cq_tail = 0;
+    sq_claimed = 0;
+    __atomic_store_n(&io_dev, dev, __ATOMIC_RELEASE);
+    smp_wake();
+    return 0;
+}
+
+// Next free submission slot, or NULL while IO_RING_SIZE requests are in flight
+struct io_sqe_t *io_get_sqe(void) {
+    uint32_t next = rings.sq_tail + sq_claimed;
+    if (next - rings.cq_head >= IO_RING_SIZE) return NULL;
+    sq_claimed++;
+    return &rings.sq[next % IO_RING_SIZE];
+}
+
+void io_submit(void) {
+    if (!sq_claimed) return;
+    __atomic_store_n(&rings.sq_tail, rings.sq_tail + sq_claimed, __ATOMIC_RELEASE);
+    sq_claimed = 0;
+    smp_wake();
+}
+
+// Runs the callbacks of every finished request, returns how many there were.
+// Re-entrant: a callback may submit, or wait and so reap, in turn
+int io_reap(void) {
+    int n = 0;
+
+    for (;;) {
+        uint32_t head = rings.cq_head;
+        if (head == __atomic_load_n(&rings.cq_tail, __ATOMIC_ACQUIRE)) break;
+        struct io_cqe_t c = rings.cq[head % IO_RING_SIZE];
+        __atomic_store_n(&rings.cq_head, head + 1, __ATOMIC_RELEASE); // Slot free before the callback
+        if (c.done) c.done(c.ctx, c.res);
+        n++;
+    }
+    return n;
+}
+
+// Until everything submitted has completed and been reaped
+void io_wait_idle(void) {
+    io_submit();
+    while (rings.cq_head != rings.sq_tail) {
+        if (!io_reap()) smp_idle();
+    }
+}
+
+// --- Block device front end ---
+
+struct io_sync_t {
+    volatile uint32_t done;
+    int res;
+};
+
+static void sync_done(void *ctx, int res) {
+    struct io_sync_t *s = ctx;
+    s->res = res;
+    s->done = 1;
+}
+
+// A free submission slot, reaping completions until one turns up
+static struct io_sqe_t *io_get_sqe_wait(void) {
+    struct io_sqe_t *sqe;
+    while (!(sqe = io_get_sqe())) {
+        io_submit();
+        if (!io_reap()) smp_idle();
+    }
+    return sqe;
+}
+
+static int io_sync(uint32_t op, uint32_t lba, uint32_t count, void *buf) {
+    struct io_sync_t s = { 0, 0 };
+    struct io_sqe_t *sqe = io_get_sqe_wait();
+
+    *sqe = (struct io_sqe_t){ op, lba, count, buf, sync_done, &s };
+    io_submit();
+    while (!s.done) {
+        if (!io_reap()) smp_idle();
+    }
+    return s.res;
+}
+
+static int io_blk_read(void *ctx, uint32_t lba, uint32_t count, void *buf) {
+    (void)ctx;
+    return io_sync(IO_OP_READ, lba, count, buf);
+}
+
+static int io_blk_write(void *ctx, uint32_t lba, uint32_t count, const void *buf) {
+    (void)ctx;
+    return io_sync(IO_OP_WRITE, lba, count, (void *)buf);
+}
+
+static int io_blk_flush(void *ctx) {
+    (void)ctx;
+    return io_sync(IO_OP_FLUSH, 0, 0, NULL);
+}
+
+static void io_req_done(void *ctx, int res) {
+    blk_complete(ctx, res);
+}
+
+static int io_blk_submit(void *ctx, struct blk_req_t *req) {
+    (void)ctx;
+    struct io_sqe_t *sqe = io_get_sqe_wait();
+    *sqe = (struct io_sqe_t){ req->op, req->lba, req->count, req->buf, io_req_done, req };
+    io_submit();
+    return 0;
+}
+
+static int io_blk_poll(void *ctx) {
+    (void)ctx;
+    return io_reap();
+}
+
+static const struct blkdev_ops_t io_blk_ops = { io_blk_read, io_blk_write, io_blk_flush, io_blk_submit, io_blk_poll };
+
+void io_blkdev_init(struct blkdev_t *front) {
+    front->ops = &io_blk_ops;
+    front->ctx = NULL;
+    front->sectors = io_dev->sectors;
+#ifdef IO_STATS
+    blkdev_stats_reset(front);
+#endif
+}
+#endif
@@ -0,0 +1,70 @@
+#ifndef IOCORE_H
+#define IOCORE_H
+
+#include <stdint.h>
+#include "blkdev.h"
+
+// Dedicated I/O core (-DIO_CORE, needs -DSMP). Core IO_CORE_ID takes over a block
+// device and serves it from a pair of single-producer/single-consumer rings in shared
+// memory, in the style of io_uring:
+//
+//   struct io_sqe_t *sqe = io_get_sqe();   // Claim submission slots, NULL when full
+//   sqe->op = IO_OP_READ; ...              // Fill any number of them
+//   io_submit();                           // Publish the batch to the I/O core
+//   io_reap();                             // Run the done callbacks of finished ones
+//
+// Requests run in submission order. Back-to-back reads or writes of adjacent sectors
+// from adjacent memory are merged into one device command; each still gets its own
+// completion. Core 0 is the only producer and consumer: tasks on the pool must not
+// submit. io_blkdev_init wraps the rings as a block device, synchronous for the
+// filesystems as they are and asynchronous through blk_submit/blk_poll.
+
+#if defined(IO_CORE) && !defined(SMP)
+#error "IO_CORE needs SMP"
+#endif
+
+#define IO_CORE_ID          3
+#define IO_RING_SIZE        64      // Requests in flight, a power of two
+#define IO_MERGE_MAX        256     // Sectors per merged command
+
+enum io_op_t {
+    IO_OP_READ = BLK_OP_READ,
+    IO_OP_WRITE = BLK_OP_WRITE,
+    IO_OP_FLUSH = BLK_OP_FLUSH,
+};
+
+// Called on core 0 from io_reap with the blk_* result
+typedef void (*io_done_fn)(void *ctx, int res);
+
+struct io_sqe_t {
+    uint32_t op;                // enum io_op_t
+    uint32_t lba;
+    uint32_t count;             // Sectors, unused by IO_OP_FLUSH
+    void *buf;
+    io_done_fn done;            // May be NULL
+    void *ctx;
+};
+
+struct io_cqe_t {
+    io_done_fn done;
+    void *ctx;
+    int res;
+};
+
+#ifdef IO_CORE
+// Hands dev to the I/O core. Nothing else may touch dev afterwards. -1 if the core is not online
+int io_core_start(struct blkdev_t *dev);
+void io_core_main(void);
+
+struct io_sqe_t *io_get_sqe(void);
+void io_submit(void);
+int io_reap(void);
+void io_wait_idle(void);
+
+// Block device front end for the started device. blk_read/write/flush submit one
+// request and wait for it, reaping any other completions on the way; blk_submit
+// queues without waiting and blk_poll reaps
+void io_blkdev_init(struct blkdev_t *front);
+#endif
+
+#endif
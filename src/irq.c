@@ -0,0 +1,37 @@
+#include "irq.h"
+
+static irq_handler_t handlers[IRQ_MAX];
+
+// Distributor and CPU interface on, every line off until a handler is registered,
+// then IRQs unmasked on this core. Secure state: group 0 is signalled as IRQ
+void irq_init(void) {
+    *GICD_CTLR = 0;
+    for (uint32_t i = 0; i < IRQ_MAX; i++) handlers[i] = 0; // .bss is not zeroed at boot
+    for (uint32_t n = 0; n < IRQ_MAX / 32; n++) *GICD_ICENABLER(n) = 0xFFFFFFFF;
+    *GICD_CTLR = 3;
+
+    *GICC_PMR = 0xFF;
+    *GICC_CTLR = 3;
+
+    __asm__ volatile ("cpsie i" ::: "memory");
+}
+
+void irq_register(uint32_t id, irq_handler_t handler) {
+    if (id >= IRQ_MAX) return;
+    handlers[id] = handler;
+    if (id >= 32) {
+        GICD_IPRIORITYR[id] = 0xA0;
+        GICD_ITARGETSR[id] = 0x01; // CPU0
+    }
+    *GICD_ISENABLER(id / 32) = 1U << (id % 32);
+}
+
+// Called from the IRQ vector in start.S
+void irq_dispatch(void) {
+    uint32_t iar = *GICC_IAR;
+    uint32_t id = iar & 0x3FF;
+    if (id >= 1020) return; // Spurious
+
+    if (id < IRQ_MAX && handlers[id]) handlers[id](id);
+    *GICC_EOIR = iar;
+}
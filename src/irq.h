@@ -0,0 +1,44 @@
+#ifndef IRQ_H
+#define IRQ_H
+
+#include <stdint.h>
+
+// Allwinner H3 GIC-400
+#define GICD_BASE      0x01c81000
+#define GICC_BASE      0x01c82000
+
+#define GICD_CTLR         ((volatile uint32_t *)(GICD_BASE + 0x000))
+#define GICD_ISENABLER(n) ((volatile uint32_t *)(GICD_BASE + 0x100 + 4 * (n)))
+#define GICD_ICENABLER(n) ((volatile uint32_t *)(GICD_BASE + 0x180 + 4 * (n)))
+#define GICD_IPRIORITYR   ((volatile uint8_t  *)(GICD_BASE + 0x400))
+#define GICD_ITARGETSR    ((volatile uint8_t  *)(GICD_BASE + 0x800))
+
+#define GICC_CTLR      ((volatile uint32_t *)(GICC_BASE + 0x00))
+#define GICC_PMR       ((volatile uint32_t *)(GICC_BASE + 0x04))
+#define GICC_IAR       ((volatile uint32_t *)(GICC_BASE + 0x0c))
+#define GICC_EOIR      ((volatile uint32_t *)(GICC_BASE + 0x10))
+
+// Interrupt IDs (SPI n is ID 32 + n)
+#define IRQ_UART0      32
+#define IRQ_MAX        160
+
+typedef void (*irq_handler_t)(uint32_t id);
+
+// Handlers run in IRQ mode on their own stack, with IRQs masked. They must not use
+// VFP/NEON: the interrupted code's registers are not saved
+void irq_init(void);
+void irq_register(uint32_t id, irq_handler_t handler);
+void irq_dispatch(void);
+
+// Mask IRQs on this core, returning the previous state for irq_restore()
+static inline uint32_t irq_save(void) {
+    uint32_t cpsr;
+    __asm__ volatile ("mrs %0, cpsr\n cpsid i" : "=r"(cpsr) :: "memory");
+    return cpsr;
+}
+
+static inline void irq_restore(uint32_t cpsr) {
+    __asm__ volatile ("msr cpsr_c, %0" :: "r"(cpsr) : "memory");
+}
+
+#endif
@@ -2,34 +2,144 @@
 #include "sdhc.h"
 #include "fat32.h"
 #include "uart.h"
+#include "crc32.h"
+#include "prof.h"
+#include "trace.h"
+#include "bench.h"
+#include "smp.h"
+#include "sched.h"
+#include "iocore.h"
+
+#ifdef DIV_BENCH
+#include "pmu.h"
+
+uint32_t soft_uidiv(uint32_t n, uint32_t d);
+
+// Cycles per divide: the old shift/subtract loop, the UDIV runtime, and 64-bit offsets
+static void div_bench(void) {
+    volatile uint32_t sink = 0;
+    uint32_t t0, soft, hw, wide;
+    const uint32_t rounds = 4096;
+
+    pmu_enable();
+    t0 = pmu_cycles();
+    for (uint32_t i = 1; i <= rounds; i++) sink += soft_uidiv(0x12345678u + i, 512 + i);
+    soft = pmu_cycles() - t0;
+
+    t0 = pmu_cycles();
+    for (uint32_t i = 1; i <= rounds; i++) sink += (0x12345678u + i) / (512 + i);
+    hw = pmu_cycles() - t0;
+
+    t0 = pmu_cycles();
+    for (uint32_t i = 1; i <= rounds; i++) sink += (uint32_t)((0x3ABCDEF0123ull * i) / (4096 + i));
+    wide = pmu_cycles() - t0;
+
+    printf("divide cycles: soft %u, udiv %u, 64-bit %u\r\n", soft / rounds, hw / rounds, wide / rounds);
+}
+#endif
+
+#ifdef IO_STATS
+static void print_costs(const struct fat32_stats_t *st) {
+    printf("op       calls  reads writes sec_rd sec_wr fat_lk\r\n");
+    for (int i = 0; i < FAT32_OP_COUNT; i++) {
+        const struct fat32_op_cost_t *c = &st->op[i];
+        if (c->calls == 0) continue;
+        printf("%s: %u %u %u %u %u %u\r\n", fat32_op_name(i), c->calls, c->dev_reads, c->dev_writes,
+               c->sectors_read, c->sectors_written, c->fat_lookups);
+    }
+    printf("fat: lookups %u hits %u misses %u writebacks %u\r\n",
+           st->fat_lookups, st->fat_hits, st->fat_misses, st->fat_writebacks);
+    printf("alloc: scans %u sectors %u zeroed %u, dir: lookups %u sectors %u\r\n",
+           st->free_scans, st->free_scan_sectors, st->clusters_zeroed, st->dir_lookups, st->dir_sectors);
+}
+
+static void print_sd(const struct sd_stats_t *st) {
+    printf("sd: cmds %u (CMD17 %u CMD18 %u CMD24 %u CMD25 %u CMD12 %u CMD13 %u) blocks r %u w %u errors %u/%u polls %u\r\n",
+           sd_stats_cmd_total(st), st->cmds[CMD17], st->cmds[CMD18], st->cmds[CMD24], st->cmds[CMD25],
+           st->cmds[CMD12], st->cmds[CMD13], st->blocks_read, st->blocks_written,
+           st->cmd_errors, st->xfer_errors, st->busy_polls);
+}
+
+// Totals for the run so far, then the cost of one 1-byte append measured with snapshots
+static void io_report(struct fat32_fs_t *fs) {
+    struct fat32_stats_t f0, f1;
+    struct sd_stats_t s0, s1;
+    struct fat32_file_t file;
+
+    fat32_stats_snapshot(fs, &f0);
+    sd_stats_snapshot(&s0);
+    print_costs(&f0);
+    print_sd(&s0);
+
+    if (fat32_open(fs, "IOSTAT.TXT", &file) != 0 && fat32_create(fs, "IOSTAT.TXT", &file) != 0) return;
+    fat32_seek(fs, &file, file.size);
+    fat32_stats_snapshot(fs, &f0);
+    sd_stats_snapshot(&s0);
+    fat32_write(fs, &file, "!", 1);
+    fat32_close(fs, &file);
+    fat32_stats_snapshot(fs, &f1);
+    sd_stats_snapshot(&s1);
+
+    fat32_stats_diff(&f1, &f1, &f0);
+    sd_stats_diff(&s1, &s1, &s0);
+    printf("1-byte append + close:\r\n");
+    print_costs(&f1);
+    print_sd(&s1);
+}
+#endif
 
 // --- Main Test Suite ---
 
 int main(void) {
+    struct blkdev_t sd;
+    struct blkdev_t *dev = &sd;
     struct fat32_fs_t fs;
     struct fat32_file_t file;
     int res;
 
     // Aligned buffers are mandatory for DMA/Cache consistency
-    uint8_t buf_read[512] __attribute__((aligned(32)));
-    uint8_t buf_write[1024] __attribute__((aligned(32)));
+    uint8_t buf_read[512] __attribute__((aligned(CACHE_LINE_SIZE)));
+    uint8_t buf_write[1024] __attribute__((aligned(CACHE_LINE_SIZE)));
+
+#ifdef PROFILE
+    prof_init();
+#endif
+#ifdef TRACE
+    trace_init();
+#endif
+#ifdef SMP
+    printf("SMP: %u cores online\r\n", smp_init());
+#endif
+    sd_blkdev_init(&sd);
+#ifdef IO_CORE
+    // The I/O core owns the card from here on; everything below reaches it through the rings
+    static struct blkdev_t io_front;
+    if (io_core_start(&sd) == 0) {
+        io_blkdev_init(&io_front);
+        dev = &io_front;
+        printf("I/O core %u owns the SD card\r\n", IO_CORE_ID);
+    }
+#endif
+#ifdef STORAGE_BENCH
+    // Unattended benchmark run (tools/run_bench.sh) in place of the smoke test
+    return storage_bench(dev);
+#endif
 
     printf("\r\n=== FAT32 BARE-METAL TEST SUITE ===\r\n");
 
     // 1. Mount Filesystem
     printf("[1/4] Mounting FAT32...\r\n");
-    res = fat32_mount(&fs);
+    res = fat32_mount(&fs, dev);
     if (res != 0) {
         printf("FAIL: Mount error code %d\r\n", res);
         return -1;
     }
     printf("PASS: Mounted. Root Cluster: %u\r\n", fs.root_cluster);
 
-    // 2. Read Test (HELLO_~1.TXT)
-    // Note: We use the 8.3 Short Name alias for "hello_world.txt"
-    printf("[2/4] Reading HELLO_~1.TXT...\r\n");
+    // 2. Read Test (hello_world.txt, found through its long file name)
+    printf("[2/4] Reading hello_world.txt...\r\n");
     
-    res = fat32_open(&fs, "HELLO_~1.TXT", &file);
+    res = fat32_open(&fs, "hello_world.txt", &file);
     if (res == 0) {
         printf("PASS: File Open. Size: %u bytes\r\n", file.size);
         
@@ -53,7 +163,7 @@ int main(void) {
         }
         fat32_close(&fs, &file);
     } else {
-        printf("WARN: HELLO_~1.TXT not found (Code %d). Skipping Read Test.\r\n", res);
+        printf("WARN: hello_world.txt not found (Code %d). Skipping Read Test.\r\n", res);
     }
 
     // 3. Write Test (WRITE.TXT)
@@ -79,6 +189,7 @@ int main(void) {
         printf("PASS: File closed and FAT updated.\r\n");
     } else {
         printf("FAIL: Could not open/create WRITE.TXT (Code %d)\r\n", res);
+        fat32_unmount(&fs);
         return -1;
     }
 
@@ -87,6 +198,7 @@ int main(void) {
     res = fat32_open(&fs, "WRITE.TXT", &file);
     if (res != 0) {
         printf("FAIL: Could not re-open WRITE.TXT\r\n");
+        fat32_unmount(&fs);
         return -1;
     }
 
@@ -110,6 +222,54 @@ int main(void) {
         printf("PASS: Sector 2 Data Verified.\r\n");
     }
 
+    // Whole-file CRC, streamed from the card without a second copy in RAM
+    uint32_t crc;
+    if (fat32_checksum(&fs, &file, &crc) != 0) {
+        printf("FAIL: Checksum read error\r\n");
+    } else if (crc != crc32_update(0, buf_write, 1024)) {
+        printf("FAIL: CRC32 %x does not match %x\r\n", crc, crc32_update(0, buf_write, 1024));
+    } else {
+        printf("PASS: CRC32 %x verified.\r\n", crc);
+    }
+
     fat32_close(&fs, &file);
+#ifdef IO_STATS
+    printf("=== I/O ACCOUNTING ===\r\n");
+    io_report(&fs);
+#endif
+    fat32_unmount(&fs);
+
+#ifdef PROFILE
+    printf("=== PROFILE ===\r\n");
+    prof_report();
+#endif
+#ifdef TRACE
+    // Decode the capture with tools/trace_decode.py
+    trace_dump();
+#endif
+
+#ifdef DIV_BENCH
+    printf("=== DIVIDE BENCHMARK ===\r\n");
+    div_bench();
+#endif
+
+#ifdef STRING_BENCH
+    // memcpy/memset/memcmp against the byte loops
+    printf("=== STRING BENCHMARK ===\r\n");
+    string_selftest();
+    string_bench();
+#endif
+
+#ifdef SMP_BENCH
+    // Work-stealing pool against core 0 alone (needs -DSMP)
+    printf("=== SMP BENCHMARK ===\r\n");
+    smp_bench();
+#endif
+
+#ifdef MALLOC_STATS
+    // Heap allocation patterns and statistics
+    printf("=== HEAP BENCHMARK ===\r\n");
+    malloc_bench();
+#endif
     return 0;
 }
\ No newline at end of file
@@ -1,33 +1,100 @@
 /* malloc.c */
 #include <stddef.h>
+#include <stdint.h>
+#include "malloc.h"
+#include "cache.h"
 
+/* Alignment helper */
+#define ALIGN_UP(x, align) (((x) + ((align)-1)) & ~((align)-1))
+#define ALIGN_DOWN(x, align) ((x) & ~((align)-1))
 
+/*
+ * In the native build (-DHOSTED) the C library owns malloc/free/memalign and the
+ * linker-script regions do not exist; only the pools and arenas below are compiled.
+ * host/Makefile also builds the allocator itself (-DHOSTED_HEAP), under names that
+ * leave the C library's alone and over regions defined by the host program.
+ */
+#if !defined(HOSTED) || defined(HOSTED_HEAP)
 /* UEFI (Unified Extensible Firmware Interface) firmware that remain accessible after the operating system has booted */
 /* Heap boundaries - defined in linker script */
 extern unsigned char __heap_start[];
 extern unsigned char __heap_end[];
+/* Uncached DMA region, mapped non-cacheable by start.S */
+extern unsigned char __dma_start[];
+extern unsigned char __dma_end[];
+
+/*
+ * Segregated-fit allocator.
+ *
+ * Every chunk starts with a boundary tag: the size of the chunk below it (0 for the
+ * first one) and its own size, with CHUNK_INUSE in bit 0. Free chunks are kept on
+ * doubly linked per-class bins, so a neighbour can be unlinked in O(1) when coalescing:
+ *   - small bins hold exactly one chunk size each (below SMALL_LIMIT, 8-byte steps)
+ *   - large bins hold one power of two each ([512, 1K), [1K, 2K), ...)
+ * A bitmap of non-empty bins finds the smallest class that fits with a count-trailing-
+ * zeros per word. Everything above brkval is the top: it is carved by bumping brkval
+ * and grows back whenever the chunk just below it is freed.
+ */
+struct chunk_t {
+    size_t prev_size;           /* Size of the chunk below, 0 at __heap_start */
+    size_t size;                /* Size including this header, | CHUNK_INUSE */
+    struct chunk_t *nx;         /* Bin links, only valid while free */
+    struct chunk_t *pv;
+};
 
+#define CHUNK_INUSE     1
+#define CHUNK_HDR       (2 * sizeof(size_t))
+#define MIN_CHUNK       sizeof(struct chunk_t)
+
+#define SMALL_LIMIT     512
+#define SMALL_BINS      (SMALL_LIMIT / 8)
+#define LARGE_SHIFT     9               /* log2(SMALL_LIMIT) */
+#define NBINS           96
+#define LARGE_SCAN      8               /* Chunks tried in the request's own large class */
 
 /* Allocator state */
 static char *brkval = NULL;
+static size_t top_prev_size = 0;       /* Size of the chunk ending at brkval */
 static size_t malloc_margin = 1024; /* Conservative stack margin */
 
-struct freelist_t {
-    size_t sz;
-    struct freelist_t *nx;
-};
-
-static struct freelist_t *__freelist = NULL;
+static struct chunk_t *bins[NBINS];
+static unsigned int binmap[NBINS / 32];
 
-/* Alignment helper */
-#define ALIGN_UP(x, align) (((x) + ((align)-1)) & ~((align)-1))
-#define ALIGN_DOWN(x, align) ((x) & ~((align)-1))
+/* Instrumentation, compiled in with -DMALLOC_STATS */
+#ifdef MALLOC_STATS
+#include "uart.h"
+#include "pmu.h"
+static struct malloc_stats_t heap_stats;
+#define STAT(x) do { x; } while (0)
 
-/* Minimum allocation size (8-byte aligned) */
-#define MIN_ALLOC (ALIGN_UP(sizeof(struct freelist_t) - sizeof(size_t), 8))
+static void hist_add(unsigned int *hist, unsigned int cycles)
+{
+    unsigned int b = cycles ? 32 - __builtin_clz(cycles) : 0;
+    hist[b < MALLOC_HIST_BUCKETS ? b : MALLOC_HIST_BUCKETS - 1]++;
+}
+#else
+#define STAT(x) do { } while (0)
+#endif
+
+/* With secondary cores running (-DSMP) one lock covers the heap and the DMA map */
+#ifdef SMP
+#include "smp.h"
+static spinlock_t heap_lock;
+#define HEAP_LOCK()     spin_lock(&heap_lock)
+#define HEAP_UNLOCK()   spin_unlock(&heap_lock)
+#else
+#define HEAP_LOCK()     do { } while (0)
+#define HEAP_UNLOCK()   do { } while (0)
+#endif
 
 /* Stack pointer access */
-typedef unsigned int 			uintptr_t;
+#ifdef HOSTED
+/* The host stack is nowhere near the heap region; the frame address will do */
+static uintptr_t get_stack_pointer(void)
+{
+    return (uintptr_t)__builtin_frame_address(0);
+}
+#else
 __attribute__((optimize("Os"), naked))
 uintptr_t get_stack_pointer(void) {
      // __asm__ volatile("mrs %0, msp" : "=r" (sp));  // Main Stack Pointer
@@ -36,164 +103,299 @@ uintptr_t get_stack_pointer(void) {
         "bx lr\n"
     );
 }
+#endif
 
+#define chunk_size(c)   ((c)->size & ~(size_t)CHUNK_INUSE)
+#define chunk_at(p, n)  ((struct chunk_t *)((char *)(p) + (n)))
 
+static unsigned int bin_index(size_t sz)
+{
+    if (sz < SMALL_LIMIT)
+        return sz >> 3;
+    return SMALL_BINS + (31 - __builtin_clz((unsigned int)sz)) - LARGE_SHIFT;
+}
 
-void *malloc(size_t len)
+static void bin_insert(struct chunk_t *c)
+{
+    unsigned int idx = bin_index(chunk_size(c));
+    c->pv = NULL;
+    c->nx = bins[idx];
+    if (c->nx)
+        c->nx->pv = c;
+    bins[idx] = c;
+    binmap[idx >> 5] |= 1u << (idx & 31);
+    STAT(heap_stats.free_chunks++; heap_stats.free_bytes += chunk_size(c));
+}
+
+static void bin_remove(struct chunk_t *c)
+{
+    unsigned int idx = bin_index(chunk_size(c));
+    if (c->pv)
+        c->pv->nx = c->nx;
+    else if ((bins[idx] = c->nx) == NULL)
+        binmap[idx >> 5] &= ~(1u << (idx & 31));
+    if (c->nx)
+        c->nx->pv = c->pv;
+    STAT(heap_stats.free_chunks--; heap_stats.free_bytes -= chunk_size(c));
+}
+
+/* First non-empty bin at or above idx, or -1 */
+static int bin_find(unsigned int idx)
+{
+    for (unsigned int w = idx >> 5; w < NBINS / 32; w++) {
+        unsigned int m = binmap[w];
+        if (w == (idx >> 5))
+            m &= ~0u << (idx & 31);
+        if (m)
+            return (w << 5) + __builtin_ctz(m);
+    }
+    return -1;
+}
+
+/* Record c's size in the boundary tag of whatever follows it */
+static void set_next_prev(struct chunk_t *c, size_t sz)
+{
+    struct chunk_t *next = chunk_at(c, sz);
+    if ((char *)next == brkval)
+        top_prev_size = sz;
+    else
+        next->prev_size = sz;
+}
+
+/* Give back everything past the first 'need' bytes of an in-use chunk */
+static void chunk_trim(struct chunk_t *c, size_t need)
 {
-    struct freelist_t *fp1, *fp2, *sfp1, *sfp2;
-    char *cp;
-    size_t s, avail;
+    size_t sz = chunk_size(c);
+    if (sz - need < MIN_CHUNK)
+        return;
+
+    struct chunk_t *rest = chunk_at(c, need);
+    struct chunk_t *next = chunk_at(c, sz);
+    size_t rest_sz = sz - need;
+    c->size = need | CHUNK_INUSE;
+    rest->prev_size = need;
+
+    if ((char *)next == brkval) {
+        /* Tail borders the top, hand it straight back */
+        brkval = (char *)rest;
+        top_prev_size = need;
+        return;
+    }
+    if (!(next->size & CHUNK_INUSE)) {
+        bin_remove(next);
+        rest_sz += chunk_size(next);
+    }
+    rest->size = rest_sz;
+    set_next_prev(rest, rest_sz);
+    bin_insert(rest);
+}
+
+/*
+ * Highest address the top may reach: the heap end, or malloc_margin below the stack.
+ * Secondary core stacks sit below the heap and do not limit it
+ */
+static char *heap_limit(void)
+{
+    uintptr_t sp = (uintptr_t)get_stack_pointer();
+    char *stack_limit = (char *)(sp - malloc_margin);
+    if (sp < (uintptr_t)__heap_start)
+        return (char *)__heap_end;
+    return ((uintptr_t)stack_limit < (uintptr_t)__heap_end) ? stack_limit : (char *)__heap_end;
+}
+
+/* Bytes the top can still hand out */
+static size_t top_avail(void)
+{
+    char *limit = heap_limit();
+    return (brkval < limit) ? (size_t)(limit - brkval) : 0;
+}
+
+/* Chunk size for a request of len bytes, 0 on overflow */
+static size_t request_size(size_t len)
+{
+    size_t need = ALIGN_UP(len + CHUNK_HDR, 8);
+    if (need < len)
+        return 0;
+    return (need < MIN_CHUNK) ? MIN_CHUNK : need;
+}
+
+static void heap_init(void)
+{
+    brkval = (char *)__heap_start;
+    top_prev_size = 0;
+    for (unsigned int i = 0; i < NBINS; i++)
+        bins[i] = NULL;
+    for (unsigned int i = 0; i < NBINS / 32; i++)
+        binmap[i] = 0;
+}
+
+static void *heap_alloc(size_t len)
+{
+    struct chunk_t *c = NULL;
+    size_t need;
 
     /* Handle zero-size allocation */
     if (len == 0)
         return NULL;
 
-    /* Ensure minimum size and alignment */
-    len = ALIGN_UP(len < MIN_ALLOC ? MIN_ALLOC : len, 8);
+    /* Initialize heap if first allocation */
+    if (brkval == NULL)
+        heap_init();
 
-    /* First-fit search */
-    for (s = 0, fp1 = __freelist, fp2 = NULL;   fp1;    fp2 = fp1, fp1 = fp1->nx) {
-        if (fp1->sz < len)
-            continue;
-        
-        if (fp1->sz == len) {
-            /* Exact match */
-            if (fp2)
-                fp2->nx = fp1->nx;
-            else
-                __freelist = fp1->nx;
-            return &(fp1->nx);
-        } else {
-            /* Potential split candidate */
-            if (s == 0 || fp1->sz < s) {
-                s = fp1->sz;
-                sfp1 = fp1;
-                sfp2 = fp2;
+    /* Header plus payload, 8-byte aligned */
+    need = request_size(len);
+    if (need == 0)
+        return NULL;
+
+    unsigned int idx = bin_index(need);
+    int b;
+    if (idx < SMALL_BINS) {
+        /* Exact class, or anything bigger */
+        b = bin_find(idx);
+    } else {
+        /* Every chunk of a higher class fits, the request's own class needs a look */
+        b = bin_find(idx + 1);
+        if (b < 0) {
+            struct chunk_t *fp = bins[idx];
+            for (int n = 0; fp && n < LARGE_SCAN; fp = fp->nx, n++) {
+                if (chunk_size(fp) >= need) {
+                    c = fp;
+                    break;
+                }
             }
         }
     }
-
-    /* Split existing chunk if suitable */
-    if (s) {
-        if (s - len < sizeof(struct freelist_t)) {
-            /* Too small to split */
-            if (sfp2)
-                sfp2->nx = sfp1->nx;
-            else
-                __freelist = sfp1->nx;
-            return &(sfp1->nx);
-        }
-
-        /* Split the chunk */
-        cp = (char *)sfp1;
-        s -= len;
-        cp += s;
-        sfp2 = (struct freelist_t *)cp;
-        sfp2->sz = len;
-        sfp1->sz = s - sizeof(size_t);
-        return &(sfp2->nx);
+    if (c == NULL && b >= 0)
+        c = bins[b];
+
+    if (c) {
+        bin_remove(c);
+        c->size |= CHUNK_INUSE;
+        chunk_trim(c, need);
+        return &c->nx;
     }
 
-    /* Initialize heap if first allocation */
-    if(brkval == NULL)
-        brkval = (char *)__heap_start;
-
-    /* Calculate available memory */
-    uintptr_t sp = (uintptr_t)get_stack_pointer();
-    char *stack_limit = (char *)(sp - malloc_margin);
-    char *heap_limit = ((uintptr_t)stack_limit < (uintptr_t)__heap_end) ? stack_limit : (char *)__heap_end;
-
-    avail = heap_limit - brkval;
-    
-    /* Check if we have enough space */
-    if (avail >= len + sizeof(size_t)) {
-        fp1 = (struct freelist_t *)brkval;
-        brkval += len + sizeof(size_t);
-        fp1->sz = len;
-        return &(fp1->nx);
+    /* Carve from the top */
+    if (top_avail() < need) {
+        /* Out of memory: say whether free space, the stack margin or the heap ran out */
+#ifdef MALLOC_STATS
+        if (heap_stats.free_bytes + top_avail() >= need)
+            heap_stats.fail_fragmented++;
+        else if (heap_limit() != (char *)__heap_end)
+            heap_stats.fail_stack_margin++;
+        else
+            heap_stats.fail_heap_end++;
+#endif
+        return NULL;
     }
 
-    return NULL; /* Out of memory */
+    c = (struct chunk_t *)brkval;
+    c->prev_size = top_prev_size;
+    c->size = need | CHUNK_INUSE;
+    brkval += need;
+    top_prev_size = need;
+    return &c->nx;
 }
 
-void free(void *p)
+static void heap_free(void *p)
 {
-    struct freelist_t *fp1, *fp2, *fpnew;
-    char *cp1, *cpnew;
+    struct chunk_t *c, *next, *prev;
+    size_t sz;
 
     if (p == NULL)
         return;
 
-    cpnew = (char *)p - sizeof(size_t);
-    fpnew = (struct freelist_t *)cpnew;
-    fpnew->nx = NULL;
-
-    /* Try to coalesce with top of heap */
-    if ((char *)p + fpnew->sz == brkval) {
-        brkval = cpnew;
-        if (__freelist == NULL)
-            return;
-            
-        /* Find new top-most chunk */
-        for (fp1 = __freelist, fp2 = NULL; fp1->nx; fp2 = fp1, fp1 = fp1->nx);
-        
-        cp1 = (char *)&(fp1->nx);
-        if (cp1 + fp1->sz == brkval) {
-            if (fp2 == NULL)
-                __freelist = NULL;
-            else
-                fp2->nx = NULL;
-            brkval = cp1 - sizeof(size_t);
+    c = (struct chunk_t *)((char *)p - CHUNK_HDR);
+    sz = chunk_size(c);
+
+    /* Coalesce with a free chunk above */
+    next = chunk_at(c, sz);
+    if ((char *)next != brkval && !(next->size & CHUNK_INUSE)) {
+        bin_remove(next);
+        sz += chunk_size(next);
+    }
+
+    /* Coalesce with a free chunk below */
+    if (c->prev_size != 0) {
+        prev = (struct chunk_t *)((char *)c - c->prev_size);
+        if (!(prev->size & CHUNK_INUSE)) {
+            bin_remove(prev);
+            sz += chunk_size(prev);
+            c = prev;
         }
-        return;
     }
 
-    /* Insert into free list */
-    if (__freelist == NULL) {
-        __freelist = fpnew;
+    /* Chunk below the top folds back into it */
+    if ((char *)c + sz == brkval) {
+        brkval = (char *)c;
+        top_prev_size = c->prev_size;
         return;
     }
 
-    /* Find insertion point */
-    for (fp1 = __freelist, fp2 = NULL; fp1; fp2 = fp1, fp1 = fp1->nx) {
-        if (fp1 < fpnew)
-            continue;
-            
-        fpnew->nx = fp1;
-        /* Try to merge with next chunk */
-        if ((char *)&(fpnew->nx) + fpnew->sz == (char *)fp1) {
-            fpnew->sz += fp1->sz + sizeof(size_t);
-            fpnew->nx = fp1->nx;
-        }
-        
-        if (fp2 == NULL) {
-            __freelist = fpnew;
-            return;
-        }
-        break;
-    }
+    c->size = sz;
+    set_next_prev(c, sz);
+    bin_insert(c);
+}
 
-    /* Insert and try to merge with previous chunk */
-    fp2->nx = fpnew;
-    cp1 = (char *)&(fp2->nx);
-    if (cp1 + fp2->sz == (char *)fpnew) {
-        fp2->sz += fpnew->sz + sizeof(size_t);
-        fp2->nx = fpnew->nx;
+#ifdef MALLOC_STATS
+static void stat_alloc(void *p, unsigned int t0)
+{
+    hist_add(heap_stats.malloc_hist, pmu_cycles() - t0);
+    heap_stats.mallocs++;
+    if (p == NULL) {
+        heap_stats.failed++;
+        return;
     }
+    heap_stats.in_use += chunk_size((struct chunk_t *)((char *)p - CHUNK_HDR));
+    if (heap_stats.in_use > heap_stats.peak)
+        heap_stats.peak = heap_stats.in_use;
+}
+#endif
+
+void *malloc(size_t len)
+{
+    void *p;
+
+    HEAP_LOCK();
+#ifdef MALLOC_STATS
+    unsigned int t0 = pmu_cycles();
+    p = heap_alloc(len);
+    stat_alloc(p, t0);
+#else
+    p = heap_alloc(len);
+#endif
+    HEAP_UNLOCK();
+    return p;
+}
+
+void free(void *p)
+{
+#ifdef MALLOC_STATS
+    if (p == NULL)
+        return;
+    HEAP_LOCK();
+    unsigned int t0 = pmu_cycles();
+    heap_stats.in_use -= chunk_size((struct chunk_t *)((char *)p - CHUNK_HDR));
+    heap_stats.frees++;
+    heap_free(p);
+    hist_add(heap_stats.free_hist, pmu_cycles() - t0);
+    HEAP_UNLOCK();
+#else
+    HEAP_LOCK();
+    heap_free(p);
+    HEAP_UNLOCK();
+#endif
 }
 
 /* Additional helper functions */
 void *calloc(size_t nmemb, size_t size)
 {
     size_t total = nmemb * size;
+    if (size != 0 && total / size != nmemb)
+        return NULL;
     void *p = malloc(total);
-    if (p) {
-        /* Simple memset implementation */
-        char *cp = p;
-        while (total--)
-            *cp++ = 0;
-    }
+    if (p)
+        memset(p, 0, total);
     return p;
 }
 
@@ -206,53 +408,452 @@ void *calloc(size_t nmemb, size_t size)
 //     return p;
 // }
 
+/* Copy a payload a word at a time; chunks are 8-byte aligned and sized */
+static void copy_words(void *dst, const void *src, size_t n)
+{
+    size_t *d = dst;
+    const size_t *sp = src;
+    for (n /= sizeof(size_t); n; n--)
+        *d++ = *sp++;
+}
+
+/* Resize in place: trim the tail, or grow into a free successor or the top. 0 if it can't */
+static int heap_resize(struct chunk_t *c, size_t need)
+{
+    size_t sz = chunk_size(c);
+    struct chunk_t *next = chunk_at(c, sz);
+
+    if (need <= sz) {
+        chunk_trim(c, need);
+        return 1;
+    }
+
+    if ((char *)next == brkval) {
+        if (top_avail() < need - sz)
+            return 0;
+        c->size = need | CHUNK_INUSE;
+        brkval = (char *)c + need;
+        top_prev_size = need;
+        return 1;
+    }
+
+    if (!(next->size & CHUNK_INUSE) && sz + chunk_size(next) >= need) {
+        bin_remove(next);
+        sz += chunk_size(next);
+        c->size = sz | CHUNK_INUSE;
+        set_next_prev(c, sz);
+        chunk_trim(c, need);
+        return 1;
+    }
+    return 0;
+}
+
 void *realloc(void *ptr, size_t size)
 {
     /* C standard requirement */
     if (ptr == NULL)
         return malloc(size);
-    
+
     if (size == 0) {
         free(ptr);
         return NULL;
     }
-    
-    /* Get original block size */
-    struct freelist_t *fp = (struct freelist_t *)((char *)ptr - sizeof(size_t));
-    size_t old_size = fp->sz;
-    
-    /* Allocate new block */
+
+    struct chunk_t *c = (struct chunk_t *)((char *)ptr - CHUNK_HDR);
+    size_t old_size = chunk_size(c);
+    size_t need = request_size(size);
+    if (need == 0)
+        return NULL;
+
+    HEAP_LOCK();
+    int resized = heap_resize(c, need);
+    if (resized)
+        STAT(heap_stats.in_use += chunk_size(c) - old_size;
+             if (heap_stats.in_use > heap_stats.peak) heap_stats.peak = heap_stats.in_use);
+    HEAP_UNLOCK();
+    if (resized)
+        return ptr;
+
+    /* Move it */
     void *new_ptr = malloc(size);
     if (new_ptr == NULL)
         return NULL;
-    
-    /* Copy data */
-    size_t copy_size = old_size < size ? old_size : size;
-    char *src = ptr;
-    char *dst = new_ptr;
-    while (copy_size--)
-        *dst++ = *src++;
-    
+    copy_words(new_ptr, ptr, old_size - CHUNK_HDR);
     free(ptr);
     return new_ptr;
 }
 
+static void *heap_memalign(size_t alignment, size_t len)
+{
+    struct chunk_t *c, *nc;
+    size_t need, lead;
 
-void malloc_init(void)
+    if (alignment <= 8)
+        return heap_alloc(len);
+    if (alignment & (alignment - 1))
+        return NULL; /* Not a power of two */
+
+    need = request_size(len);
+    if (need == 0)
+        return NULL;
+
+    /* Room to slide the payload up to the boundary, leaving a whole chunk in front */
+    char *p = heap_alloc(need + alignment + MIN_CHUNK);
+    if (p == NULL)
+        return NULL;
+    c = (struct chunk_t *)(p - CHUNK_HDR);
+
+    if (((uintptr_t)p & (alignment - 1)) == 0) {
+        chunk_trim(c, need);
+        return p;
+    }
+
+    char *aligned = (char *)ALIGN_UP((uintptr_t)p + MIN_CHUNK, alignment);
+    lead = aligned - p;
+    size_t sz = chunk_size(c);
+
+    /* Split off the lead in use, then free it so it coalesces and lands in its bin */
+    nc = chunk_at(c, lead);
+    nc->prev_size = lead;
+    nc->size = (sz - lead) | CHUNK_INUSE;
+    set_next_prev(nc, sz - lead);
+    c->size = lead | CHUNK_INUSE;
+    heap_free(p);
+
+    chunk_trim(nc, need);
+    return aligned;
+}
+
+void *memalign(size_t alignment, size_t len)
 {
-    /* Initialize heap pointer */
-    brkval = (char *)__heap_start;
-    __freelist = NULL;
-    
-    /* Optionally create one big free block covering entire heap */
-    size_t heap_size = __heap_end - __heap_start;
-    if (heap_size > sizeof(struct freelist_t)) {
-        struct freelist_t *initial_block = (struct freelist_t *)__heap_start;
-        initial_block->sz = heap_size - sizeof(size_t);
-        initial_block->nx = NULL;
-        __freelist = initial_block;
+    void *p;
+
+    HEAP_LOCK();
+#ifdef MALLOC_STATS
+    unsigned int t0 = pmu_cycles();
+    p = heap_memalign(alignment, len);
+    stat_alloc(p, t0);
+#else
+    p = heap_memalign(alignment, len);
+#endif
+    HEAP_UNLOCK();
+    return p;
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    return memalign(alignment, size);
+}
+#endif /* !HOSTED || HOSTED_HEAP */
+
+/*
+ * Fixed-size block pool. One cache-line aligned slab carved into blocks padded to
+ * whole lines, so cache maintenance on a block never touches its neighbours. Free
+ * blocks are chained through their first word: alloc and free are a pop and a push.
+ */
+int pool_init(struct mem_pool_t *pool, size_t block_size, unsigned int count)
+{
+    pool->block_size = CACHE_ALIGN_UP(block_size);
+    pool->total = count;
+    pool->in_use = 0;
+    pool->free_list = NULL;
+    pool->slab = memalign(CACHE_LINE_SIZE, pool->block_size * count);
+    if (pool->slab == NULL)
+        return -1;
+
+    char *b = (char *)pool->slab + pool->block_size * count;
+    while (count--) {
+        b -= pool->block_size;
+        *(void **)b = pool->free_list;
+        pool->free_list = b;
+    }
+    return 0;
+}
+
+void *pool_alloc(struct mem_pool_t *pool)
+{
+    void *b = pool->free_list;
+    if (b == NULL)
+        return NULL;
+    pool->free_list = *(void **)b;
+    pool->in_use++;
+    return b;
+}
+
+void pool_free(struct mem_pool_t *pool, void *block)
+{
+    if (block == NULL)
+        return;
+    *(void **)block = pool->free_list;
+    pool->free_list = block;
+    pool->in_use--;
+}
+
+void pool_destroy(struct mem_pool_t *pool)
+{
+    free(pool->slab);
+    pool->slab = NULL;
+    pool->free_list = NULL;
+    pool->total = 0;
+    pool->in_use = 0;
+}
+
+#ifdef MALLOC_STATS
+void malloc_stats_reset(void)
+{
+    /* Enable and zero the cycle counter */
+    pmu_enable();
+
+    /* Keep what describes the heap itself, drop the counters */
+    heap_stats.peak = heap_stats.in_use;
+    heap_stats.mallocs = heap_stats.frees = heap_stats.failed = 0;
+    heap_stats.fail_fragmented = heap_stats.fail_stack_margin = heap_stats.fail_heap_end = 0;
+    for (int i = 0; i < MALLOC_HIST_BUCKETS; i++)
+        heap_stats.malloc_hist[i] = heap_stats.free_hist[i] = 0;
+}
+
+void malloc_get_stats(struct malloc_stats_t *st)
+{
+    *st = heap_stats;
+
+    /* Largest free block: the top, or a chunk in the highest non-empty bin */
+    st->top = brkval ? top_avail() : 0;
+    st->largest_free = st->top;
+    for (int b = NBINS - 1; b >= 0; b--) {
+        if (bins[b] == NULL)
+            continue;
+        for (struct chunk_t *c = bins[b]; c; c = c->nx) {
+            if (chunk_size(c) > st->largest_free)
+                st->largest_free = chunk_size(c);
+        }
+        break;
+    }
+
+    /* Share of free memory unusable for a single request of the largest size */
+    size_t total_free = st->free_bytes + st->top;
+    st->fragmentation = total_free ? 100 - (unsigned int)((uint64_t)st->largest_free * 100 / total_free) : 0;
+}
+
+static void print_hist(const char *name, const unsigned int *hist)
+{
+    printf("%s cycles:", name);
+    for (int i = 0; i < MALLOC_HIST_BUCKETS; i++) {
+        if (hist[i])
+            printf(" <%u:%u", 1u << i, hist[i]);
+    }
+    printf("\r\n");
+}
+
+void malloc_stats(void)
+{
+    struct malloc_stats_t st;
+    malloc_get_stats(&st);
+
+    printf("heap: in use %u B, peak %u B, top %u B\r\n",
+           (unsigned)st.in_use, (unsigned)st.peak, (unsigned)st.top);
+    printf("free: %u chunks, %u B, largest %u B, fragmentation %u%%\r\n",
+           st.free_chunks, (unsigned)st.free_bytes, (unsigned)st.largest_free, st.fragmentation);
+    printf("calls: malloc %u, free %u, failed %u (fragmented %u, stack margin %u, heap end %u)\r\n",
+           st.mallocs, st.frees, st.failed, st.fail_fragmented, st.fail_stack_margin, st.fail_heap_end);
+    print_hist("malloc", st.malloc_hist);
+    print_hist("free", st.free_hist);
+}
+
+/* Allocation-pattern microbenchmark: cycles per operation for common shapes of use */
+void malloc_bench(void)
+{
+    static void *slot[256];
+    unsigned int seed = 12345;
+    unsigned int t0, n;
+
+    malloc_stats_reset();
+
+    /* 1. LIFO: a burst of small objects released in reverse */
+    t0 = pmu_cycles();
+    for (n = 0; n < 256; n++)
+        slot[n] = malloc(32 + (n & 7) * 8);
+    for (n = 256; n-- > 0;)
+        free(slot[n]);
+    printf("lifo 32-88 B:      %u cycles/op\r\n", (pmu_cycles() - t0) / 512);
+
+    /* 2. Churn: random sizes replacing random live objects (sector and cluster buffers mixed in) */
+    for (n = 0; n < 256; n++)
+        slot[n] = NULL;
+    t0 = pmu_cycles();
+    for (n = 0; n < 4096; n++) {
+        seed = seed * 1103515245 + 12345;
+        unsigned int i = (seed >> 16) & 255;
+        unsigned int r = (seed >> 8) & 7;
+        size_t sz = (r < 5) ? 16 + (seed & 0xF8) : (r < 7) ? 512 : 4096;
+        free(slot[i]);
+        slot[i] = malloc(sz);
+    }
+    printf("churn 16-4096 B:   %u cycles/op\r\n", (pmu_cycles() - t0) / 8192);
+    for (n = 0; n < 256; n++)
+        free(slot[n]);
+
+    /* 3. Growth: buffers extended in small steps, as directory listings and log records do */
+    t0 = pmu_cycles();
+    for (n = 0; n < 16; n++) {
+        void *p = NULL;
+        for (size_t sz = 64; sz <= 8192; sz += 64)
+            p = realloc(p, sz);
+        slot[n] = p;
+    }
+    printf("realloc 64->8K:    %u cycles/op\r\n", (pmu_cycles() - t0) / (16 * 128));
+    for (n = 0; n < 16; n++)
+        free(slot[n]);
+
+    malloc_stats();
+}
+#endif
+
+/*
+ * Arena. Blocks come from memalign and are chained newest first; allocation bumps a
+ * pointer through the head block. A mark records (block, ptr), releasing to it frees
+ * every newer block, so nested checkpoints unwind in LIFO order and a reset returns
+ * the whole arena to the heap in one pass over its blocks, not its objects.
+ */
+void arena_init(struct arena_t *a, size_t block_size)
+{
+    a->head = NULL;
+    a->ptr = NULL;
+    a->end = NULL;
+    a->block_size = block_size;
+}
+
+void *arena_alloc_aligned(struct arena_t *a, size_t size, size_t alignment)
+{
+    if (alignment < 8)
+        alignment = 8;
+
+    char *p = (char *)ALIGN_UP((uintptr_t)a->ptr, alignment);
+    if (a->head == NULL || p > a->end || (size_t)(a->end - p) < size) {
+        /* Start a new block; oversized requests get one of their own */
+        size_t hdr = ALIGN_UP(sizeof(struct arena_block_t), 8);
+        size_t bsize = a->block_size;
+        if (bsize < hdr + alignment + size)
+            bsize = ALIGN_UP(hdr + alignment + size, 8);
+
+        struct arena_block_t *blk = memalign(CACHE_LINE_SIZE, bsize);
+        if (blk == NULL)
+            return NULL;
+        blk->prev = a->head;
+        blk->size = bsize;
+        a->head = blk;
+        a->ptr = (char *)blk + hdr;
+        a->end = (char *)blk + bsize;
+        p = (char *)ALIGN_UP((uintptr_t)a->ptr, alignment);
     }
-    
+    a->ptr = p + size;
+    return p;
+}
+
+void *arena_alloc(struct arena_t *a, size_t size)
+{
+    return arena_alloc_aligned(a, size, 8);
+}
+
+struct arena_mark_t arena_mark(struct arena_t *a)
+{
+    struct arena_mark_t m = { a->head, a->ptr };
+    return m;
+}
+
+void arena_release(struct arena_t *a, struct arena_mark_t mark)
+{
+    while (a->head != mark.block) {
+        struct arena_block_t *prev = a->head->prev;
+        free(a->head);
+        a->head = prev;
+    }
+    a->ptr = mark.ptr;
+    a->end = a->head ? (char *)a->head + a->head->size : NULL;
+}
+
+void arena_reset(struct arena_t *a)
+{
+    struct arena_mark_t none = { NULL, NULL };
+    arena_release(a, none);
+}
+
+#if !defined(HOSTED) || defined(HOSTED_HEAP)
+/*
+ * DMA region allocator. The region is mapped non-cacheable, so a buffer from here
+ * can be handed to a bus master with no cache maintenance at all. Space is handed out
+ * in whole granules, first fit over a bitmap; the run length is kept at the first
+ * granule so dma_free needs only the pointer. Meant for long-lived rings and bounce
+ * buffers, not for general allocation.
+ */
+#define DMA_MAX_GRANULES 2048           /* 1 MB of 512-byte granules */
+
+static unsigned int dma_map[DMA_MAX_GRANULES / 32];    /* Bit set: granule in use */
+static unsigned short dma_run[DMA_MAX_GRANULES];       /* Granules, at the first of each block */
+static unsigned int dma_granules;
+
+static void dma_init(void)
+{
+    dma_granules = (unsigned int)(__dma_end - __dma_start) / DMA_GRANULE;
+    if (dma_granules > DMA_MAX_GRANULES)
+        dma_granules = DMA_MAX_GRANULES;
+    memset(dma_map, 0, sizeof(dma_map));
+}
+
+#define dma_used(i) (dma_map[(i) / 32] & (1u << ((i) % 32)))
+
+void *dma_alloc(size_t size)
+{
+    unsigned int need = (unsigned int)((size + DMA_GRANULE - 1) / DMA_GRANULE);
+    unsigned int run = 0;
+
+    if (need == 0)
+        need = 1;
+    HEAP_LOCK();
+    for (unsigned int i = 0; i < dma_granules; i++) {
+        if (dma_used(i)) {
+            run = 0;
+            continue;
+        }
+        if (++run < need)
+            continue;
+
+        unsigned int first = i + 1 - need;
+        for (unsigned int g = first; g <= i; g++)
+            dma_map[g / 32] |= 1u << (g % 32);
+        dma_run[first] = (unsigned short)need;
+        HEAP_UNLOCK();
+        return __dma_start + first * DMA_GRANULE;
+    }
+    HEAP_UNLOCK();
+    return NULL;
+}
+
+void dma_free(void *ptr)
+{
+    if (ptr == NULL)
+        return;
+
+    unsigned int first = (unsigned int)((unsigned char *)ptr - __dma_start) / DMA_GRANULE;
+    HEAP_LOCK();
+    for (unsigned int g = first; g < first + dma_run[first]; g++)
+        dma_map[g / 32] &= ~(1u << (g % 32));
+    HEAP_UNLOCK();
+}
+
+
+void malloc_init(void)
+{
+    /* Empty bins, the whole heap is top */
+#ifdef SMP
+    spin_init(&heap_lock);
+#endif
+    heap_init();
+    dma_init();
+#ifdef MALLOC_STATS
+    heap_stats = (struct malloc_stats_t){ 0 };
+#endif
+
     /* Set conservative stack margin (adjust based on your needs) */
     malloc_margin = 1024; /* 1KB safety margin */
-}
\ No newline at end of file
+}
+#endif /* !HOSTED || HOSTED_HEAP */
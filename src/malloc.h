@@ -10,7 +10,7 @@ extern "C" {
 // #define NULL ((void*)0)
 
 extern void *memset(void *dest, int value, size_t len);
-extern void *memcpy(void *dest, const void *src, unsigned len);
+extern void *memcpy(void *dest, const void *src, size_t len);
 // extern int strcmp(const char *s1, const char *s2);
 // extern int strncmp(const char *s1, const char *s2, size_t len);
 
@@ -18,10 +18,83 @@ void *malloc(size_t size);
 void free(void *ptr);
 void *calloc(size_t nmemb, size_t size);
 void *realloc(void *ptr, size_t size);
+void *memalign(size_t alignment, size_t size);
+void *aligned_alloc(size_t alignment, size_t size);
+
+// Fixed-size block pool (cache-line aligned, size padded to whole lines, O(1) alloc/free)
+struct mem_pool_t {
+    void *free_list;
+    void *slab;
+    size_t block_size;
+    unsigned int total;
+    unsigned int in_use;
+};
+
+int pool_init(struct mem_pool_t *pool, size_t block_size, unsigned int count);
+void *pool_alloc(struct mem_pool_t *pool);
+void pool_free(struct mem_pool_t *pool, void *block);
+void pool_destroy(struct mem_pool_t *pool);
+
+// Arena: bump allocation from heap blocks, rolled back to a mark or released all at once
+struct arena_block_t {
+    struct arena_block_t *prev;
+    size_t size;
+};
+
+struct arena_t {
+    struct arena_block_t *head; // Block being carved, newest first
+    char *ptr;
+    char *end;
+    size_t block_size;          // Default size of a new block
+};
+
+struct arena_mark_t {
+    struct arena_block_t *block;
+    char *ptr;
+};
+
+void arena_init(struct arena_t *a, size_t block_size);
+void *arena_alloc(struct arena_t *a, size_t size);
+void *arena_alloc_aligned(struct arena_t *a, size_t size, size_t alignment);
+struct arena_mark_t arena_mark(struct arena_t *a);
+void arena_release(struct arena_t *a, struct arena_mark_t mark);
+void arena_reset(struct arena_t *a);
+
+// Uncached DMA region (memlayout.ld): granule-aligned blocks that need no cache maintenance
+#define DMA_GRANULE 512
+
+void *dma_alloc(size_t size);
+void dma_free(void *ptr);
 
 
 void malloc_init(void);
 
+// Heap instrumentation, built with -DMALLOC_STATS
+#ifdef MALLOC_STATS
+#define MALLOC_HIST_BUCKETS 16  // Bucket i counts calls taking under 2^i cycles
+
+struct malloc_stats_t {
+    size_t in_use;              // Bytes in allocated chunks, headers included
+    size_t peak;
+    size_t top;                 // Untouched space above the last chunk
+    size_t free_bytes;          // Bytes in binned free chunks
+    size_t largest_free;        // Largest single free block, top included
+    unsigned int free_chunks;   // Free-list length over all bins
+    unsigned int fragmentation; // Percent of free memory outside the largest block
+    unsigned int mallocs, frees, failed;
+    unsigned int fail_fragmented;   // Enough free bytes in total, none big enough
+    unsigned int fail_stack_margin; // Stopped by malloc_margin below the stack pointer
+    unsigned int fail_heap_end;     // Heap genuinely exhausted
+    unsigned int malloc_hist[MALLOC_HIST_BUCKETS];
+    unsigned int free_hist[MALLOC_HIST_BUCKETS];
+};
+
+void malloc_stats_reset(void);
+void malloc_get_stats(struct malloc_stats_t *st);
+void malloc_stats(void);
+void malloc_bench(void);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
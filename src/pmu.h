@@ -0,0 +1,69 @@
+#ifndef PMU_H
+#define PMU_H
+
+#include <stdint.h>
+
+// Cortex-A7 PMU cycle counter (PMCCNTR), counts CPU clocks once pmu_enable() has run.
+// The four event counters are set up with pmu_event_config() and read by index
+
+// Common architectural events
+#define PMU_EV_L1I_REFILL   0x01
+#define PMU_EV_L1D_REFILL   0x03
+#define PMU_EV_BR_MISPRED   0x10
+#define PMU_EV_L2D_REFILL   0x17
+
+#ifdef HOSTED
+#include "timer.h"
+
+// Native build: nanoseconds stand in for cycles, and the event counters read zero
+
+static inline void pmu_enable(void) {
+}
+
+static inline uint32_t pmu_cycles(void) {
+    return (uint32_t)timer_count();
+}
+
+static inline void pmu_event_config(uint32_t idx, uint32_t event) {
+    (void)idx;
+    (void)event;
+}
+
+static inline uint32_t pmu_event_read(uint32_t idx) {
+    (void)idx;
+    return 0;
+}
+#else
+static inline void pmu_enable(void) {
+    uint32_t pmcr;
+    __asm__ volatile ("mrc p15, 0, %0, c9, c12, 0" : "=r"(pmcr));
+    pmcr |= (1 << 0) | (1 << 2);                                    // E, reset cycle counter
+    __asm__ volatile ("mcr p15, 0, %0, c9, c12, 0" :: "r"(pmcr));
+    __asm__ volatile ("mcr p15, 0, %0, c9, c12, 1" :: "r"(1u << 31)); // PMCNTENSET.C
+}
+
+static inline uint32_t pmu_cycles(void) {
+    uint32_t c;
+    __asm__ volatile ("mrc p15, 0, %0, c9, c13, 0" : "=r"(c));
+    return c;
+}
+
+static inline void pmu_event_config(uint32_t idx, uint32_t event) {
+    __asm__ volatile ("mcr p15, 0, %0, c9, c12, 5" :: "r"(idx));        // PMSELR
+    __asm__ volatile ("isb");
+    __asm__ volatile ("mcr p15, 0, %0, c9, c13, 1" :: "r"(event));      // PMXEVTYPER
+    __asm__ volatile ("mcr p15, 0, %0, c9, c12, 2" :: "r"(1u << idx));  // PMCNTENCLR, then reset
+    __asm__ volatile ("mcr p15, 0, %0, c9, c13, 2" :: "r"(0));          // PMXEVCNTR
+    __asm__ volatile ("mcr p15, 0, %0, c9, c12, 1" :: "r"(1u << idx));  // PMCNTENSET
+}
+
+static inline uint32_t pmu_event_read(uint32_t idx) {
+    uint32_t c;
+    __asm__ volatile ("mcr p15, 0, %0, c9, c12, 5" :: "r"(idx));
+    __asm__ volatile ("isb");
+    __asm__ volatile ("mrc p15, 0, %0, c9, c13, 2" : "=r"(c));
+    return c;
+}
+#endif
+
+#endif
@@ -0,0 +1,41 @@
+#include "prof.h"
+
+#ifdef PROFILE
+#include "uart.h"
+
+// Bounds of the probe pointer table, from memlayout.ld (or the host linker)
+extern struct prof_probe_t *__start_prof_probes[];
+extern struct prof_probe_t *__stop_prof_probes[];
+
+void prof_reset(void) {
+    for (struct prof_probe_t **p = __start_prof_probes; p < __stop_prof_probes; p++) {
+        (*p)->count = 0;
+        (*p)->min = 0xFFFFFFFF;
+        (*p)->max = 0;
+        (*p)->total = 0;
+        (*p)->refills = 0;
+        (*p)->mispredicts = 0;
+    }
+}
+
+void prof_init(void) {
+    pmu_enable();
+    pmu_event_config(PROF_EV_REFILL, PMU_EV_L1D_REFILL);
+    pmu_event_config(PROF_EV_MISPRED, PMU_EV_BR_MISPRED);
+    prof_reset();
+}
+
+// One line per probe that fired: calls, min/avg/max cycles, then D-cache refills and
+// branch mispredicts per 100 calls (printf has no fractions)
+void prof_report(void) {
+    printf("probe: calls  min/avg/max cycles  refills mispredicts [per 100 calls]\r\n");
+    for (struct prof_probe_t **p = __start_prof_probes; p < __stop_prof_probes; p++) {
+        struct prof_probe_t *pr = *p;
+        if (pr->count == 0) continue;
+        printf("%s: %u  %u/%u/%u  %u %u\r\n", pr->name, pr->count,
+               pr->min, (uint32_t)(pr->total / pr->count), pr->max,
+               (uint32_t)((uint64_t)pr->refills * 100 / pr->count),
+               (uint32_t)((uint64_t)pr->mispredicts * 100 / pr->count));
+    }
+}
+#endif
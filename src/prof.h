@@ -0,0 +1,93 @@
+#ifndef PROF_H
+#define PROF_H
+
+#include <stdint.h>
+
+// Scoped PMU probes. Build with -DPROFILE; otherwise every macro below expands to
+// nothing and no probe data or counter reads are left in the image.
+//
+//   PROF_SCOPE("sd_send_cmd");   // Times from here to the end of the enclosing block
+//
+// Each probe keeps call count, min/max/total cycles and the L1 D-cache refills and
+// branch mispredicts seen while it was open. Nested probes count inclusively.
+//
+// Under -DSMP only core 0 records: the probe fields are updated without atomics, and
+// the other cores' counters are not the ones prof_report() sums up. A probe reached
+// on another core (memcpy in a task, the SD driver on the I/O core) costs one MPIDR read.
+
+#ifdef PROFILE
+#include "pmu.h"
+#ifdef SMP
+#include "smp.h"
+#endif
+
+#define PROF_EV_REFILL  0   // Event counter assignments, set up by prof_init()
+#define PROF_EV_MISPRED 1
+
+struct prof_probe_t {
+    const char *name;
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t total;
+    uint32_t refills;
+    uint32_t mispredicts;
+};
+
+struct prof_scope_t {
+    struct prof_probe_t *probe;
+    uint32_t t0;
+    uint32_t refills0;
+    uint32_t mispredicts0;
+};
+
+static inline struct prof_scope_t prof_scope_begin(struct prof_probe_t *probe) {
+    struct prof_scope_t s;
+#ifdef SMP
+    if (smp_core_id() != 0) {
+        s.probe = 0;
+        return s;
+    }
+#endif
+    s.probe = probe;
+    s.refills0 = pmu_event_read(PROF_EV_REFILL);
+    s.mispredicts0 = pmu_event_read(PROF_EV_MISPRED);
+    s.t0 = pmu_cycles();
+    return s;
+}
+
+static inline void prof_scope_end(struct prof_scope_t *s) {
+    struct prof_probe_t *p = s->probe;
+#ifdef SMP
+    if (!p) return;
+#endif
+    uint32_t cycles = pmu_cycles() - s->t0;
+    p->refills += pmu_event_read(PROF_EV_REFILL) - s->refills0;
+    p->mispredicts += pmu_event_read(PROF_EV_MISPRED) - s->mispredicts0;
+    p->count++;
+    p->total += cycles;
+    if (cycles < p->min) p->min = cycles;
+    if (cycles > p->max) p->max = cycles;
+}
+
+#define PROF_CAT2(a, b) a##b
+#define PROF_CAT(a, b) PROF_CAT2(a, b)
+
+// The probe is a function-local static; a pointer to it goes into the prof_probes
+// section, which prof_report() walks (the linker provides its bounds)
+#define PROF_SCOPE(label)                                                               \
+    static struct prof_probe_t PROF_CAT(prof_probe_, __LINE__) = { label, 0, 0xFFFFFFFF, 0, 0, 0, 0 }; \
+    static struct prof_probe_t *PROF_CAT(prof_entry_, __LINE__)                        \
+        __attribute__((section("prof_probes"), used)) = &PROF_CAT(prof_probe_, __LINE__); \
+    struct prof_scope_t PROF_CAT(prof_scope_, __LINE__)                                \
+        __attribute__((cleanup(prof_scope_end))) = prof_scope_begin(&PROF_CAT(prof_probe_, __LINE__))
+
+void prof_init(void);
+void prof_reset(void);
+void prof_report(void);
+
+#else
+#define PROF_SCOPE(label)
+#endif
+
+#endif
@@ -0,0 +1,236 @@
+#include "sched.h"
+
+#ifdef SMP
+#include "smp.h"
+#include "cache.h"
+
+struct task_t {
+    task_fn fn;
+    void *ctx;
+    uint32_t begin;
+    uint32_t end;
+    struct task_group_t *group;
+};
+
+// Chase-Lev deque in the C11 form of Le et al. The owner moves bottom; thieves
+// claim a task by advancing top with a CAS, and the owner races them the same way
+// for the last one. Indices only grow and are compared as signed differences.
+// top and bottom get a cache line each, so thieves polling top do not keep taking
+// the line the owner pushes through
+struct deque_t {
+    volatile uint32_t top __attribute__((aligned(CACHE_LINE_SIZE)));
+    volatile uint32_t bottom __attribute__((aligned(CACHE_LINE_SIZE)));
+    struct task_t tasks[SCHED_DEQUE_SIZE];
+};
+
+static struct deque_t deques[SMP_MAX_CORES];
+
+#define STEAL_EMPTY 0
+#define STEAL_OK    1
+#define STEAL_LOST  2   // Another core took it first; there may be more
+
+static int deque_push(struct deque_t *q, const struct task_t *t) {
+    uint32_t b = q->bottom;
+    uint32_t top = __atomic_load_n(&q->top, __ATOMIC_ACQUIRE);
+    if (b - top >= SCHED_DEQUE_SIZE) return -1;
+    q->tasks[b % SCHED_DEQUE_SIZE] = *t;
+    __atomic_store_n(&q->bottom, b + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+static int deque_pop(struct deque_t *q, struct task_t *out) {
+    uint32_t b = q->bottom - 1;
+    __atomic_store_n(&q->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    uint32_t t = __atomic_load_n(&q->top, __ATOMIC_RELAXED);
+
+    if ((int32_t)(b - t) < 0) {
+        __atomic_store_n(&q->bottom, b + 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+    *out = q->tasks[b % SCHED_DEQUE_SIZE];
+    if (b != t) return 1; // More than one left, no thief can reach this one
+
+    int won = atomic_cas(&q->top, t, t + 1);
+    __atomic_store_n(&q->bottom, b + 1, __ATOMIC_RELAXED);
+    return won;
+}
+
+static int deque_steal(struct deque_t *q, struct task_t *out) {
+    uint32_t t = __atomic_load_n(&q->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    uint32_t b = __atomic_load_n(&q->bottom, __ATOMIC_ACQUIRE);
+
+    if ((int32_t)(b - t) <= 0) return STEAL_EMPTY;
+    *out = q->tasks[t % SCHED_DEQUE_SIZE];
+    return atomic_cas(&q->top, t, t + 1) ? STEAL_OK : STEAL_LOST;
+}
+
+static void task_run(const struct task_t *t) {
+    struct task_group_t *g = t->group;
+    t->fn(t->ctx, t->begin, t->end);
+    if (atomic_sub(&g->pending, 1) == 0) smp_wake(); // g may be gone after this
+}
+
+// One task from this core's deque, else one stolen from the next core round.
+// 0 only once every deque has been seen empty
+static int run_one(uint32_t self) {
+    struct task_t t;
+    int lost;
+
+    if (deque_pop(&deques[self], &t)) {
+        task_run(&t);
+        return 1;
+    }
+    do {
+        lost = 0;
+        for (uint32_t i = 1; i < SMP_MAX_CORES; i++) {
+            int r = deque_steal(&deques[(self + i) % SMP_MAX_CORES], &t);
+            if (r == STEAL_OK) {
+                task_run(&t);
+                return 1;
+            }
+            if (r == STEAL_LOST) lost = 1;
+        }
+    } while (lost);
+    return 0;
+}
+
+void sched_init(void) {
+    for (uint32_t i = 0; i < SMP_MAX_CORES; i++) { // .bss is not zeroed at boot
+        deques[i].top = 0;
+        deques[i].bottom = 0;
+    }
+}
+
+// Cores 1-3 after bring-up. Sleeps in WFE while there is nothing to steal;
+// task_spawn and finishing tasks send the events
+void sched_worker(void) {
+    uint32_t self = smp_core_id();
+    for (;;) {
+        if (!run_one(self)) smp_idle();
+    }
+}
+
+void task_spawn(struct task_group_t *g, task_fn fn, void *ctx, uint32_t begin, uint32_t end) {
+    struct task_t t = { fn, ctx, begin, end, g };
+    atomic_add(&g->pending, 1);
+    if (deque_push(&deques[smp_core_id()], &t) != 0) {
+        task_run(&t);
+        return;
+    }
+    smp_wake();
+}
+
+// The waiting core helps rather than spins, so waits nest and a pool with no
+// secondary cores online still finishes everything
+void task_wait(struct task_group_t *g) {
+    uint32_t self = smp_core_id();
+    while (atomic_load(&g->pending)) {
+        if (!run_one(self)) smp_idle();
+    }
+}
+
+struct pfor_t {
+    task_fn fn;
+    void *ctx;
+    uint32_t grain;
+    struct task_group_t group;
+};
+
+// Hands the upper half of the range to the pool until what is left fits the grain
+static void pfor_split(void *ctx, uint32_t begin, uint32_t end) {
+    struct pfor_t *p = ctx;
+    while (end - begin > p->grain) {
+        uint32_t mid = begin + (end - begin) / 2;
+        task_spawn(&p->group, pfor_split, p, mid, end);
+        end = mid;
+    }
+    p->fn(p->ctx, begin, end);
+}
+
+void task_parallel_for(uint32_t n, uint32_t grain, task_fn fn, void *ctx) {
+    struct pfor_t p = { fn, ctx, grain ? grain : 1, TASK_GROUP_INIT };
+    if (n == 0) return;
+    pfor_split(&p, 0, n);
+    task_wait(&p.group);
+}
+
+#ifdef SMP_BENCH
+#include <string.h>
+#include "uart.h"
+#include "timer.h"
+#include "malloc.h"
+#include "crc32.h"
+
+#define BENCH_BYTES (8 * 1024 * 1024)
+#define BENCH_BLOCK 4096
+#define BENCH_GRAIN 16          // Blocks per leaf task, 64 KB
+
+struct bench_job_t {
+    uint8_t *dst;
+    const uint8_t *src;
+    uint32_t *crcs;
+};
+
+static void copy_range(void *ctx, uint32_t begin, uint32_t end) {
+    struct bench_job_t *j = ctx;
+    memcpy(j->dst + begin * BENCH_BLOCK, j->src + begin * BENCH_BLOCK, (end - begin) * BENCH_BLOCK);
+}
+
+static void crc_range(void *ctx, uint32_t begin, uint32_t end) {
+    struct bench_job_t *j = ctx;
+    for (uint32_t i = begin; i < end; i++) j->crcs[i] = crc32c_update(0, j->src + i * BENCH_BLOCK, BENCH_BLOCK);
+}
+
+// One job on core 0 alone, then across the pool. The outputs are cleared in between,
+// so the check afterwards sees only what the pool wrote
+static void bench_pair(const char *name, task_fn fn, struct bench_job_t *j) {
+    const uint32_t blocks = BENCH_BYTES / BENCH_BLOCK;
+
+    uint64_t t0 = timer_count();
+    fn(j, 0, blocks);
+    uint32_t serial = (uint32_t)timer_ticks_to_us(timer_count() - t0);
+    memset(j->dst, 0, BENCH_BYTES);
+    memset(j->crcs, 0, blocks * sizeof(uint32_t));
+
+    t0 = timer_count();
+    task_parallel_for(blocks, BENCH_GRAIN, fn, j);
+    uint32_t par = (uint32_t)timer_ticks_to_us(timer_count() - t0);
+    if (par == 0) par = 1;
+
+    printf("%s: 1 core %u us, %u cores %u us, speedup x%u.%u%u\r\n", name, serial, smp_cores_online(), par,
+           serial / par, (serial * 10 / par) % 10, (serial * 100 / par) % 10);
+}
+
+// memcpy and per-block CRC-32C over 8 MB, checking the parallel results against the serial ones
+void smp_bench(void) {
+    const uint32_t blocks = BENCH_BYTES / BENCH_BLOCK;
+    struct bench_job_t j;
+    uint8_t *src = memalign(CACHE_LINE_SIZE, BENCH_BYTES);
+    uint8_t *dst = memalign(CACHE_LINE_SIZE, BENCH_BYTES);
+    uint32_t *ref = malloc(blocks * sizeof(uint32_t));
+    uint32_t *crcs = malloc(blocks * sizeof(uint32_t));
+    if (!src || !dst || !ref || !crcs) {
+        printf("smp bench: out of memory\r\n");
+        goto out;
+    }
+    for (uint32_t i = 0; i < BENCH_BYTES; i++) src[i] = (uint8_t)(i * 131 + (i >> 12));
+
+    j = (struct bench_job_t){ dst, src, ref };
+    crc_range(&j, 0, blocks);
+
+    j.crcs = crcs;
+    bench_pair("memcpy", copy_range, &j);
+    bench_pair("crc32c", crc_range, &j);
+
+    int bad = memcmp(dst, src, BENCH_BYTES) != 0 || memcmp(crcs, ref, blocks * sizeof(uint32_t)) != 0;
+    printf("smp bench: results %s\r\n", bad ? "MISMATCH" : "match");
+out:
+    free(crcs);
+    free(ref);
+    free(dst);
+    free(src);
+}
+#endif
+#endif
@@ -0,0 +1,46 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdint.h>
+
+// Work-stealing task pool (-DSMP). Every core owns a deque: it pushes and pops its
+// own tasks at the bottom, and idle cores steal from the top of the others'. Cores
+// 1-3 do nothing else; core 0 runs main() and helps out whenever it waits.
+//
+//   struct task_group_t g = TASK_GROUP_INIT;
+//   task_spawn(&g, fn, ctx, begin, end);   // Any number, from any task or main()
+//   task_wait(&g);                         // Runs tasks until all of g's are done
+//
+// Tasks are for CPU work on memory: checksums, copies, parsing of buffers already
+// read. The filesystems, the UART and the SD driver are single-core: call them from
+// core 0, except that under -DIO_CORE the SD driver belongs to the I/O core and core 0
+// goes through the rings in iocore.h. TRACE events may be emitted from any core;
+// PROFILE probes record on core 0 only. malloc and free are locked under -DSMP.
+
+#define SCHED_DEQUE_SIZE 256    // Tasks per core; spawning onto a full deque runs the task inline
+
+typedef void (*task_fn)(void *ctx, uint32_t begin, uint32_t end);
+
+struct task_group_t {
+    volatile uint32_t pending;
+};
+
+#define TASK_GROUP_INIT { 0 }
+
+#ifdef SMP
+void sched_init(void);
+void sched_worker(void);
+
+void task_spawn(struct task_group_t *g, task_fn fn, void *ctx, uint32_t begin, uint32_t end);
+void task_wait(struct task_group_t *g);
+
+// fn(ctx, begin, end) over [0, n) in pieces of at most grain, split recursively so
+// that a thief takes half of what is left rather than one piece. Returns when done
+void task_parallel_for(uint32_t n, uint32_t grain, task_fn fn, void *ctx);
+
+#ifdef SMP_BENCH
+void smp_bench(void);
+#endif
+#endif
+
+#endif
@@ -1,44 +1,229 @@
 #include "sdhc.h"
+#include "cache.h"
+#include "blkdev.h"
+#include "prof.h"
+#include "trace.h"
+#include "timer.h"
 
 // implmentation 1-bit mode at Low Speed (400kHz)
 static uint32_t rca = 0;             // Relative Card Address
 static int is_high_capacity = 0;     // 0 = SDSC (Byte Addr), 1 = SDHC/SDXC (Block Addr)
 
+// DMA mode: descriptor ring in the uncached region, NULL while transfers are PIO.
+// Cache maintenance is done here, and only on the DMA path: a PIO transfer moves
+// the data with the CPU, so the caches are already coherent with it
+static struct sd_dma_desc_t *dma_ring = 0;
+static int use_dma = 0;
+
+#ifdef IO_STATS
+static struct sd_stats_t sd_stats;
+#define SD_STAT(stmt) do { stmt; } while (0)
+#else
+#define SD_STAT(stmt) do { } while (0)
+#endif
+
+// Tallies a finished data transfer and passes its result through
+static inline int sd_account(int ret, int count, int write) {
+#ifdef IO_STATS
+    if (ret != 0) sd_stats.xfer_errors++;
+    else if (write) sd_stats.blocks_written += count;
+    else sd_stats.blocks_read += count;
+#else
+    (void)count; (void)write;
+#endif
+    return ret;
+}
+
+// --- Timeouts ---
+// Wall-clock limits from the SD Physical Layer spec, measured on the generic timer
+#define SD_CMD_TIMEOUT_US     10000     // Command response
+#define SD_READ_TIMEOUT_US    100000    // Per block read
+#define SD_WRITE_TIMEOUT_US   500000    // Per block write, including the busy that follows it
+#define SD_INIT_TIMEOUT_US    1000000   // ACMD41 must report ready within 1 s
+#define SD_ACMD41_RETRY_US    10000
+#define SD_CLOCK_TIMEOUT_US   10000     // Clock update or controller reset
+
 // --- Internal Helpers ---
-static void delay_cycles(volatile int cycles) {
-    while(cycles--) __asm__("nop");
+
+// poll_until conditions. Those that wait on the card count as busy polls
+static uint32_t risr_any(void *ctx) {
+    SD_STAT(sd_stats.busy_polls++);
+    return H3_SD_MMC0->RISR & *(const uint32_t *)ctx;
+}
+
+static uint32_t cmd_start_clear(void *ctx) {
+    (void)ctx;
+    return !(H3_SD_MMC0->CMDR & CMD_START);
+}
+
+static uint32_t reset_clear(void *ctx) {
+    (void)ctx;
+    return !(H3_SD_MMC0->GCTL & (GCTL_SOFT_RST | GCTL_FIFO_RST | GCTL_DMA_RST));
+}
+
+// Data phase over: 1 = DATA_OVER, 2 = error
+static uint32_t data_over(uint32_t err) {
+    SD_STAT(sd_stats.busy_polls++);
+    if ((H3_SD_MMC0->RISR & RISR_ERRORS) || err) return 2;
+    return (H3_SD_MMC0->RISR & RISR_DATA_OVER) ? 1 : 0;
+}
+
+static uint32_t pio_done(void *ctx) {
+    (void)ctx;
+    return data_over(0);
+}
+
+static uint32_t dma_done(void *ctx) {
+    (void)ctx;
+    return data_over(H3_SD_MMC0->IDST & IDST_ERRORS);
+}
+
+// FIFO wait: the deadline is armed when the FIFO first stalls and cleared on progress,
+// so a transfer of any length only times out once the card stops moving data
+static int fifo_stalled(deadline_t *stall, uint32_t timeout_us) {
+    if (!*stall) {
+        *stall = deadline_after_us(timeout_us);
+        return 0;
+    }
+    return deadline_passed(*stall);
 }
 
 static int sd_update_clock(void) {
     H3_SD_MMC0->CMDR = CMD_START | CMD_UP_CLK | CMD_WAIT_PRE;
-    int timeout = 100000;
-    while ((H3_SD_MMC0->CMDR & CMD_START) && timeout--);
-    return (timeout > 0) ? 0 : -1;
+    return poll_until(cmd_start_clear, NULL, SD_CLOCK_TIMEOUT_US) ? 0 : -1;
 }
 
 static int sd_send_cmd(uint32_t cmd, uint32_t arg, uint32_t flags) {
+    PROF_SCOPE("sd_send_cmd");
+    TRACE_EVENT(TRACE_CMD_ISSUE, cmd, arg);
     H3_SD_MMC0->RISR = 0xFFFFFFFF; // Clear interrupts
     H3_SD_MMC0->CAGR = arg;
     H3_SD_MMC0->CMDR = (cmd & 0x3F) | flags | CMD_START;
+    SD_STAT(sd_stats.cmds[cmd & 0x3F]++);
+    SD_STAT(if (flags & CMD_AUTO_STOP) sd_stats.cmds[CMD12]++);
+
+    // CMD_WAIT_PRE holds the command back while the card is still busy with the last write
+    uint32_t mask = RISR_ERRORS | RISR_CMD_DONE;
+    uint32_t risr = poll_until(risr_any, &mask, (flags & CMD_WAIT_PRE) ? SD_WRITE_TIMEOUT_US : SD_CMD_TIMEOUT_US);
+
+    int ret = -2; // Timeout
+    if (risr & RISR_ERRORS) {
+        ret = -1;
+    } else if (risr & RISR_CMD_DONE) {
+        H3_SD_MMC0->RISR = RISR_CMD_DONE;
+        ret = 0;
+    }
+    SD_STAT(if (ret != 0) sd_stats.cmd_errors++);
+    TRACE_EVENT(TRACE_CMD_DONE, cmd, ret);
+    return ret;
+}
 
-    int timeout = 1000000;
-    while (timeout--) {
-        uint32_t risr = H3_SD_MMC0->RISR;
-        if (risr & RISR_ERRORS) {
-            return -1; 
-        }
-        if (risr & RISR_CMD_DONE) {
-            H3_SD_MMC0->RISR = RISR_CMD_DONE;
-            return 0; 
-        }
+static uint32_t card_addr(uint32_t sector) {
+    return is_high_capacity ? sector : sector * 512;
+}
+
+// One data command through the internal DMA controller. A buffer that is not line
+// aligned would share its edge lines with the CPU, so it is bounced through the
+// uncached region instead of being handed over directly
+static int sd_dma_transfer(uint32_t cmd, uint32_t sector, int count, uint8_t *buffer, int write) {
+    uint32_t bytes = (uint32_t)count * 512;
+    int dir = write ? CACHE_DMA_TO_DEVICE : CACHE_DMA_FROM_DEVICE;
+    uint8_t *xfer = buffer;
+
+    if (((uintptr_t)buffer & (CACHE_LINE_SIZE - 1)) && !cache_is_coherent(buffer, bytes)) {
+        xfer = dma_alloc(bytes);
+        if (!xfer) return -10;
+        if (write) memcpy(xfer, buffer, bytes);
+    }
+    cache_dma_prepare(xfer, bytes, dir);
+
+    int n = (int)((bytes + SD_DMA_DESC_BYTES - 1) / SD_DMA_DESC_BYTES);
+    for (int i = 0; i < n; i++) {
+        uint32_t left = bytes - i * SD_DMA_DESC_BYTES;
+        dma_ring[i].size = (left > SD_DMA_DESC_BYTES) ? SD_DMA_DESC_BYTES : left;
+        dma_ring[i].buf = (uint32_t)(uintptr_t)(xfer + i * SD_DMA_DESC_BYTES);
+        dma_ring[i].next = (uint32_t)(uintptr_t)&dma_ring[i + 1];
+        dma_ring[i].config = DESC_OWN | DESC_CHAIN | DESC_NO_IRQ |
+                             (i == 0 ? DESC_FIRST : 0) | (i == n - 1 ? DESC_LAST : 0);
+    }
+    dma_ring[n - 1].next = 0;
+
+    // The ring is uncached, but its stores can still sit in the write buffer: drain them
+    // before the controller is pointed at the ring and starts fetching descriptors
+    __asm__ volatile ("dsb sy" ::: "memory");
+
+    H3_SD_MMC0->GCTL = (H3_SD_MMC0->GCTL & ~GCTL_HC_EN) | GCTL_DMA_EN;
+    H3_SD_MMC0->DMAC = DMAC_SOFT_RST;
+    H3_SD_MMC0->DMAC = DMAC_FIX_BURST | DMAC_IDMA_ON;
+    H3_SD_MMC0->IDIE = 0;
+    H3_SD_MMC0->IDST = 0xFFFFFFFF;
+    H3_SD_MMC0->DLBA = (uint32_t)(uintptr_t)dma_ring;
+
+    H3_SD_MMC0->BKSR = 512;
+    H3_SD_MMC0->BYCR = bytes;
+
+    uint32_t flags = CMD_RESP_EXP | CMD_CHECK_CRC | CMD_DATA_EXP | CMD_WAIT_PRE;
+    if (count > 1) flags |= CMD_AUTO_STOP;
+    if (write) flags |= CMD_WRITE;
+
+    int ret = 0;
+    if (sd_send_cmd(cmd, card_addr(sector), flags) != 0) {
+        ret = -11;
+    } else {
+        uint32_t per_block = write ? SD_WRITE_TIMEOUT_US : SD_READ_TIMEOUT_US;
+        uint32_t done = poll_until(dma_done, NULL, per_block * (uint32_t)count);
+        if (done == 2) ret = -12;
+        else if (done == 0) ret = -13;
+    }
+
+    H3_SD_MMC0->RISR = RISR_DATA_OVER | RISR_CMD_DONE;
+    H3_SD_MMC0->IDST = 0xFFFFFFFF;
+    H3_SD_MMC0->DMAC = 0;
+    H3_SD_MMC0->GCTL = (H3_SD_MMC0->GCTL & ~GCTL_DMA_EN) | GCTL_HC_EN;
+
+    cache_dma_complete(xfer, bytes, dir);
+    if (xfer != buffer) {
+        if (!write && ret == 0) memcpy(buffer, xfer, bytes);
+        dma_free(xfer);
+    }
+    return ret;
+}
+
+// Splits a request into commands the descriptor ring can hold
+static int sd_dma_blocks(uint32_t sector, int count, uint8_t *buffer, int write) {
+    while (count > 0) {
+        int n = (count > SD_DMA_MAX_SECTORS) ? SD_DMA_MAX_SECTORS : count;
+        uint32_t cmd = write ? (n > 1 ? CMD25 : CMD24) : (n > 1 ? CMD18 : CMD17);
+        int ret = sd_dma_transfer(cmd, sector, n, buffer, write);
+        if (ret != 0) return ret;
+        sector += n;
+        buffer += n * 512;
+        count -= n;
     }
-    return -2; // Timeout
+    return 0;
+}
+
+int sd_set_dma(int enable) {
+    if (enable && !dma_ring) {
+        dma_ring = dma_alloc(SD_DMA_DESCS * sizeof(struct sd_dma_desc_t));
+        if (!dma_ring) return -1;
+    }
+    use_dma = enable;
+    return 0;
+}
+
+int sd_dma_enabled(void) {
+    return use_dma;
 }
 
 int sd_init(void) {
+    dma_ring = 0; // .bss is not zeroed at boot
+    use_dma = 0;
+    SD_STAT(sd_stats_reset());
+
     // 1. Reset & Setup
     H3_SD_MMC0->GCTL = GCTL_SOFT_RST | GCTL_FIFO_RST | GCTL_DMA_RST;
-    delay_cycles(1000);
+    if (!poll_until(reset_clear, NULL, SD_CLOCK_TIMEOUT_US)) return -9;
     H3_SD_MMC0->GCTL = GCTL_HC_EN; // Enable Controller, DMA is OFF by default
     
     H3_SD_MMC0->CKCR = (1U << 16) | (1U << 24); 
@@ -52,8 +237,8 @@ int sd_init(void) {
     if ((H3_SD_MMC0->RESP0 & 0xFF) != 0xAA) return -3;
 
     // 3. ACMD41 with Capacity Check
-    int retries = 1000;
-    while (retries--) {
+    deadline_t ready_by = deadline_after_us(SD_INIT_TIMEOUT_US);
+    for (;;) {
         sd_send_cmd(CMD55, 0, CMD_RESP_EXP | CMD_CHECK_CRC);
         
         // Arg 0x40... sets HCS (High Capacity Support) bit to 1
@@ -69,9 +254,9 @@ int sd_init(void) {
             }
             break; 
         }
-        delay_cycles(1000);
+        if (deadline_passed(ready_by)) return -4;
+        udelay(SD_ACMD41_RETRY_US);
     }
-    if (retries <= 0) return -4;
 
     // 4. Finalize Setup
     if (sd_send_cmd(CMD2, 0, CMD_RESP_EXP | CMD_LONG_RESP | CMD_CHECK_CRC) != 0) return -5;
@@ -85,6 +270,9 @@ int sd_init(void) {
 }
 
 int sd_read_block(uint32_t sector, uint8_t *buffer) {
+    TRACE_EVENT(TRACE_SD_READ, sector, 1);
+    if (use_dma) return sd_account(sd_dma_blocks(sector, 1, buffer, 0), 1, 0);
+
     H3_SD_MMC0->BKSR = 512;
     H3_SD_MMC0->BYCR = 512;
 
@@ -99,18 +287,20 @@ int sd_read_block(uint32_t sector, uint8_t *buffer) {
     // Send Read Command
     // CMD_WAIT_PRE is important for H3 to ensure previous data is flushed
     uint32_t flags = CMD_RESP_EXP | CMD_CHECK_CRC | CMD_DATA_EXP | CMD_WAIT_PRE;
-    if (sd_send_cmd(CMD17, addr, flags) != 0) return -1;
+    if (sd_send_cmd(CMD17, addr, flags) != 0) return sd_account(-1, 1, 0);
 
     // --- FIX: ROBUST FIFO READ ---
+    PROF_SCOPE("sd_read_block fifo");
     uint32_t *buf_u32 = (uint32_t *)buffer;
     int words_read = 0;
-    int timeout = 0xFFFFF;
+    int ret = 0;
+    deadline_t stall = 0;
 
     // Loop until we have read all 128 words (512 bytes)
-    while (words_read < 128 && timeout--) {
+    while (words_read < 128) {
         // Check for Errors
         if (H3_SD_MMC0->RISR & RISR_ERRORS) {
-            return -2; // Hardware Error
+            return sd_account(-2, 1, 0); // Hardware Error
         }
 
         // Check if FIFO is empty by reading Status Register (STAR)
@@ -118,18 +308,24 @@ int sd_read_block(uint32_t sector, uint8_t *buffer) {
         if (!(H3_SD_MMC0->STAR & (1U << 2))) { 
             // FIFO is NOT empty, safe to read
             buf_u32[words_read++] = H3_SD_MMC0->FIFO;
+            stall = 0;
+        } else if (fifo_stalled(&stall, SD_READ_TIMEOUT_US)) {
+            ret = -3;
+            break;
         }
     }
 
     // Acknowledge Data Transfer Over
     H3_SD_MMC0->RISR = RISR_DATA_OVER;
 
-    return (timeout > 0) ? 0 : -3;
+    return sd_account(ret, 1, 0);
 }
 
 int sd_read_blocks(uint32_t sector, int count, uint8_t *buffer) {
     if (count <= 0) return -1;
     if (count == 1) return sd_read_block(sector, buffer); // Fallback optimization
+    TRACE_EVENT(TRACE_SD_READ, sector, count);
+    if (use_dma) return sd_account(sd_dma_blocks(sector, count, buffer, 0), count, 0);
 
     // 1. Configure Data Transfer Size
     // BKSR is always 512 for SD cards
@@ -150,45 +346,47 @@ int sd_read_blocks(uint32_t sector, int count, uint8_t *buffer) {
     // when BYCR countdown reaches 0.
     uint32_t flags = CMD_RESP_EXP | CMD_CHECK_CRC | CMD_DATA_EXP | CMD_WAIT_PRE | CMD_AUTO_STOP;
     
-    if (sd_send_cmd(CMD18, addr, flags) != 0) return -2;
+    if (sd_send_cmd(CMD18, addr, flags) != 0) return sd_account(-2, count, 0);
 
     // 4. Read Loop
+    PROF_SCOPE("sd_read_blocks fifo");
     uint32_t *buf_u32 = (uint32_t *)buffer;
     int total_words = (512 * count) / 4;
     int words_read = 0;
-    int timeout = 0xFFFFFF; // Larger timeout for multiple blocks
+    deadline_t stall = 0;
 
-    while (words_read < total_words && timeout--) {
+    while (words_read < total_words) {
         // Check for Errors
         if (H3_SD_MMC0->RISR & RISR_ERRORS) {
             // Optional: Send manual CMD12 here if error occurs to reset card
-            return -3;
+            return sd_account(-3, count, 0);
         }
 
         // Check FIFO Status
         // Bit 2 of STAR register = FIFO Empty. We read if NOT empty.
         if (!(H3_SD_MMC0->STAR & (1U << 2))) { 
             buf_u32[words_read++] = H3_SD_MMC0->FIFO;
+            stall = 0;
+        } else if (fifo_stalled(&stall, SD_READ_TIMEOUT_US)) {
+            return sd_account(-4, count, 0); // Timeout
         }
     }
 
-    if (timeout <= 0) return -4; // Timeout
-
     // 5. Wait for Data Over & Auto-Command Done
     // Since we used Auto-Stop, we should technically wait for the specific Auto-Command done flag
     // but waiting for DATA_OVER is usually sufficient for the data phase.
-    timeout = 0xFFFF;
-    while (!(H3_SD_MMC0->RISR & RISR_DATA_OVER) && timeout--) {
-         // Wait for controller to finish
-    }
+    uint32_t done = poll_until(pio_done, NULL, SD_READ_TIMEOUT_US);
     
     // Clear Interrupt Flags
     H3_SD_MMC0->RISR = RISR_DATA_OVER | RISR_CMD_DONE;
 
-    return 0;
+    return sd_account((done == 1) ? 0 : -5, count, 0);
 }
 
 int sd_write_block(uint32_t sector, const uint8_t *buffer) {
+    TRACE_EVENT(TRACE_SD_WRITE, sector, 1);
+    if (use_dma) return sd_account(sd_dma_blocks(sector, 1, (uint8_t *)buffer, 1), 1, 1);
+
     // 1. Setup Block Size & Byte Count
     H3_SD_MMC0->BKSR = 512;
     H3_SD_MMC0->BYCR = 512;
@@ -203,17 +401,18 @@ int sd_write_block(uint32_t sector, const uint8_t *buffer) {
     // Flags: Response | Check CRC | Data Expected | Wait Pre-load | WRITE MODE
     uint32_t flags = CMD_RESP_EXP | CMD_CHECK_CRC | CMD_DATA_EXP | CMD_WAIT_PRE | CMD_WRITE;
     
-    if (sd_send_cmd(CMD24, arg, flags) != 0) return -1;
+    if (sd_send_cmd(CMD24, arg, flags) != 0) return sd_account(-1, 1, 1);
 
     // 4. Write Loop
+    PROF_SCOPE("sd_write_block fifo");
     const uint32_t *buf_u32 = (const uint32_t *)buffer;
     int words_to_write = 128; // 512 bytes / 4
-    int timeout = 0xFFFFF;
+    deadline_t stall = 0;
 
-    while (words_to_write > 0 && timeout--) {
+    while (words_to_write > 0) {
         // Check for Errors
         if (H3_SD_MMC0->RISR & RISR_ERRORS) {
-            return -2;
+            return sd_account(-2, 1, 1);
         }
 
         // Check FIFO Status (Bit 3 in STAR usually indicates FIFO Full)
@@ -221,26 +420,27 @@ int sd_write_block(uint32_t sector, const uint8_t *buffer) {
         if (!(H3_SD_MMC0->STAR & (1U << 3))) { 
             H3_SD_MMC0->FIFO = *buf_u32++;
             words_to_write--;
+            stall = 0;
+        } else if (fifo_stalled(&stall, SD_WRITE_TIMEOUT_US)) {
+            return sd_account(-3, 1, 1); // Write Timeout
         }
     }
 
-    if (timeout <= 0) return -3; // Write Timeout
-
     // 5. Wait for Data Transfer Complete
-    timeout = 0xFFFFF;
-    while (!(H3_SD_MMC0->RISR & RISR_DATA_OVER) && timeout--) {
-        if (H3_SD_MMC0->RISR & RISR_ERRORS) return -4;
-    }
+    uint32_t done = poll_until(pio_done, NULL, SD_WRITE_TIMEOUT_US);
+    if (done == 2) return sd_account(-4, 1, 1);
 
     // Clear Flags
     H3_SD_MMC0->RISR = RISR_DATA_OVER | RISR_CMD_DONE;
 
-    return (timeout > 0) ? 0 : -5;
+    return sd_account(done ? 0 : -5, 1, 1);
 }
 
 int sd_write_blocks(uint32_t sector, int count, const uint8_t *buffer) {
     if (count <= 0) return -1;
     if (count == 1) return sd_write_block(sector, buffer); // Optimization
+    TRACE_EVENT(TRACE_SD_WRITE, sector, count);
+    if (use_dma) return sd_account(sd_dma_blocks(sector, count, (uint8_t *)buffer, 1), count, 1);
 
     // 1. Setup Block Size & Total Byte Count
     H3_SD_MMC0->BKSR = 512;
@@ -259,18 +459,19 @@ int sd_write_blocks(uint32_t sector, int count, const uint8_t *buffer) {
     uint32_t flags = CMD_RESP_EXP | CMD_CHECK_CRC | CMD_DATA_EXP | 
                      CMD_WAIT_PRE | CMD_WRITE | CMD_AUTO_STOP;
     
-    if (sd_send_cmd(CMD25, arg, flags) != 0) return -2;
+    if (sd_send_cmd(CMD25, arg, flags) != 0) return sd_account(-2, count, 1);
 
     // 4. Write Loop
+    PROF_SCOPE("sd_write_blocks fifo");
     const uint32_t *buf_u32 = (const uint32_t *)buffer;
     int total_words = (512 * count) / 4;
     int words_written = 0;
-    int timeout = 0xFFFFFF; // Larger timeout for multiple blocks
+    deadline_t stall = 0;
 
-    while (words_written < total_words && timeout--) {
+    while (words_written < total_words) {
         // Check for Errors
         if (H3_SD_MMC0->RISR & RISR_ERRORS) {
-            return -3;
+            return sd_account(-3, count, 1);
         }
 
         // Check FIFO Status
@@ -278,22 +479,21 @@ int sd_write_blocks(uint32_t sector, int count, const uint8_t *buffer) {
         // We write only if the FIFO is NOT full.
         if (!(H3_SD_MMC0->STAR & (1U << 3))) { 
             H3_SD_MMC0->FIFO = buf_u32[words_written++];
+            stall = 0;
+        } else if (fifo_stalled(&stall, SD_WRITE_TIMEOUT_US)) {
+            return sd_account(-4, count, 1); // Write Data Timeout
         }
     }
 
-    if (timeout <= 0) return -4; // Write Data Timeout
-
     // 5. Wait for Auto-Stop and Data Complete
     // We wait for DATA_OVER, which implies the Auto-CMD12 is also finished.
-    timeout = 0xFFFFF;
-    while (!(H3_SD_MMC0->RISR & RISR_DATA_OVER) && timeout--) {
-        if (H3_SD_MMC0->RISR & RISR_ERRORS) return -5;
-    }
+    uint32_t done = poll_until(pio_done, NULL, SD_WRITE_TIMEOUT_US);
+    if (done == 2) return sd_account(-5, count, 1);
 
     // Clear Interrupt Flags
     H3_SD_MMC0->RISR = RISR_DATA_OVER | RISR_CMD_DONE;
 
-    return (timeout > 0) ? 0 : -6;
+    return sd_account(done ? 0 : -6, count, 1);
 }
 
 int sd_erase_blocks(uint32_t start_sector, uint32_t count) {
@@ -328,6 +528,34 @@ int sd_erase_blocks(uint32_t start_sector, uint32_t count) {
     return 0; // Erase command accepted successfully
 }
 
+// Block device backend. The card is the only one there is, so ctx is unused
+static int sd_blk_read(void *ctx, uint32_t lba, uint32_t count, void *buf) {
+    (void)ctx;
+    return sd_read_blocks(lba, (int)count, buf);
+}
+
+static int sd_blk_write(void *ctx, uint32_t lba, uint32_t count, const void *buf) {
+    (void)ctx;
+    return sd_write_blocks(lba, (int)count, buf);
+}
+
+// Writes are complete once the card leaves the programming state
+static int sd_blk_flush(void *ctx) {
+    (void)ctx;
+    return sd_wait_ready();
+}
+
+static const struct blkdev_ops_t sd_blk_ops = { sd_blk_read, sd_blk_write, sd_blk_flush, NULL, NULL };
+
+void sd_blkdev_init(struct blkdev_t *dev) {
+    dev->ops = &sd_blk_ops;
+    dev->ctx = NULL;
+    dev->sectors = 0; // CSD is not parsed
+#ifdef IO_STATS
+    blkdev_stats_reset(dev);
+#endif
+}
+
 uint32_t sd_get_status(void) {
     // CMD13: Send Status (RCA is required)
     if (sd_send_cmd(CMD13, rca << 16, CMD_RESP_EXP | CMD_CHECK_CRC) != 0) {
@@ -336,18 +564,22 @@ uint32_t sd_get_status(void) {
     return H3_SD_MMC0->RESP0;
 }
 
+// 1 = card in TRAN state, 2 = CMD13 failed
+static uint32_t card_ready(void *ctx) {
+    (void)ctx;
+    SD_STAT(sd_stats.busy_polls++);
+    uint32_t status = sd_get_status();
+    if (status == 0xFFFFFFFF) return 2;
+
+    // Check "Current State" (Bits 9-12)
+    // 4 = TRAN (Transfer State) - Ready for data
+    return ((status >> 9) & 0x0F) == 4;
+}
+
 int sd_wait_ready(void) {
-    int timeout = 100000;
-    while (timeout--) {
-        uint32_t status = sd_get_status();
-        if (status == 0xFFFFFFFF) return -1;
-
-        // Check "Current State" (Bits 9-12)
-        // 4 = TRAN (Transfer State) - Ready for data
-        uint32_t current_state = (status >> 9) & 0x0F;
-        if (current_state == 4) return 0;
-    }
-    return -2; // Card stuck busy
+    uint32_t ready = poll_until(card_ready, NULL, SD_WRITE_TIMEOUT_US);
+    if (ready == 2) return -1;
+    return ready ? 0 : -2; // Card stuck busy
 }
 
 int sd_set_bus_width_4bit(void) {
@@ -376,4 +608,30 @@ int sd_set_speed(uint32_t frequency_hz) {
 
     H3_SD_MMC0->CKCR = (1U << 16) | div; // Enable | Divider
     return sd_update_clock();
-}
\ No newline at end of file
+}
+
+#ifdef IO_STATS
+void sd_stats_reset(void) {
+    memset(&sd_stats, 0, sizeof(sd_stats));
+}
+
+void sd_stats_snapshot(struct sd_stats_t *out) {
+    *out = sd_stats;
+}
+
+// out = after - before, field by field (out may alias either)
+void sd_stats_diff(struct sd_stats_t *out, const struct sd_stats_t *after, const struct sd_stats_t *before) {
+    for (int i = 0; i < 64; i++) out->cmds[i] = after->cmds[i] - before->cmds[i];
+    out->cmd_errors = after->cmd_errors - before->cmd_errors;
+    out->xfer_errors = after->xfer_errors - before->xfer_errors;
+    out->blocks_read = after->blocks_read - before->blocks_read;
+    out->blocks_written = after->blocks_written - before->blocks_written;
+    out->busy_polls = after->busy_polls - before->busy_polls;
+}
+
+uint32_t sd_stats_cmd_total(const struct sd_stats_t *st) {
+    uint32_t n = 0;
+    for (int i = 0; i < 64; i++) n += st->cmds[i];
+    return n;
+}
+#endif
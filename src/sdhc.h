@@ -72,11 +72,38 @@ struct sdmmc_reg_t {
 #define CMD_AUTO_STOP   (1U << 12) // Automatically send CMD12 after data transfer
 
 // GCTL Bits
-#define GCTL_HC_EN      (1U << 31)
+#define GCTL_HC_EN      (1U << 31) // FIFO accessed over AHB, i.e. by the CPU (clear for DMA)
+#define GCTL_DMA_EN     (1U << 5)
 #define GCTL_SOFT_RST   (1U << 0)
 #define GCTL_FIFO_RST   (1U << 1)
 #define GCTL_DMA_RST    (1U << 2)
 
+// DMAC Bits (internal DMA controller)
+#define DMAC_IDMA_ON    (1U << 7)
+#define DMAC_FIX_BURST  (1U << 1)
+#define DMAC_SOFT_RST   (1U << 0)
+
+// IDST Bits
+#define IDST_ERRORS     (0x34)     // Fatal bus error, descriptor unavailable, card error
+
+// IDMA descriptor, chained through next
+struct sd_dma_desc_t {
+    volatile uint32_t config;
+    volatile uint32_t size;
+    volatile uint32_t buf;
+    volatile uint32_t next;
+};
+
+#define DESC_OWN        (1U << 31) // Owned by the controller
+#define DESC_CHAIN      (1U << 4)
+#define DESC_FIRST      (1U << 3)
+#define DESC_LAST       (1U << 2)
+#define DESC_NO_IRQ     (1U << 1)
+
+#define SD_DMA_DESC_BYTES   4096
+#define SD_DMA_DESCS        32
+#define SD_DMA_MAX_SECTORS  (SD_DMA_DESCS * SD_DMA_DESC_BYTES / 512) // Per command
+
 // RISR (Interrupt Status) Bits
 #define RISR_CMD_DONE   (1U << 2)
 #define RISR_DATA_OVER  (1U << 3)
@@ -135,4 +162,27 @@ uint32_t sd_get_status(void);
 int sd_wait_ready(void);
 int sd_set_bus_width_4bit(void);
 int sd_set_speed(uint32_t frequency_hz);
+
+// Data transfers by CPU (PIO, the default) or by the internal DMA controller
+int sd_set_dma(int enable);
+int sd_dma_enabled(void);
+
+// Command and transfer accounting, built with -DIO_STATS. Take a snapshot before and
+// after an operation and diff them to see what it cost on the bus
+#ifdef IO_STATS
+struct sd_stats_t {
+    uint32_t cmds[64];          // Issued, by index. ACMDs count under their own index and
+                                // the controller's auto-stop after a multi-block transfer as CMD12
+    uint32_t cmd_errors;        // Error status or timeout in the command phase
+    uint32_t xfer_errors;       // Failed data transfers, including those whose command failed
+    uint32_t blocks_read;       // Blocks moved by successful transfers
+    uint32_t blocks_written;
+    uint32_t busy_polls;        // Status polls spent waiting for command done, data over or card ready
+};
+
+void sd_stats_reset(void);
+void sd_stats_snapshot(struct sd_stats_t *out);
+void sd_stats_diff(struct sd_stats_t *out, const struct sd_stats_t *after, const struct sd_stats_t *before);
+uint32_t sd_stats_cmd_total(const struct sd_stats_t *st);
+#endif
 #endif
\ No newline at end of file
@@ -0,0 +1,79 @@
+#include "smp.h"
+
+#ifdef SMP
+#include "sched.h"
+#include "timer.h"
+#include "iocore.h"
+#include "pmu.h"
+#include "prof.h"
+
+// Secondary bring-up through the CPU configuration block, the same sequence the
+// sunxi PSCI firmware uses for CPU_ON. We run at secure PL1 with no firmware
+// underneath, so there is no PSCI to call: this is the layer PSCI would sit on.
+// QEMU's orangepi-pc models CPUCFG (the PRCM power switches read as RAZ/WI there).
+
+#define SMP_ONLINE_TIMEOUT_US 100000
+
+void secondary_entry(void);         // start.S
+
+static volatile uint32_t cores_online;
+
+// First C code on cores 1-3: stack, MMU and caches are already set up by start.S
+void smp_secondary_main(void) {
+#if defined(TRACE) || defined(PROFILE)
+    // Each core has its own PMU, off out of reset: trace timestamps taken here (the SD
+    // driver's, under -DIO_CORE) read this core's cycle counter
+    pmu_enable();
+#endif
+#ifdef PROFILE
+    pmu_event_config(PROF_EV_REFILL, PMU_EV_L1D_REFILL);
+    pmu_event_config(PROF_EV_MISPRED, PMU_EV_BR_MISPRED);
+#endif
+    atomic_add(&cores_online, 1);
+    smp_wake();
+#ifdef IO_CORE
+    if (smp_core_id() == IO_CORE_ID) io_core_main(); // Never returns
+#endif
+    sched_worker();                 // Never returns
+}
+
+static void core_power_on(uint32_t core) {
+    // Release the power clamp in steps to limit inrush, then the power gate
+    PRCM_CPU_PWR_CLAMP(core) = 0xFE;
+    PRCM_CPU_PWR_CLAMP(core) = 0xF8;
+    PRCM_CPU_PWR_CLAMP(core) = 0xE0;
+    PRCM_CPU_PWR_CLAMP(core) = 0x80;
+    PRCM_CPU_PWR_CLAMP(core) = 0x00;
+    udelay(20);
+    PRCM_CPU_PWROFF &= ~(1U << core);
+    udelay(20);
+}
+
+static uint32_t core_counted(void *ctx) {
+    return atomic_load(&cores_online) >= *(const uint32_t *)ctx;
+}
+
+uint32_t smp_init(void) {
+    cores_online = 1; // .bss is not zeroed at boot
+    sched_init();
+
+    CPUCFG_ENTRY_ADDR = (uint32_t)(uintptr_t)secondary_entry;
+    for (uint32_t core = 1; core < SMP_MAX_CORES; core++) {
+        CPUCFG_RST_CTRL(core) = 0;                  // Hold in reset
+        CPUCFG_GEN_CTRL &= ~(1U << core);           // L1 reset on
+        CPUCFG_DBG_CTRL1 &= ~(1U << core);          // No external debug while powering up
+        core_power_on(core);
+        CPUCFG_RST_CTRL(core) = CPUCFG_RST_RELEASE;
+        CPUCFG_DBG_CTRL1 |= 1U << core;
+
+        // One at a time, so a core that never arrives is not mistaken for a late one
+        uint32_t want = core + 1;
+        if (!poll_until(core_counted, &want, SMP_ONLINE_TIMEOUT_US)) break;
+    }
+    return atomic_load(&cores_online);
+}
+
+uint32_t smp_cores_online(void) {
+    return atomic_load(&cores_online);
+}
+#endif
@@ -0,0 +1,106 @@
+#ifndef SMP_H
+#define SMP_H
+
+#include <stdint.h>
+
+// Secondary core bring-up, spinlocks and atomics for the H3's four Cortex-A7s.
+// Build with -DSMP: main() then calls smp_init(), which starts cores 1-3 in the task
+// scheduler (sched.h). Without it only the inline helpers below are compiled and
+// everything runs on core 0 as before.
+
+#define SMP_MAX_CORES   4
+#define SMP_STACK_SIZE  0x10000     // Per secondary core, matches .stacks in memlayout.ld
+
+// H3 CPU configuration block: per-core reset and the secondary entry address
+#define H3_CPUCFG_BASE          0x01F01C00
+#define CPUCFG_RST_CTRL(n)      (*(volatile uint32_t *)(H3_CPUCFG_BASE + 0x40 + 0x40 * (n)))
+#define CPUCFG_GEN_CTRL         (*(volatile uint32_t *)(H3_CPUCFG_BASE + 0x184))
+#define CPUCFG_ENTRY_ADDR       (*(volatile uint32_t *)(H3_CPUCFG_BASE + 0x1A4))
+#define CPUCFG_DBG_CTRL1        (*(volatile uint32_t *)(H3_CPUCFG_BASE + 0x1E4))
+#define CPUCFG_RST_RELEASE      0x3         // Core and debug reset de-asserted
+
+// PRCM power switches for cores 1-3
+#define H3_PRCM_BASE            0x01F01400
+#define PRCM_CPU_PWROFF         (*(volatile uint32_t *)(H3_PRCM_BASE + 0x100))
+#define PRCM_CPU_PWR_CLAMP(n)   (*(volatile uint32_t *)(H3_PRCM_BASE + 0x140 + 4 * (n)))
+
+// MPIDR affinity level 0: 0-3 within the cluster
+static inline uint32_t smp_core_id(void) {
+    uint32_t mpidr;
+    __asm__ volatile ("mrc p15, 0, %0, c0, c0, 5" : "=r"(mpidr));
+    return mpidr & 3;
+}
+
+// --- Atomics ---
+// Sequentially consistent (LDREX/STREX bracketed by DMB). Exclusives need the MMU
+// and caches on, so these are only valid after mmu_enable/mmu_on in start.S
+
+static inline uint32_t atomic_load(const volatile uint32_t *p) {
+    return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+}
+
+static inline void atomic_store(volatile uint32_t *p, uint32_t v) {
+    __atomic_store_n(p, v, __ATOMIC_SEQ_CST);
+}
+
+// Both return the new value
+static inline uint32_t atomic_add(volatile uint32_t *p, uint32_t v) {
+    return __atomic_add_fetch(p, v, __ATOMIC_SEQ_CST);
+}
+
+static inline uint32_t atomic_sub(volatile uint32_t *p, uint32_t v) {
+    return __atomic_sub_fetch(p, v, __ATOMIC_SEQ_CST);
+}
+
+// Non-zero if *p was expected and is now desired
+static inline int atomic_cas(volatile uint32_t *p, uint32_t expected, uint32_t desired) {
+    return __atomic_compare_exchange_n(p, &expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+// Wake cores sleeping in WFE, and sleep until woken. SEV follows a DSB so the
+// store that the sleeper is waiting for is visible before it wakes
+static inline void smp_wake(void) {
+    __asm__ volatile ("dsb ish\n sev" ::: "memory");
+}
+
+static inline void smp_idle(void) {
+    __asm__ volatile ("wfe" ::: "memory");
+}
+
+// --- Spinlocks ---
+// Test-and-test-and-set: waiters sleep in WFE, and the unlock wakes them with SEV.
+// Not IRQ-safe: a lock an IRQ handler takes must be held with IRQs masked
+
+typedef struct {
+    volatile uint32_t locked;
+} spinlock_t;
+
+#define SPINLOCK_INIT { 0 }
+
+static inline void spin_init(spinlock_t *l) {
+    l->locked = 0;
+}
+
+static inline int spin_trylock(spinlock_t *l) {
+    return l->locked == 0 && atomic_cas(&l->locked, 0, 1);
+}
+
+static inline void spin_lock(spinlock_t *l) {
+    while (!spin_trylock(l)) {
+        while (l->locked) smp_idle();
+    }
+}
+
+static inline void spin_unlock(spinlock_t *l) {
+    __atomic_store_n(&l->locked, 0, __ATOMIC_RELEASE);
+    smp_wake();
+}
+
+#ifdef SMP
+// Powers up and releases cores 1-3 into the scheduler. Returns the number of cores
+// online, including this one
+uint32_t smp_init(void);
+uint32_t smp_cores_online(void);
+#endif
+
+#endif
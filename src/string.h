@@ -9,4 +9,10 @@ char *strdup(const char *s);
 void *memcpy(void *dst, const void *src, size_t n);
 void *memset(void *dst, int c, size_t n);
 int memcmp(const void *a, const void *b, size_t n);
+
+// Correctness check against byte loops and per-size throughput, built with -DSTRING_BENCH
+#ifdef STRING_BENCH
+int string_selftest(void);
+void string_bench(void);
+#endif
 #endif
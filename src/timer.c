@@ -0,0 +1,26 @@
+#include "timer.h"
+
+void udelay(uint32_t us) {
+    deadline_t end = deadline_after_us(us);
+    while (!deadline_passed(end));
+}
+
+uint32_t poll_until(uint32_t (*cond)(void *ctx), void *ctx, uint32_t timeout_us) {
+    uint64_t start = timer_count();
+    deadline_t end = start + timer_us_to_ticks(timeout_us);
+    deadline_t spin_end = start + timer_us_to_ticks(POLL_SPIN_US);
+    uint32_t gap = 1;
+    uint32_t v;
+
+    while ((v = cond(ctx)) == 0) {
+        uint64_t now = timer_count();
+        if (now >= end) return cond(ctx); // One last look, the wait may have been interrupted
+        if (now < spin_end) continue;
+
+        deadline_t next = now + timer_us_to_ticks(gap);
+        if (next > end) next = end;
+        while (!deadline_passed(next));
+        if (gap < POLL_BACKOFF_MAX_US) gap *= 2;
+    }
+    return v;
+}
@@ -0,0 +1,76 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+
+#ifdef HOSTED
+#include <time.h>
+
+// Native build: CLOCK_MONOTONIC in nanoseconds stands in for the generic timer
+
+static inline uint64_t timer_count(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static inline uint32_t timer_freq(void) {
+    return 1000000000u;
+}
+#else
+// ARM generic timer: CNTPCT is a 64-bit count at CNTFRQ (24 MHz on the H3),
+// running from reset and independent of the CPU clock
+
+static inline uint64_t timer_count(void) {
+    uint32_t lo, hi;
+    __asm__ volatile ("isb\n mrrc p15, 0, %0, %1, c14" : "=r"(lo), "=r"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline uint32_t timer_freq(void) {
+    uint32_t f;
+    __asm__ volatile ("mrc p15, 0, %0, c14, c0, 0" : "=r"(f));
+    return f ? f : 24000000; // CNTFRQ is only a record of what firmware set up
+}
+#endif
+
+static inline uint64_t timer_ticks_to_us(uint64_t ticks) {
+    return ticks * 1000000 / timer_freq();
+}
+
+// Whole-MHz frequencies (every known board) take one 32-bit multiply, no 64-bit divide
+static inline uint64_t timer_us_to_ticks(uint32_t us) {
+    uint32_t f = timer_freq();
+    uint64_t ticks = (uint64_t)us * (f / 1000000);
+    if (f % 1000000) ticks += (uint64_t)us * (f % 1000000) / 1000000;
+    return ticks;
+}
+
+// --- Deadlines ---
+
+// An absolute counter value. The count is 64 bits, so it never wraps in practice and
+// deadlines compare directly
+typedef uint64_t deadline_t;
+
+static inline deadline_t deadline_after_us(uint32_t us) {
+    return timer_count() + timer_us_to_ticks(us);
+}
+
+static inline int deadline_passed(deadline_t d) {
+    return timer_count() >= d;
+}
+
+// Busy-wait on the core's own counter
+void udelay(uint32_t us);
+
+// Poll with backoff: calls cond(ctx) until it returns non-zero or timeout_us has passed,
+// and returns its last value (0 = timed out). The first POLL_SPIN_US are a tight loop
+// for conditions that clear at once; after that the gap between calls doubles from 1 us
+// up to POLL_BACKOFF_MAX_US, so a slow device is not hammered with register reads and
+// the wait overshoots its condition by at most that much
+#define POLL_SPIN_US        20
+#define POLL_BACKOFF_MAX_US 128
+
+uint32_t poll_until(uint32_t (*cond)(void *ctx), void *ctx, uint32_t timeout_us);
+
+#endif
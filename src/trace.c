@@ -0,0 +1,28 @@
+#include "trace.h"
+
+#ifdef TRACE
+#include "uart.h"
+
+struct trace_event_t trace_ring[TRACE_RING_SIZE];
+uint32_t trace_head;
+
+// Also drops anything emitted before the call (.bss is not zeroed at boot)
+void trace_init(void) {
+    pmu_enable();
+    trace_head = 0;
+}
+
+// "TRACE BEGIN <emitted> <dumped>", one "ts type a b" hex line per event, oldest
+// first, then "TRACE END". Events emitted while the dump runs may come out torn
+void trace_dump(void) {
+    uint32_t head = trace_head;
+    uint32_t n = (head > TRACE_RING_SIZE) ? TRACE_RING_SIZE : head;
+
+    printf("TRACE BEGIN %u %u\r\n", head, n);
+    for (uint32_t i = head - n; i != head; i++) {
+        struct trace_event_t *e = &trace_ring[i & (TRACE_RING_SIZE - 1)];
+        printf("%x %x %x %x\r\n", e->ts, e->type, e->a, e->b);
+    }
+    printf("TRACE END\r\n");
+}
+#endif
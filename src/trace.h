@@ -0,0 +1,70 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+// Binary event trace. Build with -DTRACE; otherwise TRACE_EVENT() expands to nothing.
+//
+// Each event is 16 bytes (cycle timestamp, type, two arguments) written into a RAM
+// ring with one atomic increment, so emitting costs a handful of instructions and is
+// safe from interrupts. When the ring wraps the oldest events are overwritten.
+// trace_dump() prints the ring as hex over the UART; tools/trace_decode.py turns a
+// captured log into a timeline.
+//
+// Any core may emit. Timestamps come from the emitting core's own cycle counter, and
+// the counters are not in step, so under -DSMP the type carries the core number above
+// TRACE_CORE_SHIFT and the decoder keeps a separate clock per core.
+
+// Event types (a, b)
+#define TRACE_CMD_ISSUE     1   // SD command index, argument
+#define TRACE_CMD_DONE      2   // SD command index, status (0 or negative)
+#define TRACE_SD_READ       3   // First LBA, sector count
+#define TRACE_SD_WRITE      4   // First LBA, sector count
+#define TRACE_FAT_HIT       5   // FAT sector, 0
+#define TRACE_FAT_MISS      6   // FAT sector, 1 if a dirty sector was written back first
+#define TRACE_CLUSTER_ALLOC 7   // Cluster, 0
+#define TRACE_MARK          8   // Free for ad-hoc use
+
+#define TRACE_CORE_SHIFT    24
+
+#ifdef TRACE
+#include "pmu.h"
+#ifdef SMP
+#include "smp.h"
+#endif
+
+#define TRACE_RING_SIZE 4096    // Events, power of two (64 KB)
+
+struct trace_event_t {
+    uint32_t ts;                // PMU cycle counter of the emitting core
+    uint32_t type;              // Event type, emitting core above TRACE_CORE_SHIFT
+    uint32_t a;
+    uint32_t b;
+};
+
+extern struct trace_event_t trace_ring[TRACE_RING_SIZE];
+extern uint32_t trace_head;     // Events emitted since trace_init(), never wraps back
+
+static inline void trace_emit(uint32_t type, uint32_t a, uint32_t b) {
+    uint32_t i = __atomic_fetch_add(&trace_head, 1, __ATOMIC_RELAXED) & (TRACE_RING_SIZE - 1);
+    struct trace_event_t *e = &trace_ring[i];
+    e->ts = pmu_cycles();
+#ifdef SMP
+    e->type = type | smp_core_id() << TRACE_CORE_SHIFT;
+#else
+    e->type = type;
+#endif
+    e->a = a;
+    e->b = b;
+}
+
+#define TRACE_EVENT(type, a, b) trace_emit((type), (uint32_t)(a), (uint32_t)(b))
+
+void trace_init(void);
+void trace_dump(void);
+
+#else
+#define TRACE_EVENT(type, a, b) do { } while (0)
+#endif
+
+#endif
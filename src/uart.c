@@ -1,4 +1,12 @@
 #include <uart.h>
+#include "irq.h"
+
+// Transmit ring: printf only ever appends here. head is advanced by the writer,
+// tail by whoever feeds the FIFO, which always runs with IRQs masked
+static char tx_ring[UART_TX_RING];
+static volatile uint32_t tx_head;
+static volatile uint32_t tx_tail;
+static int tx_irq;              // THRE interrupt drains the ring
 
 void sys_uart_init(void)
 {
@@ -38,11 +46,72 @@ void sys_uart_init(void)
     val &= ~0x1f;
     val |= (3 << 0);  // 8 bits
     *UART_LCR = val;
+
+    tx_head = 0; // .bss is not zeroed at boot
+    tx_tail = 0;
+    tx_irq = 0;
+}
+
+// One burst from the ring into an empty FIFO. Caller has IRQs masked
+static void uart_tx_fill(void) {
+    uint32_t tail = tx_tail;
+    for (int n = 0; n < UART_TX_BURST && tail != tx_head; n++, tail++) {
+        *UART_THR = (uint32_t)(uint8_t)tx_ring[tail & (UART_TX_RING - 1)];
+    }
+    tx_tail = tail;
+}
+
+static void uart_irq(uint32_t id) {
+    (void)id;
+    (void)*UART_IIR; // Acknowledges the THRE interrupt
+    if (*UART_LSR & UART_LSR_THRE) uart_tx_fill();
+    if (tx_tail == tx_head) *UART_IER = 0;
+}
+
+void sys_uart_irq_enable(void) {
+    irq_register(IRQ_UART0, uart_irq);
+    tx_irq = 1;
+    if (tx_tail != tx_head) *UART_IER = UART_IER_ETBEI;
+}
+
+// Never waits: with the interrupt on it just arms THRE, otherwise it tops up the
+// FIFO if it has drained since last time
+static void uart_tx_kick(void) {
+    if (tx_irq) {
+        *UART_IER = UART_IER_ETBEI;
+        return;
+    }
+    uint32_t flags = irq_save();
+    if (*UART_LSR & UART_LSR_THRE) uart_tx_fill();
+    irq_restore(flags);
+}
+
+// A full ring is drained by polling, so output is never dropped, even with IRQs masked
+static void uart_enqueue(char c) {
+    while (tx_head - tx_tail >= UART_TX_RING) {
+        uint32_t flags = irq_save();
+        if (*UART_LSR & UART_LSR_THRE) uart_tx_fill();
+        irq_restore(flags);
+    }
+    tx_ring[tx_head & (UART_TX_RING - 1)] = c;
+    tx_head = tx_head + 1;
+}
+
+// Blocks until every queued byte has left the shift register. Works with IRQs
+// masked, so it is usable from a panic path
+void sys_uart_flush(void) {
+    uint32_t flags = irq_save();
+    while (tx_tail != tx_head) {
+        if (*UART_LSR & UART_LSR_THRE) uart_tx_fill();
+    }
+    while (!(*UART_LSR & UART_LSR_TEMT));
+    irq_restore(flags);
 }
 
 void sys_uart_putc(char c)
 {
-    *UART_THR = (uint32_t)c;
+    uart_enqueue(c);
+    uart_tx_kick();
 }
 
 char sys_uart_getc(void)
@@ -55,8 +124,9 @@ void sys_uart_puts(const char *str){
         return;
 
     while (*str) {
-        sys_uart_putc(*str++);
+        uart_enqueue(*str++);
     }
+    uart_tx_kick();
 }
 
 
@@ -68,7 +138,7 @@ static void uart_put_uint(unsigned int val, int base)
     int i = 0;
 
     if (val == 0) {
-        sys_uart_putc('0');
+        uart_enqueue('0');
         return;
     }
 
@@ -79,7 +149,7 @@ static void uart_put_uint(unsigned int val, int base)
     }
 
     while (i--)
-        sys_uart_putc(buf[i]);
+        uart_enqueue(buf[i]);
 }
 
 
@@ -91,7 +161,7 @@ int printf(const char *fmt, ...)
     while (*fmt) {
 
         if (*fmt != '%') {
-            sys_uart_putc(*fmt++);
+            uart_enqueue(*fmt++);
             continue;
         }
 
@@ -101,20 +171,20 @@ int printf(const char *fmt, ...)
 
         case 's': {
             char *s = va_arg(ap, char *);
-            sys_uart_puts(s ? s : "(null)");
+            for (const char *p = s ? s : "(null)"; *p; p++) uart_enqueue(*p);
             break;
         }
 
         case 'c': {
             char c = (char)va_arg(ap, int);
-            sys_uart_putc(c);
+            uart_enqueue(c);
             break;
         }
 
         case 'd': {
             int v = va_arg(ap, int);
             if (v < 0) {
-                sys_uart_putc('-');
+                uart_enqueue('-');
                 v = -v;
             }
             uart_put_uint((unsigned)v, 10);
@@ -135,12 +205,12 @@ int printf(const char *fmt, ...)
         }
 
         case '%':
-            sys_uart_putc('%');
+            uart_enqueue('%');
             break;
 
         default:
-            sys_uart_putc('%');
-            sys_uart_putc(*fmt);
+            uart_enqueue('%');
+            uart_enqueue(*fmt);
             break;
         }
 
@@ -148,5 +218,6 @@ int printf(const char *fmt, ...)
     }
 
     va_end(ap);
+    uart_tx_kick();
     return 0;
 }
\ No newline at end of file
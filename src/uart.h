@@ -19,18 +19,31 @@
 #define UART_DLL       ((volatile uint32_t *)(UART0_BASE + 0x00))
 #define UART_DLH       ((volatile uint32_t *)(UART0_BASE + 0x04))
 #define UART_IER       ((volatile uint32_t *)(UART0_BASE + 0x04))
+#define UART_IIR       ((volatile uint32_t *)(UART0_BASE + 0x08))
 #define UART_FCR       ((volatile uint32_t *)(UART0_BASE + 0x08))
 #define UART_LCR       ((volatile uint32_t *)(UART0_BASE + 0x0c))
-#define UART_LSR       ((volatile uint32_t *)(UART0_BASE + 0x7c))
+#define UART_LSR       ((volatile uint32_t *)(UART0_BASE + 0x14))
+#define UART_USR       ((volatile uint32_t *)(UART0_BASE + 0x7c))
+
+#define UART_IER_ETBEI (1 << 1)   // Interrupt when the transmit FIFO empties
+#define UART_LSR_THRE  (1 << 5)   // Transmit FIFO empty
+#define UART_LSR_TEMT  (1 << 6)   // FIFO and shift register empty
+
+// Output is queued in a RAM ring and fed to the FIFO a burst at a time, by the
+// THRE interrupt once sys_uart_irq_enable() has run, by polling before that
+#define UART_TX_RING   4096       // Power of two
+#define UART_TX_BURST  16         // Bytes that fit an empty FIFO (64 on the H3, 16 on a 16550)
 
 #define GR "\033[32m"
 #define RS  "\033[0m"
 #define BG_YEL "\033[1;32m"
 
 void sys_uart_init(void);
+void sys_uart_irq_enable(void);
 char sys_uart_getc(void);
 void sys_uart_putc(char c);
 void sys_uart_puts(const char *str);
+void sys_uart_flush(void);
 
 
 int printf(const char *fmt, ...);
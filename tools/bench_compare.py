@@ -0,0 +1,72 @@
+#!/usr/bin/env python3
+"""Compare two tools/run_bench.sh CSV files and flag regressions.
+
+Usage: bench_compare.py [--threshold 10] baseline.csv current.csv
+
+Each (test, param) row is matched across the files. Throughput (kib_per_s,
+or ops_per_s for metadata tests that move no data) regresses when it drops
+by more than the threshold percentage; p99 latency when it grows by more.
+The exit status is 1 if anything regressed or went missing, so the script
+can gate a build.
+"""
+
+import argparse
+import csv
+import sys
+
+
+def load(path):
+    with open(path, newline="") as f:
+        return {(r["test"], int(r["param"])): r for r in csv.DictReader(f)}
+
+
+def change(old, new):
+    return (new - old) * 100.0 / old if old else 0.0
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Compare two storage benchmark runs")
+    ap.add_argument("--threshold", type=float, default=10.0, help="regression threshold in percent (default 10)")
+    ap.add_argument("baseline")
+    ap.add_argument("current")
+    args = ap.parse_args()
+
+    base, cur = load(args.baseline), load(args.current)
+    bad = 0
+
+    print("%-10s %8s %14s %14s %8s %10s %10s %8s" %
+          ("test", "param", "base rate", "cur rate", "delta%", "base p99", "cur p99", "delta%"))
+    for key in sorted(base):
+        b = base[key]
+        c = cur.get(key)
+        if c is None:
+            print("%-10s %8d missing from %s" % (key[0], key[1], args.current))
+            bad += 1
+            continue
+
+        field = "kib_per_s" if int(b["bytes"]) else "ops_per_s"
+        unit = "KiB/s" if field == "kib_per_s" else "op/s"
+        rate_b, rate_c = int(b[field]), int(c[field])
+        p99_b, p99_c = int(b["p99_us"]), int(c["p99_us"])
+        d_rate, d_p99 = change(rate_b, rate_c), change(p99_b, p99_c)
+
+        flags = []
+        if d_rate < -args.threshold:
+            flags.append("SLOWER")
+        if d_p99 > args.threshold and p99_c - p99_b > 1:  # Ignore 1 us jitter on tiny latencies
+            flags.append("P99")
+        bad += bool(flags)
+
+        print("%-10s %8d %8d %-5s %8d %-5s %+7.1f %10d %10d %+7.1f %s" %
+              (key[0], key[1], rate_b, unit, rate_c, unit, d_rate, p99_b, p99_c, d_p99, " ".join(flags)))
+
+    for key in sorted(set(cur) - set(base)):
+        print("%-10s %8d new in %s" % (key[0], key[1], args.current))
+
+    if bad:
+        print("%d regression(s) above %.1f%%" % (bad, args.threshold))
+    return 1 if bad else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
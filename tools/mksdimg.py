@@ -0,0 +1,318 @@
+#!/usr/bin/env python3
+"""Build an MBR-partitioned FAT32 or exFAT SD card image for QEMU.
+
+Usage: mksdimg.py [--size-mb 512] [--spc 8] [--exfat] out.img
+
+The image holds one FAT32 partition at LBA 2048 with hello_world.txt (long
+file name, short name HELLO_~1.TXT) in the root directory, which is what the
+smoke test in src/main.c expects; the storage benchmark creates its own files.
+QEMU's SD model wants a power-of-two card size, so --size-mb must be one.
+The file is sparse past the first data clusters.
+
+With --exfat the partition is exFAT instead, holding the same hello_world.txt
+plus fixtures for host/test_exfat.c, whose contents follow pattern():
+  contig.bin          5 clusters, NoFatChain
+  chain.bin           5 clusters on a FAT chain, out of physical order
+  Sub Dir/nested.bin  1.5 clusters in a NoFatChain subdirectory
+"""
+
+import argparse
+import struct
+import sys
+
+SECTOR = 512
+PART_LBA = 2048
+RESERVED = 32
+
+
+def lfn_checksum(short):
+    s = 0
+    for b in short:
+        s = (((s & 1) << 7) + (s >> 1) + b) & 0xFF
+    return s
+
+
+def lfn_entries(long, short):
+    parts = (len(long) + 12) // 13
+    out = []
+    for k in range(parts):
+        ordn = parts - k
+        chars = []
+        for j in range(13):
+            p = (ordn - 1) * 13 + j
+            chars.append(ord(long[p]) if p < len(long) else (0 if p == len(long) else 0xFFFF))
+        out.append(struct.pack('<B5HBBB6HH2H', ordn | (0x40 if k == 0 else 0), *chars[0:5], 0x0F, 0,
+                               lfn_checksum(short), *chars[5:11], 0, *chars[11:13]))
+    return out
+
+
+def short_entry(short, attr, cluster, size):
+    return struct.pack('<11sBBBHHHHHHHI', short, attr, 0, 0, 0, 0, 0, cluster >> 16, 0, 0, cluster & 0xFFFF, size)
+
+
+def build_fat32(size_mb, spc):
+    total = size_mb * 1024 * 1024 // SECTOR
+    vol = total - PART_LBA
+    fatsz = ((vol // spc) * 4 + SECTOR - 1) // SECTOR
+    clusters = (vol - RESERVED - 2 * fatsz) // spc
+    if clusters < 65525:
+        # src/fat32.c does not care, but a PC would call this FAT16
+        print("mksdimg: warning: %d clusters is below the FAT32 minimum of 65525" % clusters, file=sys.stderr)
+
+    data_lba = PART_LBA + RESERVED + 2 * fatsz
+    # Only the metadata and the first clusters are non-zero; the rest of the file is left sparse
+    img = bytearray((data_lba + 2 * spc) * SECTOR)
+
+    img[0x1BE:0x1BE + 16] = struct.pack('<B3sB3sII', 0, b'\0\0\0', 0x0C, b'\0\0\0', PART_LBA, vol)
+    img[510:512] = b'\x55\xAA'
+
+    bs = bytearray(SECTOR)
+    bs[0:3] = b'\xEB\x58\x90'
+    bs[3:11] = b'MSWIN4.1'
+    struct.pack_into('<HBHBHHBHHHII', bs, 11, SECTOR, spc, RESERVED, 2, 0, 0, 0xF8, 0, 32, 64, PART_LBA, vol)
+    struct.pack_into('<IHHIHH', bs, 36, fatsz, 0, 0, 2, 1, 6)
+    struct.pack_into('<BBBI11s8s', bs, 0x40, 0x80, 0, 0x29, 0x12345678, b'NO NAME    ', b'FAT32   ')
+    bs[510:512] = b'\x55\xAA'
+    base = PART_LBA * SECTOR
+    img[base:base + SECTOR] = bs
+    img[base + 6 * SECTOR:base + 7 * SECTOR] = bs  # Backup boot sector
+
+    fsinfo = bytearray(SECTOR)
+    struct.pack_into('<I', fsinfo, 0, 0x41615252)
+    struct.pack_into('<III', fsinfo, 484, 0x61417272, 0xFFFFFFFF, 0xFFFFFFFF)  # Free count / next free unknown
+    struct.pack_into('<I', fsinfo, 508, 0xAA550000)
+    img[base + SECTOR:base + 2 * SECTOR] = fsinfo
+
+    def fat_set(c, v):
+        for f in range(2):
+            struct.pack_into('<I', img, (PART_LBA + RESERVED + f * fatsz) * SECTOR + c * 4, v)
+
+    def cluster_offset(c):
+        return (data_lba + (c - 2) * spc) * SECTOR
+
+    fat_set(0, 0x0FFFFFF8)
+    fat_set(1, 0x0FFFFFFF)
+    fat_set(2, 0x0FFFFFFF)  # Root directory
+
+    text = b'Hello from the FAT32 test image! ' * 4
+    fat_set(3, 0x0FFFFFFF)
+    img[cluster_offset(3):cluster_offset(3) + len(text)] = text
+
+    ents = lfn_entries('hello_world.txt', b'HELLO_~1TXT') + [short_entry(b'HELLO_~1TXT', 0x20, 3, len(text))]
+    root = cluster_offset(2)
+    for i, e in enumerate(ents):
+        img[root + i * 32:root + i * 32 + 32] = e
+    return img, total * SECTOR
+
+
+# --- exFAT ---
+
+EXFAT_FAT_OFFSET = 128  # Sectors from the volume start, past the boot region and its backup
+
+
+def pattern(n, seed):
+    """Fixture file contents; host/test_exfat.c computes the same bytes"""
+    return bytes((i * 31 + (i >> 9) + seed) & 0xFF for i in range(n))
+
+
+def exfat_sum(data, skip=()):
+    """Rotate-right-and-add checksum of the boot region and the up-case table"""
+    s = 0
+    for i, b in enumerate(data):
+        if i in skip:
+            continue
+        s = (((s & 1) << 31) + (s >> 1) + b) & 0xFFFFFFFF
+    return s
+
+
+def exfat_sum16(data, skip=()):
+    """16-bit form, for entry set checksums and name hashes"""
+    s = 0
+    for i, b in enumerate(data):
+        if i in skip:
+            continue
+        s = (((s & 1) << 15) + (s >> 1) + b) & 0xFFFF
+    return s
+
+
+def upcase(c):
+    return c - 32 if ord('a') <= c <= ord('z') else c
+
+
+def exfat_entry_set(name, attr, first, size, contiguous, alloc=None):
+    """File, stream extension and name entries, with the set checksum filled in"""
+    units = [ord(ch) for ch in name]
+    nname = (len(units) + 14) // 15
+    alloc = size if alloc is None else alloc
+
+    f = bytearray(32)
+    f[0] = 0x85
+    f[1] = 1 + nname
+    struct.pack_into('<H', f, 4, attr)
+
+    st = bytearray(32)
+    st[0] = 0xC0
+    st[1] = 0x01 | (0x02 if contiguous else 0)
+    st[3] = len(units)
+    struct.pack_into('<H', st, 4, exfat_sum16(b''.join(struct.pack('<H', upcase(u)) for u in units)))
+    struct.pack_into('<QII', st, 8, size, 0, first)
+    struct.pack_into('<Q', st, 24, alloc)
+
+    out = f + st
+    for k in range(nname):
+        e = bytearray(32)
+        e[0] = 0xC1
+        for j, u in enumerate(units[k * 15:k * 15 + 15]):
+            struct.pack_into('<H', e, 2 + 2 * j, u)
+        out += e
+    struct.pack_into('<H', out, 2, exfat_sum16(out, skip=(2, 3)))
+    return out
+
+
+def build_exfat(size_mb, spc):
+    total = size_mb * 1024 * 1024 // SECTOR
+    vol = total - PART_LBA
+    spc_shift = spc.bit_length() - 1
+
+    # The heap starts cluster-aligned after the FAT; the FAT covers what is left
+    clusters = vol // spc
+    while True:
+        fat_len = ((clusters + 2) * 4 + SECTOR - 1) // SECTOR
+        heap = (EXFAT_FAT_OFFSET + fat_len + spc - 1) // spc * spc
+        fit = (vol - heap) // spc
+        if fit >= clusters:
+            break
+        clusters = fit
+
+    fat = {0: 0xFFFFFFF8, 1: 0xFFFFFFFF}
+    data = {}  # Cluster -> contents
+    next_free = [2]
+
+    def alloc(n):
+        first = next_free[0]
+        next_free[0] += n
+        return first
+
+    def put(first, blob):
+        for i in range(0, len(blob), spc * SECTOR):
+            data[first + i // (spc * SECTOR)] = blob[i:i + spc * SECTOR]
+
+    def chain(cl):
+        for a, b in zip(cl, cl[1:]):
+            fat[a] = b
+        fat[cl[-1]] = 0xFFFFFFFF
+
+    bpc = spc * SECTOR
+    nbitmap = ((clusters + 7) // 8 + bpc - 1) // bpc
+    bitmap_c = alloc(nbitmap)
+    chain(list(range(bitmap_c, bitmap_c + nbitmap)))
+
+    table = b''.join(struct.pack('<H', upcase(c)) for c in range(128))
+    upcase_c = alloc(1)
+    chain([upcase_c])
+    put(upcase_c, table)
+
+    root_c = alloc(1)
+    chain([root_c])
+    sub_c = alloc(1)
+
+    text = b'Hello from the exFAT test image! ' * 4
+    hello_c = alloc(1)
+    put(hello_c, text)
+
+    contig = pattern(5 * bpc, 1)
+    contig_c = alloc(5)
+    put(contig_c, contig)
+
+    # chain.bin's clusters interleave with a gap cluster and run backwards in places
+    chained = pattern(5 * bpc, 2)
+    base = alloc(7)
+    order = [base + 4, base, base + 1, base + 6, base + 2]
+    chain(order)
+    for i, c in enumerate(order):
+        data[c] = chained[i * bpc:(i + 1) * bpc]
+    used = set(order) | set(range(bitmap_c, base)) | {sub_c}
+
+    nested = pattern(bpc + bpc // 2, 3)
+    nested_c = alloc(2)
+    put(nested_c, nested)
+    used |= set(range(base + 7, next_free[0]))
+
+    sub = exfat_entry_set('nested.bin', 0x20, nested_c, len(nested), True)
+    put(sub_c, bytes(sub))
+
+    label = bytearray(32)
+    label[0] = 0x83
+    label[1] = 6
+    for j, ch in enumerate('SDTEST'):
+        struct.pack_into('<H', label, 2 + 2 * j, ord(ch))
+    bm = bytearray(32)
+    bm[0] = 0x81
+    struct.pack_into('<IQ', bm, 20, bitmap_c, (clusters + 7) // 8)
+    uc = bytearray(32)
+    uc[0] = 0x82
+    struct.pack_into('<I', uc, 4, exfat_sum(table))
+    struct.pack_into('<IQ', uc, 20, upcase_c, len(table))
+    root = (label + bm + uc +
+            exfat_entry_set('hello_world.txt', 0x20, hello_c, len(text), True) +
+            exfat_entry_set('contig.bin', 0x20, contig_c, len(contig), True) +
+            exfat_entry_set('chain.bin', 0x20, order[0], len(chained), False) +
+            exfat_entry_set('Sub Dir', 0x10, sub_c, bpc, True))
+    put(root_c, bytes(root))
+
+    bits = bytearray((clusters + 7) // 8)
+    for c in used:
+        bits[(c - 2) // 8] |= 1 << ((c - 2) % 8)
+    put(bitmap_c, bytes(bits))
+
+    # Boot region: boot sector, 8 extended boot sectors, OEM and reserved sectors, checksum
+    bs = bytearray(SECTOR)
+    bs[0:3] = b'\xEB\x76\x90'
+    bs[3:11] = b'EXFAT   '
+    struct.pack_into('<QQIIIIIIHHBBBBB', bs, 0x40, PART_LBA, vol, EXFAT_FAT_OFFSET, fat_len, heap, clusters,
+                     root_c, 0x12345678, 0x0100, 0, 9, spc_shift, 1, 0x80, 0)
+    bs[510:512] = b'\x55\xAA'
+    region = bytearray(bs)
+    for _ in range(8):
+        ext = bytearray(SECTOR)
+        struct.pack_into('<I', ext, 508, 0xAA550000)
+        region += ext
+    region += bytearray(2 * SECTOR)
+    region += struct.pack('<I', exfat_sum(region, skip=(106, 107, 112))) * (SECTOR // 4)
+
+    heap_lba = PART_LBA + heap
+    img = bytearray((heap_lba + next_free[0] * spc) * SECTOR)
+    img[0x1BE:0x1BE + 16] = struct.pack('<B3sB3sII', 0, b'\0\0\0', 0x07, b'\0\0\0', PART_LBA, vol)
+    img[510:512] = b'\x55\xAA'
+    base_off = PART_LBA * SECTOR
+    img[base_off:base_off + len(region)] = region
+    img[base_off + len(region):base_off + 2 * len(region)] = region  # Backup boot region
+
+    fat_off = (PART_LBA + EXFAT_FAT_OFFSET) * SECTOR
+    for c, v in fat.items():
+        struct.pack_into('<I', img, fat_off + c * 4, v)
+    for c, blob in data.items():
+        off = (heap_lba + (c - 2) * spc) * SECTOR
+        img[off:off + len(blob)] = blob
+    return img, total * SECTOR
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Generate a FAT32 SD card image")
+    ap.add_argument("--size-mb", type=int, default=512, help="card size in MiB, a power of two (default 512)")
+    ap.add_argument("--spc", type=int, default=8, choices=[1, 2, 4, 8, 16, 32, 64, 128],
+                    help="sectors per cluster (default 8, i.e. 4 KB clusters)")
+    ap.add_argument("--exfat", action="store_true", help="format the partition as exFAT")
+    ap.add_argument("image")
+    args = ap.parse_args()
+
+    if args.size_mb <= 0 or args.size_mb & (args.size_mb - 1):
+        sys.exit("mksdimg: --size-mb must be a power of two")
+    img, size = (build_exfat if args.exfat else build_fat32)(args.size_mb, args.spc)
+    with open(args.image, "wb") as f:
+        f.write(img)
+        f.truncate(size)
+
+
+if __name__ == "__main__":
+    main()
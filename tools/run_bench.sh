@@ -0,0 +1,56 @@
+#!/bin/sh
+# Run a -DSTORAGE_BENCH kernel under QEMU on a freshly generated SD image and
+# collect its RESULT lines as CSV.
+#
+# Usage: run_bench.sh kernel.elf [out.csv]
+#
+# Environment: QEMU (default qemu-system-arm), BENCH_TIMEOUT seconds (default 600),
+# BENCH_IMAGE_MB / BENCH_SPC passed to mksdimg.py, BENCH_LOG to keep the console log.
+# Compare two runs with tools/bench_compare.py.
+
+set -e
+
+if [ $# -lt 1 ]; then
+    echo "usage: $0 kernel.elf [out.csv]" >&2
+    exit 2
+fi
+
+KERNEL=$1
+OUT=${2:-bench.csv}
+QEMU=${QEMU:-qemu-system-arm}
+TIMEOUT=${BENCH_TIMEOUT:-600}
+TOOLS=$(dirname "$0")
+WORK=$(mktemp -d)
+LOG=${BENCH_LOG:-$WORK/console.log}
+trap 'kill $QPID 2>/dev/null || true; rm -rf "$WORK"' EXIT
+
+python3 "$TOOLS/mksdimg.py" --size-mb "${BENCH_IMAGE_MB:-512}" --spc "${BENCH_SPC:-8}" "$WORK/sd.img"
+: > "$LOG"
+
+"$QEMU" -M orangepi-pc -cpu cortex-a7 -m 1G -display none -monitor none \
+    -serial file:"$LOG" -kernel "$KERNEL" \
+    -drive if=sd,format=raw,file="$WORK/sd.img" &
+QPID=$!
+
+# The kernel never exits, so wait for the end marker (or QEMU dying early)
+elapsed=0
+while ! grep -q "BENCH DONE" "$LOG"; do
+    if ! kill -0 $QPID 2>/dev/null; then
+        echo "run_bench: QEMU exited before BENCH DONE" >&2
+        exit 1
+    fi
+    if [ $elapsed -ge "$TIMEOUT" ]; then
+        echo "run_bench: no BENCH DONE after ${TIMEOUT}s" >&2
+        exit 1
+    fi
+    sleep 1
+    elapsed=$((elapsed + 1))
+done
+kill $QPID 2>/dev/null || true
+
+echo "test,param,ops,bytes,total_us,ops_per_s,kib_per_s,p50_us,p90_us,p99_us,max_us" > "$OUT"
+tr -d '\r' < "$LOG" | sed -n 's/^RESULT,//p' >> "$OUT"
+tr -d '\r' < "$LOG" | grep '^ERROR,' >&2 && status=1 || status=0
+
+echo "run_bench: $(($(wc -l < "$OUT") - 1)) results in $OUT"
+exit $status
@@ -0,0 +1,141 @@
+#!/usr/bin/env python3
+"""Turn a trace_dump() capture (see src/trace.h) into a timeline.
+
+Usage: trace_decode.py [--mhz 1008] capture.log
+
+The capture may contain any other console output; only the lines between
+"TRACE BEGIN" and "TRACE END" are read. Timestamps are PMU cycles, unwrapped
+on the assumption that consecutive events are less than 2^32 cycles apart.
+
+Every core counts its own cycles from its own start, so times and deltas are
+kept per core. With events from more than one core (-DSMP), each line starts
+with the core that emitted it and its time is relative to that core's first
+event; lines from different cores are in emission order but their times do
+not compare.
+"""
+
+import argparse
+import sys
+
+CORE_SHIFT = 24  # TRACE_CORE_SHIFT
+
+CMD_ISSUE, CMD_DONE, SD_READ, SD_WRITE, FAT_HIT, FAT_MISS, CLUSTER_ALLOC, MARK = range(1, 9)
+
+NAMES = {
+    CMD_ISSUE: "CMD_ISSUE",
+    CMD_DONE: "CMD_DONE",
+    SD_READ: "SD_READ",
+    SD_WRITE: "SD_WRITE",
+    FAT_HIT: "FAT_HIT",
+    FAT_MISS: "FAT_MISS",
+    CLUSTER_ALLOC: "CLUSTER_ALLOC",
+    MARK: "MARK",
+}
+
+
+def signed(v):
+    return v - (1 << 32) if v & 0x80000000 else v
+
+
+def read_capture(f):
+    events, emitted, inside = [], 0, False
+    for line in f:
+        line = line.strip()
+        if line.startswith("TRACE BEGIN"):
+            parts = line.split()
+            emitted = int(parts[2]) if len(parts) > 2 else 0
+            events, inside = [], True
+        elif line.startswith("TRACE END"):
+            inside = False
+        elif inside:
+            try:
+                ts, typ, a, b = (int(x, 16) for x in line.split())
+            except ValueError:
+                continue  # Console noise interleaved with the dump
+            events.append((ts, typ, a, b))
+    return emitted, events
+
+
+def describe(typ, a, b):
+    if typ == CMD_ISSUE:
+        return "CMD%d arg=0x%x" % (a, b)
+    if typ == CMD_DONE:
+        return "CMD%d status=%d" % (a, signed(b))
+    if typ in (SD_READ, SD_WRITE):
+        return "lba=%d count=%d" % (a, b)
+    if typ == FAT_HIT:
+        return "fat sector %d" % a
+    if typ == FAT_MISS:
+        return "fat sector %d%s" % (a, " (writeback)" if b else "")
+    if typ == CLUSTER_ALLOC:
+        return "cluster %d" % a
+    return "a=0x%x b=0x%x" % (a, b)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("capture", nargs="?", help="serial log (default: stdin)")
+    ap.add_argument("--mhz", type=float, default=1008.0, help="CPU clock for cycle-to-time conversion")
+    ap.add_argument("--summary", action="store_true", help="print only the summary")
+    args = ap.parse_args()
+
+    with (open(args.capture, errors="replace") if args.capture else sys.stdin) as f:
+        emitted, events = read_capture(f)
+    if not events:
+        sys.exit("no trace found")
+
+    us = lambda cycles: cycles / args.mhz
+    multicore = any(typ >> CORE_SHIFT for _, typ, _, _ in events)
+    clocks = {}  # Core -> [t0, last, base, prev_raw]
+    issued = {}
+    counts = {}
+    cmd_lat = {}
+    sectors = {SD_READ: 0, SD_WRITE: 0}
+
+    for raw, typ, a, b in events:
+        core, typ = typ >> CORE_SHIFT, typ & ((1 << CORE_SHIFT) - 1)
+        clock = clocks.get(core)
+        if clock is None:
+            clock = clocks[core] = [raw, raw, 0, raw]
+        if raw < clock[3]:
+            clock[2] += 1 << 32
+        clock[3] = raw
+        t = clock[2] + raw
+        t0, last = clock[0], clock[1]
+
+        counts[typ] = counts.get(typ, 0) + 1
+        extra = ""
+        if typ == CMD_ISSUE:
+            issued[core, a] = t
+        elif typ == CMD_DONE and (core, a) in issued:
+            lat = t - issued.pop((core, a))
+            cmd_lat.setdefault(a, []).append(lat)
+            extra = "  [%.1f us]" % us(lat)
+        elif typ in sectors:
+            sectors[typ] += b
+
+        if not args.summary:
+            print("%s%12.1f  +%9.1f  %-13s %s%s" % ("c%d " % core if multicore else "", us(t - t0), us(t - last),
+                                                    NAMES.get(typ, "TYPE%d" % typ), describe(typ, a, b), extra))
+        clock[1] = t
+
+    print()
+    print("events: %d decoded, %d emitted%s" % (len(events), emitted,
+          ", %d lost to wrap" % (emitted - len(events)) if emitted > len(events) else ""))
+    for core in sorted(clocks):
+        t0, last = clocks[core][:2]
+        print("span: %.1f us%s" % (us(last - t0), " on core %d" % core if multicore else ""))
+    for typ in sorted(counts):
+        print("  %-13s %d" % (NAMES.get(typ, "TYPE%d" % typ), counts[typ]))
+    hits, misses = counts.get(FAT_HIT, 0), counts.get(FAT_MISS, 0)
+    if hits + misses:
+        print("FAT cache hit rate: %.1f%%" % (100.0 * hits / (hits + misses)))
+    print("sectors: %d read, %d written" % (sectors[SD_READ], sectors[SD_WRITE]))
+    for cmd in sorted(cmd_lat):
+        lat = cmd_lat[cmd]
+        print("  CMD%-3d x%-6d min %.1f  avg %.1f  max %.1f us" % (cmd, len(lat), us(min(lat)),
+              us(sum(lat) / len(lat)), us(max(lat))))
+
+
+if __name__ == "__main__":
+    main()